@@ -2,8 +2,86 @@
 #include "Version.h"
 #include "Calibration.h"
 #include "Util.h"
+#include "ThreadPool.h"
 
 namespace ark {
+    namespace {
+        /** board found in a recorded frame */
+        struct FrameBoard {
+            /** true if the board was found */
+            bool found = false;
+
+            /** (x,y,z) coordinates of each corner (zero if the corner has no depth) */
+            std::vector<Vec3f> xyz;
+
+            /** number of corners with depth */
+            int numValid = 0;
+
+            /** mean of the corners with depth */
+            Vec3f center;
+
+            /** variance of the Laplacian over the board, a measure of sharpness */
+            double sharpness = 0.0;
+        };
+
+        /** minimum number of consecutive detections for the board to be considered at a position (not moving) */
+        const int MIN_POSITION_FRAMES = 3;
+
+        /** detect the board in one recorded frame */
+        FrameBoard detectRecordedBoard(const std::string & path, cv::Size board_sz,
+                                       bool (*find_corners)(const cv::Mat &, cv::Size, std::vector<Point2f> &, cv::Mat *))
+        {
+            FrameBoard board;
+            cv::Mat xyzMap, ampMap;
+            {
+                cv::FileStorage fs(path, cv::FileStorage::READ);
+                if (!fs.isOpened()) return board;
+                fs["xyzMap"] >> xyzMap;
+                fs["ampMap"] >> ampMap;
+
+                // cameras without an amplitude image record IR instead
+                if (ampMap.empty()) fs["irMap"] >> ampMap;
+            }
+            if (xyzMap.empty() || ampMap.empty()) return board;
+
+            std::vector<Point2f> corners;
+            cv::Mat gray;
+            if (!find_corners(ampMap, board_sz, corners, &gray)) return board;
+
+            Vec3f sum(0.0f, 0.0f, 0.0f);
+            board.xyz.reserve(corners.size());
+            for (const Point2f & corner : corners) {
+                Vec3f xyz = util::averageAroundPoint(xyzMap, Point2i((int)corner.x, (int)corner.y), 5);
+                if (xyz[2] > 0) {
+                    ++board.numValid;
+                    sum += xyz;
+                }
+                else {
+                    xyz = Vec3f(0.0f, 0.0f, 0.0f);
+                }
+                board.xyz.push_back(xyz);
+            }
+            if (board.numValid == 0) return board;
+            board.center = sum / board.numValid;
+
+            // sharpness of the board on the upsampled image
+            const int scale = gray.cols / ampMap.cols;
+            cv::Rect bbox = cv::boundingRect(corners);
+            bbox = cv::Rect(bbox.x * scale, bbox.y * scale, bbox.width * scale, bbox.height * scale)
+                   & cv::Rect(0, 0, gray.cols, gray.rows);
+            if (bbox.area() > 0) {
+                cv::Mat laplacian;
+                cv::Laplacian(gray(bbox), laplacian, CV_32F);
+                cv::Scalar mean, stddev;
+                cv::meanStdDev(laplacian, mean, stddev);
+                board.sharpness = stddev[0] * stddev[0];
+            }
+
+            board.found = true;
+            return board;
+        }
+    }
+
     void Calibration::XYZToUnity(DepthCamera& depth_cam, int num_boards, int board_w, int board_h)
     {
         auto board_sz = cv::Size(board_w, board_h);
@@ -11,12 +89,7 @@ namespace ark {
         std::vector<Point2f> cornersAmp; // Corners of amplitude image
         std::vector<Vec3f> cornersXYZ; // Corners of the depth image
         std::vector<std::vector<Vec3f>> XYZ_points;
-        std::vector<Vec3f> upper_left;
-        upper_left.push_back(Vec3f(-0.05, 0.03, 0.40));
-        upper_left.push_back(Vec3f(0.05, 0.03, 0.40));
-        upper_left.push_back(Vec3f(0.0, 0.08, 0.35));
-        upper_left.push_back(Vec3f(0.0, -0.02, 0.35));
-        auto Unity_points = prepareUnityData(upper_left, 0.03, board_h, board_w);
+        auto Unity_points = defaultUnityData(board_w, board_h);
         auto success = 0;
 
         // Collect data for calibration
@@ -28,41 +101,29 @@ namespace ark {
             depth_cam.nextFrame();
             auto xyzMap = depth_cam.getXYZMap();
 
+            // Find chessboards on amplitude
             cv::Mat ampGray;
-            cv::normalize(depth_cam.getAmpMap(), ampGray, 0, 255, cv::NORM_MINMAX, CV_8UC1);
-            cv::equalizeHist(ampGray, ampGray);
-            cv::resize(ampGray, ampGray, cv::Size(ampGray.cols * 4, ampGray.rows * 4));
-
-            // Sharpen amplitude image
-            cv::Mat unsharp_mask;
-            cv::GaussianBlur(ampGray, unsharp_mask, cv::Size(5, 5), 5);
-            cv::addWeighted(ampGray, 1.5, unsharp_mask, -0.5, 0, ampGray);
+            found1 = findBoardCorners(depth_cam.getAmpMap(), board_sz, cornersAmp, &ampGray);
             cv::imshow("Gray Amp", ampGray);
-
-            // Find chessboards on amplitude
-            found1 = findChessboardCorners(ampGray, board_sz, cornersAmp, CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_FILTER_QUADS);
             if (found1) {
-                cv::cornerSubPix(ampGray, cornersAmp, cv::Size(11, 11), cv::Size(-1, -1), cv::TermCriteria(CV_TERMCRIT_EPS | CV_TERMCRIT_ITER, 30, 0.1));
+                const float scale = (float)ampGray.cols / depth_cam.getAmpMap().cols;
+                std::vector<Point2f> cornersGray(cornersAmp);
+                for (auto & corner : cornersGray) corner *= scale;
+
                 auto ampRGB = ampGray.clone();
                 cv::cvtColor(ampRGB, ampRGB, CV_GRAY2BGR);
-                cv::drawChessboardCorners(ampRGB, board_sz, cornersAmp, found1);
+                cv::drawChessboardCorners(ampRGB, board_sz, cornersGray, found1);
                 cv::imshow("Gray Corners", ampRGB);
 
-                for (auto i = 0; i < cornersAmp.size(); i++)
-                {
-                    cornersAmp[i].x = cornersAmp[i].x / 4;
-                    cornersAmp[i].y = cornersAmp[i].y / 4;
-                }
-
+                // corners without depth are kept as zero (and skipped when solving), so that
+                // each corner stays aligned with its Unity point
+                int numValid = 0;
                 for (auto i = 0; i < cornersAmp.size(); i++)
                 {
                     auto xyz = util::averageAroundPoint(xyzMap, cv::Point2i(cornersAmp[i].x, cornersAmp[i].y), 5);
-                    cv::Point3f pt;
-                    pt.x = xyz[0]; pt.y = xyz[1], pt.z = xyz[2];
-                    if (pt.z == 0) {
-                        continue;
-                    }
-                    cornersXYZ.push_back(pt);
+                    if (xyz[2] > 0) ++numValid;
+                    else xyz = Vec3f(0, 0, 0);
+                    cornersXYZ.push_back(xyz);
                 }
 
                 int c = cv::waitKey(1);
@@ -70,7 +131,7 @@ namespace ark {
                 {
                     success++;
                     XYZ_points.push_back(cornersXYZ);
-                    printf("%u points recorded!\n", (unsigned) cornersXYZ.size());
+                    printf("%d points recorded!\n", numValid);
                 }
             }
 
@@ -82,42 +143,202 @@ namespace ark {
         }
 
         /**** Perform calculations ****/
-        Calibration::writeDataToFile(Unity_points, 4, 3, "Unity.txt");
-        Calibration::writeDataToFile(XYZ_points, 4, 3, "XYZ.txt");
-        float x_input[3][48];
-        float y_input[3][48];
-        auto count = 0;
-        for (auto i = 0; i < XYZ_points.size(); i++)
+        Calibration::writeDataToFile(Unity_points, board_w, board_h, "Unity.txt");
+        Calibration::writeDataToFile(XYZ_points, board_w, board_h, "XYZ.txt");
+
+        cv::Mat r, t;
+        double rmsError, maxError;
+        if (solveRT(XYZ_points, Unity_points, r, t, rmsError, maxError) < 3) {
+            printf("Not enough points recorded to calibrate!\n");
+            return;
+        }
+        printf("Reprojection error: %f m (RMS), %f m (max)\n", rmsError, maxError);
+        writeRT(r, t);
+    }
+
+    Calibration::OfflineResult Calibration::XYZToUnityOffline(const std::vector<std::string> & frame_paths,
+        int board_w, int board_h, const std::vector<std::vector<Vec3f>> & unity_points,
+        int views_per_position, float min_position_distance)
+    {
+        OfflineResult result;
+        const cv::Size board_sz(board_w, board_h);
+        const int N = (int)frame_paths.size();
+        result.numFrames = N;
+
+        // detect the board in all frames in parallel
+        std::vector<FrameBoard> boards(N);
+        ThreadPool::global().parallelFor(0, N, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                boards[i] = detectRecordedBoard(frame_paths[i], board_sz, &Calibration::findBoardCorners);
+            }
+        }, 1, ThreadPool::NORMAL);
+
+        // group consecutive detections of the board at the same position
+        std::vector<std::vector<int>> positions;
+        Vec3f anchor;
+        for (int i = 0; i < N; ++i) {
+            if (!boards[i].found) continue;
+            ++result.numDetected;
+
+            if (positions.empty() || cv::norm(boards[i].center - anchor) > min_position_distance) {
+                positions.push_back(std::vector<int>());
+                anchor = boards[i].center;
+            }
+            positions.back().push_back(i);
+        }
+
+        // drop groups where the board was only passing through
+        positions.erase(std::remove_if(positions.begin(), positions.end(),
+            [](const std::vector<int> & frames) { return (int)frames.size() < MIN_POSITION_FRAMES; }),
+            positions.end());
+
+        if (positions.size() > unity_points.size()) {
+            // keep the positions the board was held at longest, in recording order
+            std::vector<int> order(positions.size());
+            for (int i = 0; i < (int)order.size(); ++i) order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+                return positions[a].size() > positions[b].size();
+            });
+            order.resize(unity_points.size());
+            std::sort(order.begin(), order.end());
+
+            std::vector<std::vector<int>> kept;
+            for (int i : order) kept.push_back(positions[i]);
+            positions.swap(kept);
+        }
+        else if (positions.size() < unity_points.size()) {
+            std::cerr << "XYZToUnityOffline: board found at " << positions.size() << " positions, expected "
+                      << unity_points.size() << "\n";
+        }
+
+        // use the most complete, sharpest views of each position
+        std::vector<std::vector<Vec3f>> XYZ_points, Unity_points;
+        for (size_t p = 0; p < positions.size(); ++p) {
+            std::vector<int> & frames = positions[p];
+            std::sort(frames.begin(), frames.end(), [&](int a, int b) {
+                if (boards[a].numValid != boards[b].numValid) return boards[a].numValid > boards[b].numValid;
+                return boards[a].sharpness > boards[b].sharpness;
+            });
+            if ((int)frames.size() > views_per_position) frames.resize(std::max(1, views_per_position));
+            std::sort(frames.begin(), frames.end());
+
+            for (int i : frames) {
+                XYZ_points.push_back(boards[i].xyz);
+                Unity_points.push_back(unity_points[p]);
+            }
+            result.viewFrames.push_back(frames);
+        }
+
+        result.numPoints = solveRT(XYZ_points, Unity_points, result.R, result.T, result.rmsError, result.maxError);
+        return result;
+    }
+
+    std::vector<std::string> Calibration::listRecording(const std::string & directory)
+    {
+        namespace fs = boost::filesystem;
+        std::vector<std::string> paths;
+
+        if (!fs::is_directory(directory)) return paths;
+        for (fs::directory_iterator it(directory), end; it != end; ++it) {
+            if (!fs::is_regular_file(it->path())) continue;
+            const std::string ext = it->path().extension().string();
+            if (ext == ".yml" || ext == ".yaml" || ext == ".xml" || ext == ".json" || ext == ".gz") {
+                paths.push_back(it->path().string());
+            }
+        }
+
+        // order by frame number (img9.yml before img10.yml)
+        std::sort(paths.begin(), paths.end(), [](const std::string & a, const std::string & b) {
+            if (a.size() != b.size()) return a.size() < b.size();
+            return a < b;
+        });
+        return paths;
+    }
+
+    void Calibration::writeRT(const cv::Mat & R, const cv::Mat & T, const std::string & filename)
+    {
+        cv::FileStorage fs(filename, cv::FileStorage::WRITE);
+        fs << "R" << R;
+        fs << "T" << T;
+        fs.release();
+    }
+
+    int Calibration::solveRT(const std::vector<std::vector<Vec3f>> & XYZ_points,
+                             const std::vector<std::vector<Vec3f>> & Unity_points,
+                             cv::Mat & R, cv::Mat & T, double & rms_error, double & max_error)
+    {
+        std::vector<Vec3f> xyz, unity;
+        for (size_t i = 0; i < XYZ_points.size() && i < Unity_points.size(); i++)
         {
-            for (auto v = 0; v < XYZ_points[i].size(); v++)
+            for (size_t v = 0; v < XYZ_points[i].size() && v < Unity_points[i].size(); v++)
             {
-                x_input[0][count] = XYZ_points[i][v][0];
-                x_input[1][count] = XYZ_points[i][v][1];
-                x_input[2][count] = XYZ_points[i][v][2];
-                y_input[0][count] = Unity_points[i][v][0];
-                y_input[1][count] = Unity_points[i][v][1];
-                y_input[2][count] = Unity_points[i][v][2];
-                count++;
+                if (XYZ_points[i][v][2] <= 0) continue;
+                xyz.push_back(XYZ_points[i][v]);
+                unity.push_back(Unity_points[i][v]);
             }
         }
 
-        auto x = cv::Mat(3, 48, CV_32FC1, &x_input); //XYZ
-        auto y = cv::Mat(3, 48, CV_32FC1, &y_input); //Unity
-        cv::Mat r, t;
-        computeRT(x, y, &r, &t);
-        cv::FileStorage fs("RT_Transform.txt", cv::FileStorage::WRITE);
-        fs << "R" << r;
-        fs << "T" << t;
-        fs.release();
+        const int n = (int)xyz.size();
+        rms_error = max_error = -1.0;
+        if (n < 3) {
+            R.release();
+            T.release();
+            return n;
+        }
+
+        // one point per column
+        cv::Mat x = cv::Mat(n, 3, CV_32FC1, xyz.data()).t(); //XYZ
+        cv::Mat y = cv::Mat(n, 3, CV_32FC1, unity.data()).t(); //Unity
+        computeRT(x, y, &R, &T);
+
+        cv::Mat projected = R * x + cv::repeat(T, 1, n);
+        double sqTotal = 0.0;
+        max_error = 0.0;
+        for (int i = 0; i < n; i++)
+        {
+            const double err = cv::norm(projected.col(i) - y.col(i));
+            sqTotal += err * err;
+            max_error = std::max(max_error, err);
+        }
+        rms_error = std::sqrt(sqTotal / n);
+
+        return n;
+    }
+
+    bool Calibration::findBoardCorners(const cv::Mat & amp_map, cv::Size board_sz,
+                                       std::vector<Point2f> & corners, cv::Mat * gray)
+    {
+        const int scale = 4;
+
+        cv::Mat ampGray;
+        cv::normalize(amp_map, ampGray, 0, 255, cv::NORM_MINMAX, CV_8UC1);
+        cv::equalizeHist(ampGray, ampGray);
+        cv::resize(ampGray, ampGray, cv::Size(ampGray.cols * scale, ampGray.rows * scale));
+
+        // Sharpen amplitude image
+        cv::Mat unsharp_mask;
+        cv::GaussianBlur(ampGray, unsharp_mask, cv::Size(5, 5), 5);
+        cv::addWeighted(ampGray, 1.5, unsharp_mask, -0.5, 0, ampGray);
+        if (gray) *gray = ampGray;
+
+        corners.clear();
+        bool found = findChessboardCorners(ampGray, board_sz, corners, CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_FILTER_QUADS);
+        if (!found) return false;
+
+        cv::cornerSubPix(ampGray, corners, cv::Size(11, 11), cv::Size(-1, -1), cv::TermCriteria(CV_TERMCRIT_EPS | CV_TERMCRIT_ITER, 30, 0.1));
+        for (auto & corner : corners) corner /= (float)scale;
+        return true;
     }
 
     void Calibration::computeRT(cv::Mat x, cv::Mat y, cv::Mat *R, cv::Mat *t)
     {
 
-        cv::Mat x_mean, y_mean, H;
+        cv::Mat x_mean, y_mean;
         cv::reduce(x, x_mean, 1, CV_REDUCE_AVG);
         cv::reduce(y, y_mean, 1, CV_REDUCE_AVG);
 
+        cv::Mat H = cv::Mat::zeros(x.rows, y.rows, x.type());
+
         for (auto i = 0; i < x.cols; i++)
         {
             H = H + (x.col(i) - x_mean) * ((y.col(i) - y_mean).t());
@@ -197,6 +418,16 @@ namespace ark {
         return Unity_points;
     }
 
+    std::vector<std::vector<Vec3f>> Calibration::defaultUnityData(int board_w, int board_h)
+    {
+        std::vector<Vec3f> upper_left;
+        upper_left.push_back(Vec3f(-0.05, 0.03, 0.40));
+        upper_left.push_back(Vec3f(0.05, 0.03, 0.40));
+        upper_left.push_back(Vec3f(0.0, 0.08, 0.35));
+        upper_left.push_back(Vec3f(0.0, -0.02, 0.35));
+        return prepareUnityData(upper_left, 0.03, board_h, board_w);
+    }
+
     void Calibration::writeDataToFile(std::vector<std::vector<Vec3f>> points, int board_w, int board_h, std::string filename)
     {
         ofstream output_file;
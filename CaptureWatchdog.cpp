@@ -0,0 +1,185 @@
+#include "stdafx.h"
+#include "Version.h"
+#include "CaptureWatchdog.h"
+
+namespace ark {
+    CaptureWatchdog::CaptureWatchdog(DepthCamera & camera, float expected_fps,
+                                     float stall_frames, int min_stall_ms)
+        : camera(camera), state(std::make_shared<State>())
+    {
+        const double frameMs = expected_fps > 0.0f ? 1000.0 / expected_fps : 0.0;
+        stallThresholdMs = std::max((double)min_stall_ms, frameMs * stall_frames);
+    }
+
+    CaptureWatchdog::~CaptureWatchdog()
+    {
+        stop();
+    }
+
+    void CaptureWatchdog::start(const ThreadConfig & config)
+    {
+        if (isRunning()) return;
+
+        {
+            std::lock_guard<std::mutex> lock(stopMutex);
+            stopping = false;
+        }
+        thread = config.launch(std::bind(&CaptureWatchdog::watchLoop, this));
+    }
+
+    void CaptureWatchdog::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(stopMutex);
+            stopping = true;
+        }
+        stopCondition.notify_all();
+
+        if (thread.joinable()) thread.join();
+    }
+
+    bool CaptureWatchdog::isRunning() const
+    {
+        return thread.joinable();
+    }
+
+    bool CaptureWatchdog::isStalled() const
+    {
+        return state->stalled.load();
+    }
+
+    double CaptureWatchdog::getStallThresholdMs() const
+    {
+        return stallThresholdMs;
+    }
+
+    int CaptureWatchdog::addEventCallback(std::function<void(const Event &)> func)
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        const int id = state->callbacks.empty() ? 0 : state->callbacks.rbegin()->first + 1;
+        state->callbacks[id] = func;
+        return id;
+    }
+
+    void CaptureWatchdog::removeEventCallback(int id)
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->callbacks.erase(id);
+    }
+
+    CaptureWatchdog::Stats CaptureWatchdog::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->stats;
+    }
+
+    const char * CaptureWatchdog::eventName(EventType type)
+    {
+        static const char * NAMES[] = { "stall", "reconnect attempt", "reconnect failed", "recovered" };
+        return NAMES[type];
+    }
+
+    void CaptureWatchdog::State::emit(const Event & event)
+    {
+        std::vector<std::function<void(const Event &)> > funcs;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto & callback : callbacks) funcs.push_back(callback.second);
+        }
+
+        for (const auto & func : funcs) {
+            func(event);
+        }
+    }
+
+    void CaptureWatchdog::requestReconnect(int attempt, double stall_ms)
+    {
+        state->reconnectPending = true;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            ++state->stats.numReconnectAttempts;
+        }
+        state->emit(Event{ RECONNECT_ATTEMPT, stall_ms, attempt });
+
+        // the callback may run after the watchdog is destroyed, so it only holds the shared state
+        std::shared_ptr<State> st = state;
+        camera.requestReconnect([st, attempt](bool success) {
+            if (!success) {
+                {
+                    std::lock_guard<std::mutex> lock(st->mutex);
+                    ++st->stats.numReconnectFailures;
+                }
+                st->emit(Event{ RECONNECT_FAILED, 0.0, attempt });
+            }
+            st->reconnectPending = false;
+        });
+    }
+
+    void CaptureWatchdog::watchLoop()
+    {
+        using namespace std::chrono;
+        typedef steady_clock::time_point time_point;
+
+        const milliseconds checkInterval(std::max(10, std::min(100, (int)(stallThresholdMs / 4))));
+        const time_point startTime = steady_clock::now();
+
+        // time of the last good frame before the current stall
+        time_point stallFrameTime;
+        int attempt = 0;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(stopMutex);
+                if (stopCondition.wait_for(lock, checkInterval, [this]() { return stopping; })) break;
+            }
+
+            // frames from before the watchdog was started don't count
+            const time_point now = steady_clock::now();
+            const time_point lastFrame = std::max(camera.getLastFrameTime(), startTime);
+
+            if (!state->stalled) {
+                if (!camera.isCapturing()) continue;
+
+                const double sinceFrameMs = duration<double, std::milli>(now - lastFrame).count();
+                if (sinceFrameMs < stallThresholdMs) continue;
+
+                state->stalled = true;
+                stallFrameTime = lastFrame;
+                attempt = 0;
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    ++state->stats.numStalls;
+                }
+
+                std::cerr << "CaptureWatchdog: " << camera.getModelName() << " stalled (no frame for "
+                          << (int)sinceFrameMs << " ms), restarting device\n";
+                state->emit(Event{ STALL, sinceFrameMs, 0 });
+                requestReconnect(++attempt, sinceFrameMs);
+            }
+            else if (lastFrame > stallFrameTime) {
+                // frames resumed
+                const double stallMs = duration<double, std::milli>(lastFrame - stallFrameTime).count();
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    Stats & stats = state->stats;
+                    ++stats.numRecoveries;
+                    stats.lastStallMs = stallMs;
+                    stats.maxStallMs = std::max(stats.maxStallMs, stallMs);
+                    stats.totalStallMs += stallMs;
+                    stats.recentStallMs.push_back(stallMs);
+                    if (stats.recentStallMs.size() > MAX_RECENT_STALLS) stats.recentStallMs.pop_front();
+                }
+                state->stalled = false;
+
+                std::cerr << "CaptureWatchdog: " << camera.getModelName() << " recovered after "
+                          << (int)stallMs << " ms\n";
+                state->emit(Event{ RECOVERED, stallMs, attempt });
+            }
+            else if (!state->reconnectPending && camera.isCapturing()) {
+                // still stalled and the last attempt is done: try again (the camera applies backoff)
+                const double stallMs = duration<double, std::milli>(now - stallFrameTime).count();
+                requestReconnect(++attempt, stallMs);
+            }
+        }
+    }
+}
@@ -3,8 +3,26 @@
 #include "DepthCamera.h"
 #include "Hand.h"
 #include "FrameObject.h"
+#include "ThreadPool.h"
 
 namespace ark {
+    namespace {
+        /** write a frame's maps into file located at "destination" */
+        bool writeFrame(const std::string & destination, const cv::Mat & xyz_map, const cv::Mat & amp_map,
+                        const cv::Mat & flag_map, const cv::Mat & rgb_map, const cv::Mat & ir_map)
+        {
+            cv::FileStorage fs(destination, cv::FileStorage::WRITE);
+
+            fs << "xyzMap" << xyz_map;
+            fs << "ampMap" << amp_map;
+            fs << "flagMap" << flag_map;
+            fs << "rgbMap" << rgb_map;
+            fs << "irMap" << ir_map;
+
+            fs.release();
+            return true;
+        }
+    }
 
     /**
      * Minimum depth of points (in meters). Points under this depth are presumed to be noise. (0.0 to disable)
@@ -26,11 +44,41 @@ namespace ark {
     {
         ASSERT(captureInterrupt == true, "beginCapture: already capturing from this camera");
         captureInterrupt = false;
-        std::thread thd(&DepthCamera::captureThreadingHelper, this, fps_cap,
-            &captureInterrupt, remove_noise);
+
+        ThreadConfig config = getCaptureThreadConfig();
+        {
+            std::lock_guard<std::mutex> lock(captureThreadConfigMutex);
+            effectiveCaptureThreadConfig = config;
+        }
+
+        boost::thread thd = config.launch([this, fps_cap, remove_noise]() {
+            {
+                std::lock_guard<std::mutex> lock(captureThreadConfigMutex);
+                effectiveCaptureThreadConfig = ThreadConfig::current();
+            }
+            captureThreadingHelper(fps_cap, &captureInterrupt, remove_noise);
+        });
         thd.detach();
     }
 
+    void DepthCamera::setCaptureThreadConfig(const ThreadConfig & config)
+    {
+        std::lock_guard<std::mutex> lock(captureThreadConfigMutex);
+        captureThreadConfig = config;
+    }
+
+    ThreadConfig DepthCamera::getCaptureThreadConfig() const
+    {
+        std::lock_guard<std::mutex> lock(captureThreadConfigMutex);
+        return captureThreadConfig;
+    }
+
+    ThreadConfig DepthCamera::getEffectiveCaptureThreadConfig() const
+    {
+        std::lock_guard<std::mutex> lock(captureThreadConfigMutex);
+        return effectiveCaptureThreadConfig;
+    }
+
     void DepthCamera::endCapture()
     {
         captureInterrupt = true;
@@ -38,37 +86,225 @@ namespace ark {
 
     bool DepthCamera::nextFrame(bool removeNoise)
     {
+        // restart the device first, if requested
+        if (reconnectRequested.load()) {
+            handleReconnect();
+        }
+
+        // snapshot the active channels, so that the whole frame sees the same set even if
+        // another thread subscribes meanwhile
+        int available = 0;
+        for (int ch = 0; ch < NUM_CHANNELS; ++ch) {
+            if (hasChannel((Channel)ch)) available |= 1 << ch;
+        }
+        bool changed;
+        {
+            std::lock_guard<std::mutex> lock(subscriptionMutex);
+            frameChannels = subscribedChannels.load() & available;
+            changed = channelsChanged.exchange(false);
+        }
+
+        // let the camera enable or disable streams for newly (un)subscribed channels
+        if (changed) {
+            onChannelsChanged();
+        }
+
         // initialize back buffers
-        initializeImages();
+        initializeImages(frameChannels);
 
         // call update with back buffer images (to allow continued operation on front end)
+        frameTime = std::chrono::steady_clock::time_point();
         update(xyzMapBuf, rgbMapBuf, irMapBuf, ampMapBuf, flagMapBuf);
 
+        // use the device's capture time if the camera reported it
+        if (frameTime == std::chrono::steady_clock::time_point()) {
+            frameTime = std::chrono::steady_clock::now();
+        }
+        const long long captureTicks = frameTime.time_since_epoch().count();
+
         if (!badInput() && xyzMapBuf.data) {
             if (removeNoise) {
                 this->removeNoise(xyzMapBuf, ampMapBuf, flagMapConfidenceThreshold());
             }
-        }
 
-        // lock all buffers while swapping
-        std::lock_guard<std::mutex> lock(imageMutex);
+            TemporalFilter::Ptr filter = std::atomic_load(&temporalFilter);
+            if (filter) {
+                filter->apply(xyzMapBuf);
+            }
 
-        // when update is done, swap buffers to front
-        swapBuffers();
+            lastFrameTicks = captureTicks;
+            ++frameCount;
 
-        // call callbacks
-        for (auto callback : updateCallbacks) {
-            callback.second(*this);
+            // the device is working again: reset the reconnect backoff
+            reconnectBackoff = 0;
         }
 
+        {
+            // lock all buffers while swapping
+            std::lock_guard<std::mutex> lock(imageMutex);
+
+            // when update is done, swap buffers to front
+            swapBuffers(frameChannels);
+            xyzMapTicks = lastFrameTicks.load();
+        }
+        frameCondition.notify_all();
+
+        // call callbacks (outside the lock, so that they may use the image getters)
+        runUpdateCallbacks();
+
         return !badInput();
     }
 
+    void DepthCamera::setTemporalFilter(const TemporalFilter::Ptr & filter)
+    {
+        std::atomic_store(&temporalFilter, filter);
+    }
+
+    TemporalFilter::Ptr DepthCamera::getTemporalFilter() const
+    {
+        return std::atomic_load(&temporalFilter);
+    }
+
     bool DepthCamera::badInput()
     {
         return badInputFlag;
     }
 
+    bool DepthCamera::reconnect()
+    {
+        return false;
+    }
+
+    void DepthCamera::onChannelsChanged()
+    {
+        // by default, inactive channels are simply skipped
+    }
+
+    void DepthCamera::subscribe(Channel channel)
+    {
+        std::lock_guard<std::mutex> lock(subscriptionMutex);
+        if (subscribers[channel]++ == 0) {
+            subscribedChannels |= 1 << channel;
+            channelsChanged = true;
+        }
+    }
+
+    void DepthCamera::unsubscribe(Channel channel)
+    {
+        std::lock_guard<std::mutex> lock(subscriptionMutex);
+        if (subscribers[channel] <= 0) return;
+        if (--subscribers[channel] == 0) {
+            subscribedChannels &= ~(1 << channel);
+            channelsChanged = true;
+        }
+    }
+
+    bool DepthCamera::subscribeImplicitly(Channel channel) const
+    {
+        if (subscribedChannels.load() & (1 << channel)) return false;
+
+        DepthCamera * self = const_cast<DepthCamera *>(this);
+        {
+            std::lock_guard<std::mutex> lock(subscriptionMutex);
+            if (self->implicitSubscriptions & (1 << channel)) return false;
+            self->implicitSubscriptions |= 1 << channel;
+        }
+        self->subscribe(channel);
+        return true;
+    }
+
+    void DepthCamera::waitForImage(std::unique_lock<std::mutex> & lock, const cv::Mat & img) const
+    {
+        // the channel was only just subscribed to: give the capture thread a chance to fill it in
+        if (captureInterrupt) return;
+        frameCondition.wait_for(lock, std::chrono::milliseconds(IMPLICIT_SUBSCRIBE_WAIT_MS),
+            [&] { return img.data != nullptr || captureInterrupt; });
+    }
+
+    bool DepthCamera::hasChannel(Channel channel) const
+    {
+        switch (channel) {
+        case CHANNEL_RGB: return hasRGBMap();
+        case CHANNEL_IR: return hasIRMap();
+        case CHANNEL_AMP: return hasAmpMap();
+        case CHANNEL_FLAG: return hasFlagMap();
+        default: return false;
+        }
+    }
+
+    bool DepthCamera::isChannelActive(Channel channel) const
+    {
+        return (subscribedChannels.load() & (1 << channel)) && hasChannel(channel);
+    }
+
+    bool DepthCamera::isChannelInFrame(Channel channel) const
+    {
+        return (frameChannels & (1 << channel)) != 0;
+    }
+
+    void DepthCamera::setFrameTime(std::chrono::steady_clock::time_point time)
+    {
+        frameTime = time;
+    }
+
+    void DepthCamera::requestReconnect(std::function<void(bool)> on_done)
+    {
+        std::lock_guard<std::mutex> lock(reconnectMutex);
+        if (on_done) reconnectCallbacks.push_back(on_done);
+        reconnectRequested = true;
+    }
+
+    void DepthCamera::setReconnectBackoff(int initial_ms, int max_ms)
+    {
+        std::lock_guard<std::mutex> lock(reconnectMutex);
+        reconnectBackoffInitial = std::max(0, initial_ms);
+        reconnectBackoffMax = std::max(reconnectBackoffInitial, max_ms);
+    }
+
+    void DepthCamera::handleReconnect()
+    {
+        using namespace std::chrono;
+
+        std::vector<std::function<void(bool)> > callbacks;
+        int initialMs, maxMs;
+        {
+            std::lock_guard<std::mutex> lock(reconnectMutex);
+
+            // still backing off after the last attempt: keep the request for later
+            if (steady_clock::now() < nextReconnectTime) return;
+
+            reconnectRequested = false;
+            callbacks.swap(reconnectCallbacks);
+            initialMs = reconnectBackoffInitial;
+            maxMs = reconnectBackoffMax;
+        }
+
+        printf("%s: restarting device...\n", getModelName().c_str());
+        const bool success = reconnect();
+        if (!success) {
+            printf("%s: could not restart device\n", getModelName().c_str());
+        }
+
+        // space out further attempts until the device delivers good frames again
+        reconnectBackoff = reconnectBackoff > 0 ? std::min(reconnectBackoff * 2, maxMs) : initialMs;
+        nextReconnectTime = steady_clock::now() + milliseconds(reconnectBackoff);
+
+        for (const auto & callback : callbacks) {
+            callback(success);
+        }
+    }
+
+    std::chrono::steady_clock::time_point DepthCamera::getLastFrameTime() const
+    {
+        return std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(lastFrameTicks.load()));
+    }
+
+    long long DepthCamera::getFrameCount() const
+    {
+        return frameCount.load();
+    }
+
     /**
     Remove noise on zMap and xyzMap
     */
@@ -102,6 +338,7 @@ namespace ark {
 
     int DepthCamera::addUpdateCallback(std::function<void(DepthCamera&)> func)
     {
+        std::lock_guard<std::mutex> lock(updateCallbackMutex);
         int id;
         if (updateCallbacks.empty()) {
             id = 0;
@@ -116,9 +353,23 @@ namespace ark {
 
     void DepthCamera::removeUpdateCallback(int id)
     {
+        std::lock_guard<std::mutex> lock(updateCallbackMutex);
         updateCallbacks.erase(id);
     }
 
+    void DepthCamera::runUpdateCallbacks()
+    {
+        std::map<int, std::function<void(DepthCamera &)> > callbacks;
+        {
+            std::lock_guard<std::mutex> lock(updateCallbackMutex);
+            callbacks = updateCallbacks;
+        }
+
+        for (auto & callback : callbacks) {
+            callback.second(*this);
+        }
+    }
+
     cv::Size DepthCamera::getImageSize() const
     {
         return cv::Size(getWidth(), getHeight());
@@ -129,54 +380,55 @@ namespace ark {
         return "DepthCamera";
     }
 
-    void DepthCamera::initializeImages()
+    void DepthCamera::initializeImages(int channels)
     {
         cv::Size sz = getImageSize();
 
-        // initialize back buffers, if necessary
+        // initialize back buffers of the active channels
         xyzMapBuf.release();
         xyzMapBuf.create(sz, CV_32FC3);
 
-        if (hasRGBMap()) {
-            rgbMapBuf.release();
+        rgbMapBuf.release();
+        if (channels & (1 << CHANNEL_RGB)) {
             rgbMapBuf.create(sz, CV_8UC3);
         }
 
-        if (hasIRMap()) {
-            irMapBuf.release();
+        irMapBuf.release();
+        if (channels & (1 << CHANNEL_IR)) {
             irMapBuf.create(sz, CV_8U);
         }
 
-        if (hasAmpMap()) {
-            ampMapBuf.release();
+        ampMapBuf.release();
+        if (channels & (1 << CHANNEL_AMP)) {
             ampMapBuf.create(sz, CV_32F);
         }
 
-        if (hasFlagMap()) {
-            flagMapBuf.release();
+        flagMapBuf.release();
+        if (channels & (1 << CHANNEL_FLAG)) {
             flagMapBuf.create(sz, CV_8U);
         }
     }
 
     /** swap a single buffer */
-    void DepthCamera::swapBuffer(bool (DepthCamera::* check_func)() const, cv::Mat & img, cv::Mat & buf)
+    void DepthCamera::swapBuffer(Channel channel, int channels, cv::Mat & img, cv::Mat & buf)
     {
-        if ((this->*check_func)()) {
+        if (channels & (1 << channel)) {
             cv::swap(img, buf);
         }
         else {
-            img.data = nullptr;
+            // release, so that the image of an unsubscribed channel does not keep its buffer alive
+            img.release();
         }
     }
 
     /** swap all buffers */
-    void DepthCamera::swapBuffers()
+    void DepthCamera::swapBuffers(int channels)
     {
         cv::swap(xyzMap, xyzMapBuf);
-        swapBuffer(&DepthCamera::hasRGBMap, rgbMap, rgbMapBuf);
-        swapBuffer(&DepthCamera::hasIRMap, irMap, irMapBuf);
-        swapBuffer(&DepthCamera::hasAmpMap, ampMap, ampMapBuf);
-        swapBuffer(&DepthCamera::hasFlagMap, flagMap, flagMapBuf);
+        swapBuffer(CHANNEL_RGB, channels, rgbMap, rgbMapBuf);
+        swapBuffer(CHANNEL_IR, channels, irMap, irMapBuf);
+        swapBuffer(CHANNEL_AMP, channels, ampMap, ampMapBuf);
+        swapBuffer(CHANNEL_FLAG, channels, flagMap, flagMapBuf);
     }
 
     /**
@@ -184,17 +436,26 @@ namespace ark {
     */
     bool DepthCamera::writeImage(std::string destination) const
     {
-        cv::FileStorage fs(destination, cv::FileStorage::WRITE);
         std::lock_guard<std::mutex> lock(imageMutex);
+        return writeFrame(destination, xyzMap, ampMap, flagMap, rgbMap, irMap);
+    }
 
-        fs << "xyzMap" << xyzMap;
-        fs << "ampMap" << ampMap;
-        fs << "flagMap" << flagMap;
-        fs << "rgbMap" << rgbMap;
-        fs << "irMap" << irMap;
+    void DepthCamera::writeImageAsync(std::string destination, std::function<void(bool)> on_done) const
+    {
+        cv::Mat xyz, amp, flag, rgb, ir;
+        {
+            std::lock_guard<std::mutex> lock(imageMutex);
+            xyz = xyzMap.clone();
+            amp = ampMap.clone();
+            flag = flagMap.clone();
+            rgb = rgbMap.clone();
+            ir = irMap.clone();
+        }
 
-        fs.release();
-        return true;
+        ThreadPool::background().submit([destination, xyz, amp, flag, rgb, ir, on_done]() {
+            bool result = writeFrame(destination, xyz, amp, flag, rgb, ir);
+            if (on_done) on_done(result);
+        }, ThreadPool::LOW);
     }
 
     /**
@@ -205,19 +466,19 @@ namespace ark {
         cv::FileStorage fs;
         fs.open(source, cv::FileStorage::READ);
 
-        std::lock_guard<std::mutex> lock(imageMutex);
-
-        fs["xyzMap"] >> xyzMap;
-        fs["ampMap"] >> ampMap;
-        fs["flagMap"] >> flagMap;
-        fs["rgbMap"] >> rgbMap;
-        fs["irMap"] >> irMap;
-        fs.release();
+        {
+            std::lock_guard<std::mutex> lock(imageMutex);
+
+            fs["xyzMap"] >> xyzMap;
+            fs["ampMap"] >> ampMap;
+            fs["flagMap"] >> flagMap;
+            fs["rgbMap"] >> rgbMap;
+            fs["irMap"] >> irMap;
+            fs.release();
+        }
 
         // call callbacks
-        for (auto callback : updateCallbacks) {
-            callback.second(*this);
-        }
+        runUpdateCallbacks();
 
         return !(xyzMap.rows == 0 || ampMap.rows == 0 || flagMap.rows == 0);
     }
@@ -229,11 +490,21 @@ namespace ark {
         return xyzMap;
     }
 
+    const cv::Mat DepthCamera::getXYZMap(std::chrono::steady_clock::time_point & frame_time) const
+    {
+        std::lock_guard<std::mutex> lock(imageMutex);
+        frame_time = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(xyzMapTicks));
+        if (xyzMap.data == nullptr) return cv::Mat::zeros(getHeight(), getWidth(), CV_32FC3);
+        return xyzMap;
+    }
+
     const cv::Mat DepthCamera::getAmpMap() const
     {
         if (!hasAmpMap()) throw;
+        const bool subscribed = subscribeImplicitly(CHANNEL_AMP);
 
-        std::lock_guard<std::mutex> lock(imageMutex);
+        std::unique_lock<std::mutex> lock(imageMutex);
+        if (subscribed) waitForImage(lock, ampMap);
         if (ampMap.data == nullptr) return cv::Mat::zeros(getHeight(), getWidth(), CV_32F);
         return ampMap;
     }
@@ -241,16 +512,20 @@ namespace ark {
     const cv::Mat DepthCamera::getFlagMap() const
     {
         if (!hasFlagMap()) throw;
+        const bool subscribed = subscribeImplicitly(CHANNEL_FLAG);
 
-        std::lock_guard<std::mutex> lock(imageMutex);
+        std::unique_lock<std::mutex> lock(imageMutex);
+        if (subscribed) waitForImage(lock, flagMap);
         if (flagMap.data == nullptr) return cv::Mat::zeros(getHeight(), getWidth(), CV_8U);
         return flagMap;
     }
 
     const cv::Mat DepthCamera::getRGBMap() const {
         if (!hasRGBMap()) throw;
+        const bool subscribed = subscribeImplicitly(CHANNEL_RGB);
 
-        std::lock_guard<std::mutex> lock(imageMutex);
+        std::unique_lock<std::mutex> lock(imageMutex);
+        if (subscribed) waitForImage(lock, rgbMap);
         if (rgbMap.data == nullptr) return cv::Mat::zeros(getHeight(), getWidth(), CV_8UC3);
         return rgbMap;
     }
@@ -258,8 +533,10 @@ namespace ark {
     const cv::Mat DepthCamera::getIRMap() const
     {
         if (!hasIRMap()) throw;
+        const bool subscribed = subscribeImplicitly(CHANNEL_IR);
 
-        std::lock_guard<std::mutex> lock(imageMutex);
+        std::unique_lock<std::mutex> lock(imageMutex);
+        if (subscribed) waitForImage(lock, irMap);
         if (irMap.data == nullptr) return cv::Mat::zeros(getImageSize(), CV_8U);
         return irMap;
     }
@@ -309,7 +586,10 @@ namespace ark {
         }
 
         while (interrupt == nullptr || !(*interrupt)) {
-            this->nextFrame(remove_noise);
+            if (!this->nextFrame(remove_noise)) {
+                // don't spin while the device is failing
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
 
             // cap FPS
             if (fps_cap > 0) {
@@ -3,12 +3,14 @@
 
 namespace ark {
     Detector::Detector(DetectionParams::Ptr params)
-        : params(params ? params : DetectionParams::DEFAULT) {
+        : params(params ? params : DetectionParams::DEFAULT), pendingParams(this->params) {
         callback = std::bind(&Detector::callbackHelper, this, std::placeholders::_1);
+        pendingParamsReader.refresh(pendingParams);
     } 
 
     void Detector::update(const cv::Mat & image)
     {
+        applyPendingParams();
         this->image = image;
         detect(this->image);
         lastCamera = nullptr;
@@ -19,6 +21,7 @@ namespace ark {
     {
         // stop if the camera is still on the same frame as before
         if (onSameFrame && lastCamera == &camera) return;
+        applyPendingParams();
         this->image = camera.getXYZMap();
         detect(this->image);
 
@@ -32,7 +35,16 @@ namespace ark {
 
     void Detector::setParams(const DetectionParams::Ptr params)
     {
-        this->params = params;
+        // copy, so that the caller may keep modifying its own instance
+        pendingParams.publish(std::make_shared<DetectionParams>(params ? *params : *DetectionParams::DEFAULT));
+    }
+
+    void Detector::applyPendingParams()
+    {
+        // only an atomic version check unless new parameters were published
+        if (pendingParamsReader.refresh(pendingParams)) {
+            params = pendingParamsReader.get();
+        }
     }
 
     void Detector::callbackHelper(DepthCamera & camera)
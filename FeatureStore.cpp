@@ -0,0 +1,173 @@
+#include "stdafx.h"
+#include "Version.h"
+#include "FeatureStore.h"
+
+namespace ark {
+    namespace classifier {
+        namespace {
+            const char MAGIC[8] = { 'A', 'R', 'K', 'F', 'E', 'A', 'T', '\0' };
+            const uint32_t VERSION = 1;
+
+            /** alignment of each section and column, in bytes */
+            const uint64_t ALIGNMENT = 64;
+
+            uint64_t alignUp(uint64_t x)
+            {
+                return (x + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+            }
+        }
+
+        FeatureStore::FeatureStore(const std::string & path)
+        {
+            using namespace boost::interprocess;
+
+            try {
+                file = file_mapping(path.c_str(), read_only);
+                region = mapped_region(file, read_only);
+            }
+            catch (const interprocess_exception &) {
+                return;
+            }
+
+            const size_t length = region.get_size();
+            const char * base = static_cast<const char *>(region.get_address());
+            if (length < sizeof(Header)) return;
+
+            const Header * head = reinterpret_cast<const Header *>(base);
+            if (memcmp(head->magic, MAGIC, sizeof MAGIC) != 0 || head->version != VERSION) {
+                std::cerr << "FeatureStore: " << path << " is not a feature store (or has an unsupported version)\n";
+                return;
+            }
+
+            // make sure every section lies within the file
+            const uint64_t N = head->numSamples;
+            if (head->columnStride < N ||
+                head->columnsOffset + head->columnStride * head->numColumns * sizeof(float) > length ||
+                head->labelsOffset + N * sizeof(int32_t) > length ||
+                head->sizesOffset + N * sizeof(int32_t) > length) {
+                std::cerr << "FeatureStore: " << path << " is truncated\n";
+                return;
+            }
+
+            columns = reinterpret_cast<const float *>(base + head->columnsOffset);
+            labels = reinterpret_cast<const int32_t *>(base + head->labelsOffset);
+            sizes = reinterpret_cast<const int32_t *>(base + head->sizesOffset);
+            header = head;
+        }
+
+        bool FeatureStore::isOpen() const
+        {
+            return header != nullptr;
+        }
+
+        FeatureStore::Kind FeatureStore::getKind() const
+        {
+            return header ? static_cast<Kind>(header->kind) : KIND_UNKNOWN;
+        }
+
+        int FeatureStore::size() const
+        {
+            return header ? (int)header->numSamples : 0;
+        }
+
+        int FeatureStore::getNumColumns() const
+        {
+            return header ? (int)header->numColumns : 0;
+        }
+
+        int FeatureStore::getLabel(int sample) const
+        {
+            return labels[sample];
+        }
+
+        int FeatureStore::getNumFeatures(int sample) const
+        {
+            return sizes[sample];
+        }
+
+        const float * FeatureStore::getColumn(int column) const
+        {
+            return columns + header->columnStride * column;
+        }
+
+        cv::Mat FeatureStore::getRows(const std::vector<int> & samples, int first_column, int num_columns) const
+        {
+            ASSERT(first_column >= 0 && first_column + num_columns <= getNumColumns(),
+                   "FeatureStore: column range out of bounds");
+
+            cv::Mat result((int)samples.size(), num_columns, CV_32F);
+
+            // read column by column, so that each column is scanned once
+            for (int c = 0; c < num_columns; ++c) {
+                const float * col = getColumn(first_column + c);
+                for (int r = 0; r < (int)samples.size(); ++r) {
+                    result.at<float>(r, c) = col[samples[r]];
+                }
+            }
+
+            return result;
+        }
+
+        cv::Mat FeatureStore::getLabels(const std::vector<int> & samples) const
+        {
+            cv::Mat result(1, (int)samples.size(), CV_32S);
+            int * ptr = result.ptr<int>(0);
+            for (int i = 0; i < (int)samples.size(); ++i) {
+                ptr[i] = labels[samples[i]];
+            }
+            return result;
+        }
+
+        bool FeatureStore::write(const std::string & path, Kind kind,
+                                 const std::vector<cv::Mat> & features, const std::vector<int> & labels)
+        {
+            ASSERT(features.size() == labels.size(), "FeatureStore: number of feature vectors and labels differ");
+
+            const uint64_t N = features.size();
+            int numColumns = 0;
+            for (const cv::Mat & f : features) {
+                numColumns = std::max(numColumns, (int)f.total());
+            }
+
+            Header head;
+            memset(&head, 0, sizeof head);
+            memcpy(head.magic, MAGIC, sizeof MAGIC);
+            head.version = VERSION;
+            head.kind = (uint32_t)kind;
+            head.numSamples = (uint32_t)N;
+            head.numColumns = (uint32_t)numColumns;
+            head.columnStride = alignUp(N * sizeof(float)) / sizeof(float);
+            head.columnsOffset = alignUp(sizeof(Header));
+            head.labelsOffset = alignUp(head.columnsOffset + head.columnStride * numColumns * sizeof(float));
+            head.sizesOffset = alignUp(head.labelsOffset + N * sizeof(int32_t));
+            const uint64_t length = head.sizesOffset + N * sizeof(int32_t);
+
+            // lay out the whole file in memory, then write it at once
+            std::vector<char> buffer(length, 0);
+            memcpy(buffer.data(), &head, sizeof head);
+
+            float * cols = reinterpret_cast<float *>(buffer.data() + head.columnsOffset);
+            int32_t * lbls = reinterpret_cast<int32_t *>(buffer.data() + head.labelsOffset);
+            int32_t * szs = reinterpret_cast<int32_t *>(buffer.data() + head.sizesOffset);
+            const float nan = std::numeric_limits<float>::quiet_NaN();
+
+            for (uint64_t i = 0; i < N; ++i) {
+                ASSERT(features[i].type() == CV_32F, "FeatureStore: feature vectors must be of type CV_32F");
+                const cv::Mat f = features[i].isContinuous() ? features[i] : features[i].clone();
+                const float * ptr = f.ptr<float>(0);
+                const int n = (int)f.total();
+
+                for (int c = 0; c < numColumns; ++c) {
+                    cols[head.columnStride * c + i] = c < n ? ptr[c] : nan;
+                }
+                lbls[i] = labels[i];
+                szs[i] = n;
+            }
+
+            std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+            if (!ofs) return false;
+            ofs.write(buffer.data(), (std::streamsize)length);
+            return (bool)ofs;
+        }
+    }
+}
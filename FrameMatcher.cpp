@@ -0,0 +1,105 @@
+#include "stdafx.h"
+#include "Version.h"
+#include "FrameMatcher.h"
+
+namespace ark {
+    FrameMatcher::FrameMatcher(DepthCamera & depth_cam, RGBCamera & rgb_cam,
+                               double tolerance_ms, int max_pending)
+        : depthCam(depth_cam), rgbCam(rgb_cam), toleranceMs(tolerance_ms),
+          state(std::make_shared<State>((size_t)std::max(1, max_pending)))
+    {
+        // the callback may run after the matcher is destroyed, so it only holds the shared state
+        std::shared_ptr<State> st = state;
+        callbackId = depthCam.addUpdateCallback([st](DepthCamera & camera) {
+            st->onDepthFrame(camera);
+        });
+    }
+
+    FrameMatcher::~FrameMatcher()
+    {
+        depthCam.removeUpdateCallback(callbackId);
+    }
+
+    void FrameMatcher::State::onDepthFrame(DepthCamera & camera)
+    {
+        if (camera.badInput()) return;
+
+        Pending frame;
+        frame.xyzMap = camera.getXYZMap(frame.time);
+        frame.index = camera.getFrameCount();
+
+        // DepthCamera allocates a new back buffer for every frame, but a camera may wrap its own
+        // reused buffer instead (e.g. PMDCamera); the map must be copied before holding on to it then
+        if (frame.xyzMap.u == nullptr) frame.xyzMap = frame.xyzMap.clone();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending.size() >= maxPending) {
+            pending.pop_front();
+            ++stats.numOverflow;
+        }
+        pending.push_back(frame);
+    }
+
+    bool FrameMatcher::tryMatch(Pair & pair)
+    {
+        std::deque<Pending> & pending = state->pending;
+        Stats & stats = state->stats;
+        std::lock_guard<std::mutex> lock(state->mutex);
+        const Clock::time_point now = Clock::now();
+
+        while (!pending.empty()) {
+            const Pending & frame = pending.front();
+
+            // wait until no closer RGB frame can arrive: either a later one was captured,
+            // or the tolerance has passed
+            const double ageMs = std::chrono::duration<double, std::milli>(now - frame.time).count();
+            if (!rgbCam.hasFrameAfter(frame.time) && ageMs <= toleranceMs) return false;
+
+            RGBCamera::Frame rgb;
+            double skew;
+            if (rgbCam.getFrameNear(frame.time, toleranceMs, rgb, &skew)) {
+                pair.xyzMap = frame.xyzMap;
+                pair.depthTime = frame.time;
+                pair.depthIndex = frame.index;
+                pair.rgbImage = rgb.image;
+                pair.rgbTime = rgb.timestamp;
+                pair.rgbIndex = rgb.index;
+                pair.skewMs = skew;
+                pending.pop_front();
+
+                ++stats.numMatched;
+                stats.lastSkewMs = skew;
+                state->totalAbsSkewMs += std::abs(skew);
+                stats.meanAbsSkewMs = state->totalAbsSkewMs / stats.numMatched;
+                stats.maxAbsSkewMs = std::max(stats.maxAbsSkewMs, std::abs(skew));
+                return true;
+            }
+
+            pending.pop_front();
+            ++stats.numUnmatched;
+        }
+
+        return false;
+    }
+
+    bool FrameMatcher::next(Pair & pair, int timeout_ms)
+    {
+        const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (true) {
+            if (tryMatch(pair)) return true;
+            if (Clock::now() >= deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    double FrameMatcher::getTolerance() const
+    {
+        return toleranceMs;
+    }
+
+    FrameMatcher::Stats FrameMatcher::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->stats;
+    }
+}
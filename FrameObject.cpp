@@ -79,6 +79,11 @@ namespace ark {
         return surfaceArea;
     }
 
+    int FrameObject::getPointStride() const
+    {
+        return pointStride;
+    }
+
     cv::Rect FrameObject::getBoundingBox() const
     {
         return cv::Rect(topLeftPt.x, topLeftPt.y, xyzMap.cols, xyzMap.rows);
@@ -188,7 +193,14 @@ namespace ark {
             }
         }
 
-        morph(params->contourImageErodeAmount, params->contourImageDilateAmount, false);
+        if (pointStride > 1) {
+            // decimated: close the gaps between the grid points first
+            morph(params->contourImageErodeAmount,
+                std::max(params->contourImageDilateAmount, pointStride + 1), true);
+        }
+        else {
+            morph(params->contourImageErodeAmount, params->contourImageDilateAmount, false);
+        }
 
         for (int i = 1; i < getContourScalingFactor(); i <<= 1) {
             cv::pyrUp(grayMap, grayMap);
@@ -0,0 +1,198 @@
+#include "stdafx.h"
+#include "Version.h"
+#include "FramePipeline.h"
+
+namespace ark {
+    FramePipeline::FramePipeline(DetectionParams::Ptr params, ResultCallback on_result)
+        : FramePipeline(params, on_result, Config()) { }
+
+    FramePipeline::FramePipeline(DetectionParams::Ptr params, ResultCallback on_result,
+                                 const Config & config, ThreadPool & pool)
+        : config(config), pool(pool), onResult(on_result)
+    {
+        if (this->config.numLanes <= 0) this->config.numLanes = std::max(pool.getNumWorkers(), 1);
+        if (this->config.maxBuffered <= 0) this->config.maxBuffered = 2 * this->config.numLanes;
+        this->config.maxBuffered = std::max(this->config.maxBuffered, this->config.numLanes);
+
+        const DetectionParams::Ptr lanePtr = laneParams(params);
+        lanes.resize(this->config.numLanes);
+        for (int i = 0; i < this->config.numLanes; ++i) {
+            Lane & lane = lanes[i];
+            if (this->config.detectPlanes) {
+                lane.planeDetector = std::make_shared<PlaneDetector>(lanePtr);
+                lane.handDetector = std::make_shared<HandDetector>(lane.planeDetector, lanePtr);
+            }
+            else {
+                lane.handDetector = std::make_shared<HandDetector>(false, lanePtr);
+            }
+            freeLanes.push_back(i);
+        }
+
+        stats.numLanes = this->config.numLanes;
+    }
+
+    FramePipeline::~FramePipeline()
+    {
+        // like flush(), but a destructor must not throw: an exception from the callback is dropped here
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return nextEmit == nextSequence && !emitting; });
+    }
+
+    int64_t FramePipeline::submit(const cv::Mat & xyz_map, Clock::time_point capture_time)
+    {
+        std::shared_ptr<Result> result = std::make_shared<Result>();
+        result->xyzMap = xyz_map;
+        result->captureTime = capture_time;
+
+        int lane;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            rethrowCallbackError();
+            condition.wait(lock, [this] {
+                return !freeLanes.empty() && nextSequence - nextEmit < config.maxBuffered;
+            });
+
+            lane = freeLanes.back();
+            freeLanes.pop_back();
+
+            if (nextSequence == 0) startTime = Clock::now();
+            result->sequence = nextSequence++;
+            ++stats.numSubmitted;
+        }
+
+        pool.submit([this, lane, result]() {
+            detectFrame(lane, *result);
+            finishFrame(lane, std::move(*result));
+        });
+
+        return result->sequence;
+    }
+
+    void FramePipeline::flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return nextEmit == nextSequence && !emitting; });
+        rethrowCallbackError();
+    }
+
+    void FramePipeline::rethrowCallbackError()
+    {
+        if (!callbackError) return;
+        std::exception_ptr error = callbackError;
+        callbackError = nullptr;
+        std::rethrow_exception(error);
+    }
+
+    void FramePipeline::setParams(const DetectionParams::Ptr params)
+    {
+        const DetectionParams::Ptr lanePtr = laneParams(params);
+        for (Lane & lane : lanes) {
+            if (lane.planeDetector) lane.planeDetector->setParams(lanePtr);
+            lane.handDetector->setParams(lanePtr);
+        }
+    }
+
+    int FramePipeline::getNumLanes() const
+    {
+        return config.numLanes;
+    }
+
+    FramePipeline::Stats FramePipeline::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stats result = stats;
+        if (stats.numEmitted > 0) {
+            result.avgDetectMs = detectMsSum / stats.numEmitted;
+            const double elapsed = std::chrono::duration<double>(Clock::now() - startTime).count();
+            if (elapsed > 0.0) result.framesPerSecond = stats.numEmitted / elapsed;
+        }
+        return result;
+    }
+
+    void FramePipeline::detectFrame(int lane, Result & result)
+    {
+        const Clock::time_point start = Clock::now();
+        Lane & detectors = lanes[lane];
+
+        try {
+            if (detectors.planeDetector) {
+                detectors.planeDetector->update(result.xyzMap);
+                result.planes = detectors.planeDetector->getPlanes();
+            }
+            if (config.detectHands) {
+                detectors.handDetector->update(result.xyzMap);
+                result.hands = detectors.handDetector->getHands();
+            }
+        }
+        catch (const std::exception & e) {
+            result.error = e.what();
+        }
+        catch (...) {
+            result.error = "unknown error";
+        }
+
+        result.detectMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    void FramePipeline::finishFrame(int lane, Result && result)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const int64_t sequence = result.sequence;
+            reorderBuffer.emplace(sequence, std::move(result));
+            stats.maxReorderDepth = std::max(stats.maxReorderDepth, (int)reorderBuffer.size());
+            freeLanes.push_back(lane);
+            condition.notify_all();
+
+            // the thread already emitting will pick this frame up when its turn comes
+            if (emitting) return;
+            emitting = true;
+        }
+
+        // emit as many consecutive results as are ready, outside the lock
+        while (true) {
+            Result next;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = reorderBuffer.find(nextEmit);
+                if (it == reorderBuffer.end()) {
+                    emitting = false;
+                    condition.notify_all();
+                    break;
+                }
+                next = std::move(it->second);
+                reorderBuffer.erase(it);
+            }
+
+            // a throwing callback must not stop the emission, or flush() would wait forever:
+            // keep going, and pass the first exception on to the thread calling submit() or flush()
+            std::exception_ptr error;
+            try {
+                onResult(next);
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (error && !callbackError) callbackError = error;
+                ++nextEmit;
+                ++stats.numEmitted;
+                if (!next.error.empty()) ++stats.numFailed;
+                detectMsSum += next.detectMs;
+                condition.notify_all();
+            }
+        }
+    }
+
+    DetectionParams::Ptr FramePipeline::laneParams(const DetectionParams::Ptr & params)
+    {
+        DetectionParams::Ptr result =
+            std::make_shared<DetectionParams>(params ? *params : *DetectionParams::DEFAULT);
+
+        // the previous frame of a lane is not the previous frame of the sequence
+        result->planeExcludeHands = false;
+        return result;
+    }
+}
@@ -55,8 +55,48 @@ namespace {
 
 namespace ark {
 
-    // Initialize the SVM hand validator
-    static const classifier::SVMHandValidator & handValidator = classifier::SVMHandValidator(SVM_PATHS);
+    namespace {
+        /** make an int8-quantized copy of a validator (sharing its float model) */
+        Hand::ValidatorStore::Snapshot quantizeValidator(const classifier::SVMHandValidator & validator)
+        {
+            auto quantized = std::make_shared<classifier::SVMHandValidator>(validator);
+            quantized->quantize(classifier::QuantizedSVM::PRECISION_INT8);
+            return quantized;
+        }
+    }
+
+    Hand::ValidatorStore & Hand::getValidatorStore()
+    {
+        // loaded on first use rather than at static initialization
+        static ValidatorStore store(std::make_shared<const classifier::SVMHandValidator>(SVM_PATHS));
+        return store;
+    }
+
+    Hand::ValidatorStore & Hand::getQuantizedValidatorStore()
+    {
+        static ValidatorStore store(quantizeValidator(*getValidator()));
+        return store;
+    }
+
+    Hand::ValidatorStore::Snapshot Hand::getValidator()
+    {
+        return getValidatorStore().load();
+    }
+
+    Hand::ValidatorStore::Snapshot Hand::getQuantizedValidator()
+    {
+        return getQuantizedValidatorStore().load();
+    }
+
+    bool Hand::reloadValidator(const std::string & path)
+    {
+        auto validator = std::make_shared<classifier::SVMHandValidator>();
+        if (!validator->loadFile(path)) return false;
+
+        getValidatorStore().publish(validator);
+        getQuantizedValidatorStore().publish(quantizeValidator(*validator));
+        return true;
+    }
 
     Hand::Hand() : FrameObject() { }
 
@@ -67,11 +107,45 @@ namespace ark {
         isHand = checkForHand();
     }
 
-    Hand::Hand(VecP2iPtr points_ij, VecV3fPtr points_xyz, const cv::Mat & depth_map, DetectionParams::Ptr params, bool sorted, int points_to_use)
-        : FrameObject(points_ij, points_xyz, depth_map, params, sorted, points_to_use)
+    Hand::Hand(VecP2iPtr points_ij, VecV3fPtr points_xyz, const cv::Mat & depth_map, DetectionParams::Ptr params, bool sorted, int points_to_use, int point_stride,
+               const classifier::SVMHandValidator * validator)
+        : FrameObject(points_ij, points_xyz, depth_map, params, sorted, points_to_use), validator(validator)
     {
+        pointStride = std::max(point_stride, 1);
+
         // Determine whether cluster is a hand
         isHand = checkForHand();
+
+        // the given validator is only guaranteed to live for the duration of the constructor
+        this->validator = nullptr;
+    }
+
+    void Hand::refineFingers(const cv::Mat & full_xyz_map, float max_depth_diff)
+    {
+        const int radius = params->xyzAverageSize;
+
+        for (size_t i = 0; i < fingersIJ.size(); ++i) {
+            const Point2i & pt = fingersIJ[i];
+            const float z = fingersXYZ[i][2];
+
+            const int T = std::max(0, pt.y - radius), B = std::min(full_xyz_map.rows - 1, pt.y + radius);
+            const int L = std::max(0, pt.x - radius), R = std::min(full_xyz_map.cols - 1, pt.x + radius);
+
+            int total = 0;
+            Vec3f avg(0.0f, 0.0f, 0.0f);
+
+            for (int r = T; r <= B; ++r) {
+                const Vec3f * ptr = full_xyz_map.ptr<Vec3f>(r);
+                for (int c = L; c <= R; ++c) {
+                    if (ptr[c][2] > 0 && std::fabs(ptr[c][2] - z) < max_depth_diff) {
+                        ++total;
+                        avg += ptr[c];
+                    }
+                }
+            }
+
+            if (total > 0) fingersXYZ[i] = avg / total;
+        }
     }
 
     Hand::~Hand() { }
@@ -298,8 +372,16 @@ namespace ark {
         this->dominantDir = util::normalize(contour[contourFarIdx] - this->palmCenterIJ);
 
         // ** SVM check **
-        if (params->handUseSVM && handValidator.isTrained()) {
-            this->svmConfidence = handValidator.classify(*this, xyzMap,
+        // hold on to the current validator for the duration of the check, unless given one
+        ValidatorStore::Snapshot current;
+        const classifier::SVMHandValidator * svm = validator;
+        if (params->handUseSVM && svm == nullptr) {
+            current = params->handSVMQuantized ? getQuantizedValidator() : getValidator();
+            svm = current.get();
+        }
+
+        if (params->handUseSVM && svm->isTrained()) {
+            this->svmConfidence = svm->classify(*this, xyzMap,
                 topLeftPt, fullMapSize.width);
             if (this->svmConfidence < params->handSVMConfidenceThresh) {
                 // SVM confidence value below threshold, reverse decision & destroy the hand instance
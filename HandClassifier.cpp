@@ -3,9 +3,199 @@
 #include "Hand.h"
 #include "Util.h"
 #include "HandClassifier.h"
+#include "ThreadPool.h"
+#include "FeatureStore.h"
 
 namespace ark {
     namespace classifier {
+        namespace {
+            /** Load classifier training data from the text labels and features files */
+            int loadClassifierText(const std::string & dataPath, cv::Mat data[], cv::Mat labels[],
+                                   int numFeats[], int numFing[], int numSamples[]) {
+                std::string labelsPath = dataPath + DATA_LABELS_FILE_NAME,
+                    featuresPath = dataPath + DATA_FEATURES_FILE_NAME;
+
+                std::ifstream ifsLabels(labelsPath), ifsFeats(featuresPath);
+
+                // total cases
+                int N; ifsLabels >> N;
+
+                // ignore first line of features file (feature names); we don't need it
+                std::string _; getline(ifsFeats, _);
+
+                const size_t arraySize = sizeof(int) * SVMHandClassifier::NUM_SVMS;
+                memset(numFeats, 0x3f, arraySize); // large number
+                memset(numFing, 0x3f, arraySize); // large number
+                memset(numSamples, 0, arraySize);
+
+                // pre-scan features file to determine data matrix dimensions
+                for (int i = 0; i < N; ++i) {
+                    std::string name;
+                    int numFeatures, numFingers;
+                    ifsFeats >> name >> numFeatures >> numFingers;
+
+                    int svmID = SVMHandClassifier::getSVMIdx(numFingers);
+
+                    if (svmID >= 0) {
+                        ++numSamples[svmID];
+                        numFeats[svmID] = std::min(numFeatures, numFeats[svmID]);
+                        numFing[svmID] = std::min(numFingers, numFing[svmID]);
+                    }
+
+                    // ignore rest of line
+                    std::getline(ifsFeats, _);
+                }
+
+                // start from beginning
+                ifsFeats.seekg(0, ios::beg); getline(ifsFeats, _);
+
+                for (int i = 0; i < SVMHandClassifier::NUM_SVMS; ++i) {
+                    data[i].create(numSamples[i], numFeats[i] - 1, CV_32F);
+                    labels[i].create(1, numSamples[i], CV_32S);
+                    std::cerr << numFeats[i] << " ";
+                }
+
+                // use to record samples read
+                memset(numSamples, 0, arraySize);
+
+                int i;
+                for (i = 0; i < N; ++i) {
+                    std::string lbName = "", ftName = "";
+                    int label, numFeatures, numFingers;
+
+                    // synchronize
+                    if (!(ifsLabels >> lbName >> label) || !(ifsFeats >> ftName >> numFeatures >> numFingers)) {
+                        break;
+                    }
+                    while (lbName != ftName && (ifsLabels >> lbName >> label)) {}
+
+                    int currSVMId = SVMHandClassifier::getSVMIdx(numFingers);
+                    if (currSVMId < 0) {
+                        std::getline(ifsFeats, _);
+                        continue;
+                    }
+
+                    // add label
+                    labels[currSVMId].at<int>(0, numSamples[currSVMId]) = label;
+                    float * ptr = data[currSVMId].ptr<float>(numSamples[currSVMId]++);
+
+                    // read features
+                    for (int j = 0; j < numFeatures - 1; ++j) {
+                        if (j >= numFeats[currSVMId] - 1) {
+                            // ignore
+                            std::getline(ifsFeats, _);
+                            break;
+                        }
+                        ifsFeats >> ptr[j];
+                    }
+                }
+
+                return N;
+            }
+
+            /** Load classifier training data from a feature store, grouping samples by SVM */
+            int loadClassifierStore(const FeatureStore & store, cv::Mat data[], cv::Mat labels[],
+                                    int numFeats[], int numFing[], int numSamples[]) {
+                const int N = store.size();
+                std::vector<int> samples[SVMHandClassifier::NUM_SVMS];
+
+                memset(numFeats, 0x3f, sizeof(int) * SVMHandClassifier::NUM_SVMS); // large number
+                memset(numFing, 0x3f, sizeof(int) * SVMHandClassifier::NUM_SVMS); // large number
+
+                // feature 0 is the number of fingers
+                const float * fingers = store.getColumn(0);
+                for (int i = 0; i < N; ++i) {
+                    const int numFingers = (int)fingers[i];
+                    const int svmID = SVMHandClassifier::getSVMIdx(numFingers);
+                    if (svmID < 0) continue;
+
+                    samples[svmID].push_back(i);
+                    numFeats[svmID] = std::min(store.getNumFeatures(i), numFeats[svmID]);
+                    numFing[svmID] = std::min(numFingers, numFing[svmID]);
+                }
+
+                for (int i = 0; i < SVMHandClassifier::NUM_SVMS; ++i) {
+                    numSamples[i] = (int)samples[i].size();
+                    if (samples[i].empty()) continue;
+                    data[i] = store.getRows(samples[i], 1, numFeats[i] - 1);
+                    labels[i] = store.getLabels(samples[i]);
+                }
+
+                return N;
+            }
+
+            /** Load validator training data from the text labels and features files */
+            int loadValidatorText(const std::string & dataPath, cv::Mat & data, cv::Mat & labels) {
+                std::string labelsPath = dataPath + DATA_LABELS_FILE_NAME,
+                    featuresPath = dataPath + DATA_FEATURES_FILE_NAME;
+
+                std::ifstream ifsLabels(labelsPath), ifsFeats(featuresPath);
+
+                // total cases
+                int N; ifsLabels >> N;
+
+                // ignore first line of features file (feature names); we don't need it
+                std::string _; getline(ifsFeats, _);
+
+                int numFeats;
+                ifsFeats >> _ >> numFeats;
+
+                // start from beginning
+                ifsFeats.seekg(0, ios::beg); getline(ifsFeats, _);
+
+                data.create(N, numFeats, CV_32F);
+                labels.create(1, N, CV_32S);
+
+                int i;
+                for (i = 0; i < N; ++i) {
+                    std::string lbName = "", ftName = "";
+                    int label, numFeatures;
+
+                    // synchronize
+                    if (!(ifsLabels >> lbName >> label) || !(ifsFeats >> ftName >> numFeatures)) {
+                        break;
+                    }
+                    while (lbName != ftName && (ifsLabels >> lbName >> label)) {}
+
+                    // add label
+                    labels.at<int>(0, i) = label;
+                    float * ptr = data.ptr<float>(i);
+
+                    // read features
+                    for (int j = 0; j < numFeatures; ++j) {
+                        if (j >= numFeats) {
+                            // ignore
+                            std::getline(ifsFeats, _);
+                            break;
+                        }
+                        ifsFeats >> ptr[j];
+                    }
+                }
+
+                std::cout << "Loaded " << i <<
+                    " training samples (" << numFeats << " features)" << "\n";
+                return N;
+            }
+
+            /** Load validator training data from a feature store */
+            int loadValidatorStore(const FeatureStore & store, cv::Mat & data, cv::Mat & labels) {
+                const int N = store.size();
+                std::vector<int> samples(N);
+                int numFeats = N > 0 ? store.getNumColumns() : 0;
+                for (int i = 0; i < N; ++i) {
+                    samples[i] = i;
+                    numFeats = std::min(store.getNumFeatures(i), numFeats);
+                }
+
+                data = store.getRows(samples, 0, numFeats);
+                labels = store.getLabels(samples);
+
+                std::cout << "Loaded " << N <<
+                    " training samples (" << numFeats << " features)" << "\n";
+                return N;
+            }
+        }
+
         // Classifier implementation
         bool Classifier::isTrained() const {
             return trained;
@@ -67,6 +257,7 @@ namespace ark {
                 svm[i]->setCoef0(hyperparams[i * 5 + 1]);
                 svm[i]->setC(hyperparams[i * 5 + 2]);
                 svm[i]->setP(hyperparams[i * 5 + 4]);
+                quantized[i] = QuantizedSVM();
             }
         }
 
@@ -97,6 +288,7 @@ namespace ark {
 
         bool SVMHandClassifier::loadFile(std::string ipath) {
             using namespace boost::filesystem;
+            for (int i = 0; i < NUM_SVMS; ++i) quantized[i] = QuantizedSVM();
 
             const char * env = std::getenv("OPENARK_DIR");
             path filePath(ipath);
@@ -139,17 +331,6 @@ namespace ark {
                 dataPath += boost::filesystem::path::preferred_separator;
             }
 
-            std::string labelsPath = dataPath + DATA_LABELS_FILE_NAME,
-                featuresPath = dataPath + DATA_FEATURES_FILE_NAME;
-
-            std::ifstream ifsLabels(labelsPath), ifsFeats(featuresPath);
-
-            // total cases
-            int N; ifsLabels >> N;
-
-            // ignore first line of features file (feature names); we don't need it
-            std::string _; getline(ifsFeats, _);
-
             // record number of features for SVM #
             int numFeats[NUM_SVMS];
 
@@ -159,73 +340,13 @@ namespace ark {
             // record number of samples for SVM #
             int numSamples[NUM_SVMS];
 
-            memset(numFeats, 0x3f, sizeof numFeats); // large number
-            memset(numFing, 0x3f, sizeof numFing); // large number
-            memset(numSamples, 0, sizeof numSamples);
-
-            // pre-scan features file to determine data matrix dimensions
-            for (int i = 0; i < N; ++i) {
-                std::string name;
-                int numFeatures, numFingers;
-                ifsFeats >> name >> numFeatures >> numFingers;
-
-                int svmID = getSVMIdx(numFingers);
-
-                if (svmID >= 0) {
-                    ++numSamples[svmID];
-                    numFeats[svmID] = std::min(numFeatures, numFeats[svmID]);
-                    numFing[svmID] = std::min(numFingers, numFing[svmID]);
-                }
-
-                // ignore rest of line
-                std::getline(ifsFeats, _);
-            }
-
-            // start from beginning
-            ifsFeats.seekg(0, ios::beg); getline(ifsFeats, _);
-
             cv::Mat data[NUM_SVMS], labels[NUM_SVMS];
 
-            for (int i = 0; i < NUM_SVMS; ++i) {
-                data[i].create(numSamples[i], numFeats[i] - 1, CV_32F);
-                labels[i].create(1, numSamples[i], CV_32S);
-                std::cerr << numFeats[i] << " ";
-            }
-
-            // use to record samples read
-            memset(numSamples, 0, sizeof numSamples);
-
-            int i;
-            for (i = 0; i < N; ++i) {
-                std::string lbName = "", ftName = "";
-                int label, numFeatures, numFingers;
-
-                // synchronize
-                if (!(ifsLabels >> lbName >> label) || !(ifsFeats >> ftName >> numFeatures >> numFingers)) {
-                    break;
-                }
-                while (lbName != ftName && (ifsLabels >> lbName >> label)) {}
-
-                int currSVMId = getSVMIdx(numFingers);
-                if (currSVMId < 0) {
-                    std::getline(ifsFeats, _);
-                    continue;
-                }
-
-                // add label
-                labels[currSVMId].at<int>(0, numSamples[currSVMId]) = label;
-                float * ptr = data[currSVMId].ptr<float>(numSamples[currSVMId]++);
-
-                // read features
-                for (int j = 0; j < numFeatures - 1; ++j) {
-                    if (j >= numFeats[currSVMId] - 1) {
-                        // ignore
-                        std::getline(ifsFeats, _);
-                        break;
-                    }
-                    ifsFeats >> ptr[j];
-                }
-            }
+            // prefer the binary feature store if there is one
+            FeatureStore store(dataPath + DATA_STORE_FILE_NAME);
+            const int N = store.isOpen() && store.getKind() == FeatureStore::KIND_CLASSIFIER ?
+                loadClassifierStore(store, data, labels, numFeats, numFing, numSamples) :
+                loadClassifierText(dataPath, data, labels, numFeats, numFing, numSamples);
 
             // clean up old pointers & allocate memory
             for (int i = 0; i < NUM_SVMS; ++i) {
@@ -233,43 +354,57 @@ namespace ark {
                     " (" << numSamples[i] << " features)" << "\n";
             }
 
-            for (int i = 0; i < NUM_SVMS; ++i) {
-                std::cout << "Training SVM " << i << "...\n";
-                auto trainData = cv::ml::TrainData::create(data[i], cv::ml::ROW_SAMPLE, labels[i]);
-                svm[i]->train(trainData);
-                trainData.release();
+            // the SVMs are independent, so train them concurrently
+            {
+                TaskGroup group;
+                for (int i = 0; i < NUM_SVMS; ++i) {
+                    std::cout << "Training SVM " << i << "...\n";
+                    group.run([this, &data, &labels, i]() {
+                        auto trainData = cv::ml::TrainData::create(data[i], cv::ml::ROW_SAMPLE, labels[i]);
+                        svm[i]->train(trainData);
+                        trainData.release();
+                    });
+                }
+                group.wait();
             }
 
             trained = true;
 
             std::cout << "\nTesting...\n";
 
-            int good = 0, goodSVM[NUM_SVMS];
-            memset(goodSVM, 0, sizeof goodSVM);
-
-            ifsLabels.close(); ifsFeats.close();
+            std::atomic<int> goodSVM[NUM_SVMS];
+            int i;
+            for (i = 0; i < NUM_SVMS; ++i) goodSVM[i] = 0;
 
             for (i = 0; i < NUM_SVMS; ++i) {
-                for (int j = 0; j < data[i].rows; ++j) {
-                    cv::Mat feats(1, numFeats[i], CV_32F);
-                    feats.at<float>(0, 0) = numFing[i];
+                const int svmIdx = i;
+                ThreadPool::global().parallelFor(0, data[i].rows, [&](int start, int end) {
+                    cv::Mat feats(1, numFeats[svmIdx], CV_32F);
+                    feats.at<float>(0, 0) = numFing[svmIdx];
+                    int good = 0;
 
-                    int label = labels[i].at<int>(0, j);
+                    for (int j = start; j < end; ++j) {
+                        int label = labels[svmIdx].at<int>(0, j);
 
-                    float * ptr = data[i].ptr<float>(j);
+                        float * ptr = data[svmIdx].ptr<float>(j);
 
-                    for (int k = 0; k < data[i].cols; ++k) {
-                        feats.at<float>(0, k + 1) = ptr[k];
-                    }
+                        for (int k = 0; k < data[svmIdx].cols; ++k) {
+                            feats.at<float>(0, k + 1) = ptr[k];
+                        }
 
-                    double res = classify(feats);
-                    if (res < 0.5 && label == 0 || res > 0.5 && label == 1) {
-                        ++good;
-                        ++goodSVM[i];
+                        double res = classify(feats);
+                        if (res < 0.5 && label == 0 || res > 0.5 && label == 1) {
+                            ++good;
+                        }
                     }
-                }
+
+                    goodSVM[svmIdx] += good;
+                }, 0, ThreadPool::NORMAL);
             }
 
+            int good = 0;
+            for (i = 0; i < NUM_SVMS; ++i) good += goodSVM[i];
+
             std::cout << "Training Results:\n";
             for (int i = 0; i < NUM_SVMS; ++i) {
                 std::cout << "\tSVM " << i << ":" <<
@@ -278,9 +413,32 @@ namespace ark {
 
             std::cout << "Overall:" << (double)good / N * 100 << "% Correct\n\n";
 
+            // how much int8 quantization would cost on the training set
+            for (int i = 0; i < NUM_SVMS; ++i) {
+                QuantizedSVM q;
+                if (!q.quantize(svm[i])) continue;
+                std::cout << "SVM " << i << ": " << QuantizedSVM::compare(svm[i], q, data[i]).toString() << "\n";
+            }
+            std::cout << "\n";
+
             return trained;
         }
 
+        bool SVMHandClassifier::quantize(QuantizedSVM::Precision precision) {
+            if (!trained) return false;
+            for (int i = 0; i < NUM_SVMS; ++i) {
+                if (!quantized[i].quantize(svm[i], precision)) {
+                    for (int j = 0; j < NUM_SVMS; ++j) quantized[j] = QuantizedSVM();
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool SVMHandClassifier::isQuantized() const {
+            return quantized[0].isTrained();
+        }
+
         float SVMHandClassifier::classify(const cv::Mat & features) const {
             if (!trained) throw ClassifierNotTrainedException();
 
@@ -290,9 +448,13 @@ namespace ark {
             int nFeat = features.cols;
             if (nFeat > MAX_FEATURES) nFeat = MAX_FEATURES;
 
-            cv::Mat samples = features(cv::Rect(1, 0, nFeat - 1, 1));
+            // no SVM is trained for hands without fingers: predict not hand
             int svmIdx = getSVMIdx(features);
-            double result = svm[svmIdx]->predict(samples);
+            if (svmIdx < 0 || nFeat < 2) return 0.0;
+
+            cv::Mat samples = features(cv::Rect(1, 0, nFeat - 1, 1));
+            double result = quantized[svmIdx].isTrained() ? quantized[svmIdx].predict(samples)
+                                                          : svm[svmIdx]->predict(samples);
 
             // range [0, 1]
             return std::max(std::min(1.0, result), 0.0);
@@ -479,6 +641,7 @@ namespace ark {
             svm->setC(hyperparams[2]);
             svm->setTermCriteria(cv::TermCriteria(cv::TermCriteria::EPS, 10000, hyperparams[4]));
             svm->setP(hyperparams[4]);
+            quantized = QuantizedSVM();
         }
 
         SVMHandValidator::SVMHandValidator() { }
@@ -508,6 +671,7 @@ namespace ark {
 
         bool SVMHandValidator::loadFile(std::string ipath) {
             using namespace boost::filesystem;
+            quantized = QuantizedSVM();
 
             const char * FILE_NAME = "svm.xml";
 
@@ -543,56 +707,13 @@ namespace ark {
                 dataPath += boost::filesystem::path::preferred_separator;
             }
 
-            std::string labelsPath = dataPath + DATA_LABELS_FILE_NAME,
-                featuresPath = dataPath + DATA_FEATURES_FILE_NAME;
-
-            std::ifstream ifsLabels(labelsPath), ifsFeats(featuresPath);
-
-            // total cases
-            int N; ifsLabels >> N;
-
-            // ignore first line of features file (feature names); we don't need it
-            std::string _; getline(ifsFeats, _);
-
-            int numFeats;
-            ifsFeats >> _ >> numFeats;
-
-            // start from beginning
-            ifsFeats.seekg(0, ios::beg); getline(ifsFeats, _);
-
             cv::Mat data, labels;
-            data.create(N, numFeats, CV_32F);
-            labels.create(1, N, CV_32S);
-
-            int i;
-            for (i = 0; i < N; ++i) {
-                std::string lbName = "", ftName = "";
-                int label, numFeatures;
-
-                // synchronize
-                if (!(ifsLabels >> lbName >> label) || !(ifsFeats >> ftName >> numFeatures)) {
-                    break;
-                }
-                while (lbName != ftName && (ifsLabels >> lbName >> label)) {}
-
-                // add label
-                labels.at<int>(0, i) = label;
-                float * ptr = data.ptr<float>(i);
-
-                // read features
-                for (int j = 0; j < numFeatures; ++j) {
-                    if (j >= numFeats) {
-                        // ignore
-                        std::getline(ifsFeats, _);
-                        break;
-                    }
-                    ifsFeats >> ptr[j];
-                }
-            }
 
-            // clean up old pointers & allocate memory
-            std::cout << "Loaded " << i <<
-                " training samples (" << numFeats << " features)" << "\n";
+            // prefer the binary feature store if there is one
+            FeatureStore store(dataPath + DATA_STORE_FILE_NAME);
+            const int N = store.isOpen() && store.getKind() == FeatureStore::KIND_VALIDATOR ?
+                loadValidatorStore(store, data, labels) :
+                loadValidatorText(dataPath, data, labels);
 
             std::cout << "Training SVM...\n";
             cv::Ptr<cv::ml::TrainData> trainData =
@@ -604,32 +725,48 @@ namespace ark {
 
             std::cout << "\nTesting...\n";
 
-            int good = 0;
-
-            ifsLabels.close(); ifsFeats.close();
+            std::atomic<int> good(0);
 
-            for (int j = 0; j < data.rows; ++j) {
-                cv::Mat feats = data.row(j);
-                int label = labels.at<int>(0, j);
+            ThreadPool::global().parallelFor(0, data.rows, [&](int start, int end) {
+                int goodInRange = 0;
+                for (int j = start; j < end; ++j) {
+                    cv::Mat feats = data.row(j);
+                    int label = labels.at<int>(0, j);
 
-                double res = classify(feats);
-                if (res < 0.5 && label == 0 || res > 0.5 && label == 1) {
-                    ++good;
+                    double res = classify(feats);
+                    if (res < 0.5 && label == 0 || res > 0.5 && label == 1) {
+                        ++goodInRange;
+                    }
                 }
-            }
+                good += goodInRange;
+            }, 0, ThreadPool::NORMAL);
 
             std::cout << "Training Results:\n";
-            std::cout << (double)good / N * 100.0 << "% Correct\n\n";
+            std::cout << (double)good.load() / N * 100.0 << "% Correct\n\n";
+
+            // how much int8 quantization would cost on the training set
+            QuantizedSVM q;
+            if (q.quantize(svm)) {
+                std::cout << QuantizedSVM::compare(svm, q, data).toString() << "\n\n";
+            }
 
             return trained;
         }
 
+        bool SVMHandValidator::quantize(QuantizedSVM::Precision precision) {
+            return trained && quantized.quantize(svm, precision);
+        }
+
+        bool SVMHandValidator::isQuantized() const {
+            return quantized.isTrained();
+        }
+
         float SVMHandValidator::classify(const cv::Mat & features) const {
             if (!trained) throw ClassifierNotTrainedException();
 
             // if no fingers, predict not hand
             if (features.data == nullptr || features.cols == 0) return 0.0f;
-            float result = svm->predict(features);
+            float result = quantized.isTrained() ? quantized.predict(features) : svm->predict(features);
 
             // range [0, 1]
             return std::max(std::min(1.0f, result), 0.0f);
@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "HandDetector.h"
+#include "ThreadPool.h"
 
 namespace ark {
     HandDetector::HandDetector(bool elim_planes, DetectionParams::Ptr params)
@@ -20,13 +21,235 @@ namespace ark {
         return hands;
     }
 
+    const std::vector<cv::Vec4i> & HandDetector::getForearmCuts() const {
+        return forearmCuts;
+    }
+
+    int HandDetector::trimForearm(std::vector<Point2i> & points_ij, std::vector<Vec3f> & points_xyz)
+    {
+        const int N = (int)points_ij.size();
+        if (N < 3) return N;
+
+        // 1. principal axis of the cluster in the x-y plane (meters)
+        double meanX = 0.0, meanY = 0.0;
+        for (int i = 0; i < N; ++i) {
+            meanX += points_xyz[i][0];
+            meanY += points_xyz[i][1];
+        }
+        meanX /= N; meanY /= N;
+
+        double sxx = 0.0, sxy = 0.0, syy = 0.0;
+        for (int i = 0; i < N; ++i) {
+            const double dx = points_xyz[i][0] - meanX, dy = points_xyz[i][1] - meanY;
+            sxx += dx * dx; sxy += dx * dy; syy += dy * dy;
+        }
+
+        const double theta = 0.5 * std::atan2(2.0 * sxy, sxx - syy);
+        const float ax = (float)std::cos(theta), ay = (float)std::sin(theta);
+
+        // 2. extent along the axis; short clusters can't contain a forearm
+        std::vector<float> & axisPos = workspace.axisPos;
+        axisPos.resize(N);
+
+        float tMin = FLT_MAX, tMax = -FLT_MAX;
+        for (int i = 0; i < N; ++i) {
+            const float t = (float)((points_xyz[i][0] - meanX) * ax + (points_xyz[i][1] - meanY) * ay);
+            axisPos[i] = t;
+            tMin = std::min(tMin, t);
+            tMax = std::max(tMax, t);
+        }
+
+        if (tMax - tMin < params->handForearmMinLength) return N;
+
+        // 3. width profile along the axis
+        const float binSize = params->handForearmBinSize;
+        const int numBins = (int)((tMax - tMin) / binSize) + 1;
+
+        std::vector<float> & profileMin = workspace.profileMin, & profileMax = workspace.profileMax;
+        std::vector<int> & profileCount = workspace.profileCount, & profileEdge = workspace.profileEdge;
+        profileMin.assign(numBins, FLT_MAX);
+        profileMax.assign(numBins, -FLT_MAX);
+        profileCount.assign(numBins, 0);
+        profileEdge.assign(numBins, INT_MAX);
+
+        const int R = workspace.size.height, C = workspace.size.width;
+
+        for (int i = 0; i < N; ++i) {
+            const int bin = std::min(numBins - 1, (int)((axisPos[i] - tMin) / binSize));
+            const float w = (float)(-(points_xyz[i][0] - meanX) * ay + (points_xyz[i][1] - meanY) * ax);
+            profileMin[bin] = std::min(profileMin[bin], w);
+            profileMax[bin] = std::max(profileMax[bin], w);
+            ++profileCount[bin];
+
+            const Point2i & pt = points_ij[i];
+            const int edge = std::min(std::min(pt.x, C - 1 - pt.x), std::min(pt.y, R - 1 - pt.y));
+            profileEdge[bin] = std::min(profileEdge[bin], edge);
+        }
+
+        // 4. the forearm enters from the image border (whichever side), so the hand is the other end
+        const bool minAtEdge = profileEdge[0] <= params->handForearmMaxEdgeDistance;
+        const bool maxAtEdge = profileEdge[numBins - 1] <= params->handForearmMaxEdgeDistance;
+        if (minAtEdge == maxAtEdge) return N;
+        const bool handAtMin = maxAtEdge;
+
+        auto binWidth = [&](int k) {
+            const int bin = handAtMin ? k : numBins - 1 - k;
+            return profileCount[bin] ? profileMax[bin] - profileMin[bin] : -1.0f;
+        };
+
+        // 5. palm: widest part near the hand end; wrist: narrowest part past the palm
+        const int palmEnd = std::min(numBins, (int)(params->handForearmPalmSearch / binSize) + 1);
+        int palmBin = 0;
+        for (int k = 1; k < palmEnd; ++k) {
+            if (binWidth(k) > binWidth(palmBin)) palmBin = k;
+        }
+
+        const int wristEnd = std::min(numBins, palmBin + (int)(params->handForearmWristSearch / binSize) + 1);
+        int wristBin = -1;
+        float wristWidth = FLT_MAX;
+        for (int k = palmBin + 1; k < wristEnd; ++k) {
+            const float width = binWidth(k);
+            if (width >= 0.0f && width < wristWidth) {
+                wristWidth = width;
+                wristBin = k;
+            }
+        }
+
+        if (wristBin < 0) return N;
+
+        // 6. cut the forearm a margin past the wrist
+        const float cutDist = (wristBin + 0.5f) * binSize + params->handForearmCutMargin;
+        if (cutDist >= tMax - tMin) return N;
+        const float cutT = handAtMin ? tMin + cutDist : tMax - cutDist;
+
+        Point2i cutL, cutR;
+        float cutWMin = FLT_MAX, cutWMax = -FLT_MAX;
+
+        int kept = 0;
+        for (int i = 0; i < N; ++i) {
+            const float t = axisPos[i];
+
+            if (std::fabs(t - cutT) < binSize * 0.5f) {
+                const float w = (float)(-(points_xyz[i][0] - meanX) * ay + (points_xyz[i][1] - meanY) * ax);
+                if (w < cutWMin) { cutWMin = w; cutL = points_ij[i]; }
+                if (w > cutWMax) { cutWMax = w; cutR = points_ij[i]; }
+            }
+
+            if (handAtMin ? t <= cutT : t >= cutT) {
+                points_ij[kept] = points_ij[i];
+                points_xyz[kept] = points_xyz[i];
+                ++kept;
+            }
+        }
+
+        points_ij.resize(kept);
+        points_xyz.resize(kept);
+
+        if (cutWMax >= cutWMin) {
+            forearmCuts.push_back(cv::Vec4i(cutL.x, cutL.y, cutR.x, cutR.y));
+        }
+
+        return kept;
+    }
+
+    void HandDetector::Workspace::prepare(cv::Size frame_size)
+    {
+        if (frame_size != size) {
+            size = frame_size;
+            const int N = size.area();
+
+            floodFillMap.create(size, CV_8U);
+            allIJPoints.reserve(N);
+            allXYZPoints.reserve(N);
+        }
+
+        clusterIJ.clear();
+        clusterXYZ.clear();
+        clusterSize.clear();
+        clusterStride.clear();
+        clusterHands.clear();
+        clusterComponent.clear();
+    }
+
+    void HandDetector::updatePlaneMask()
+    {
+        const int maxMotion = params->planeHandMaskMaxMotion, margin = params->planeHandMaskMargin;
+        std::vector<Point2i> palms;
+
+        cv::Mat & mask = workspace.handMask;
+        mask.create(workspace.size, CV_8U);
+        mask.setTo(0);
+
+        for (const Hand::Ptr & hand : hands) {
+            const int cluster = (int)(std::find(workspace.clusterHands.begin(), workspace.clusterHands.end(), hand)
+                                      - workspace.clusterHands.begin());
+            if (cluster >= (int)workspace.clusterComponent.size()) continue;
+            const int component = workspace.clusterComponent[cluster];
+            if (component == 0) continue;
+
+            // assume the hand keeps moving as it did since the previous frame
+            const Point2i palm = hand->getPalmCenterIJ();
+            palms.push_back(palm);
+
+            Point2i motion(0, 0);
+            float bestDist = 2.0f * maxMotion;
+            for (const Point2i & last : lastPalmsIJ) {
+                const float dist = util::euclideanDistance(palm, last);
+                if (dist <= bestDist) {
+                    bestDist = dist;
+                    motion = palm - last;
+                }
+            }
+            const float motionNorm = (float)util::magnitude(motion);
+            if (motionNorm > maxMotion) motion = Point2i(Point2f(motion) * (maxMotion / motionNorm));
+
+            // sweep the component (plus the margin) from its current to its predicted position
+            const int padX = margin + std::abs(motion.x), padY = margin + std::abs(motion.y);
+            cv::Rect rect = workspace.componentBounds[component];
+            rect = cv::Rect(rect.x - padX, rect.y - padY, rect.width + 2 * padX, rect.height + 2 * padY) &
+                   cv::Rect(cv::Point(0, 0), workspace.size);
+
+            const Point2i anchor(margin + std::max(motion.x, 0), margin + std::max(motion.y, 0));
+            cv::Mat kernel = cv::Mat::zeros(2 * margin + 1 + std::abs(motion.y), 2 * margin + 1 + std::abs(motion.x), CV_8U);
+            cv::line(kernel, anchor, anchor - motion, cv::Scalar(1), 2 * margin + 1);
+
+            cv::compare(workspace.componentMap(rect), component, workspace.componentMask, cv::CMP_EQ);
+            cv::dilate(workspace.componentMask, workspace.componentMask, kernel, anchor);
+            cv::Mat maskROI = mask(rect);
+            cv::bitwise_or(maskROI, workspace.componentMask, maskROI);
+        }
+
+        lastPalmsIJ = palms;
+        planeDetector->setExcludedMask(palms.empty() ? cv::Mat() : mask);
+        planeMaskSet = !palms.empty();
+    }
+
     void HandDetector::detect(cv::Mat & image)
     {
         hands.clear();
+        forearmCuts.clear();
+
+        // pick up new validator models (see Hand::reloadValidator) between frames only
+        const classifier::SVMHandValidator * validator = nullptr;
+        if (params->handUseSVM) {
+            Hand::ValidatorStore::Reader & reader = params->handSVMQuantized ? quantizedValidatorReader : validatorReader;
+            reader.refresh(params->handSVMQuantized ? Hand::getQuantizedValidatorStore() : Hand::getValidatorStore());
+            validator = reader.get().get();
+        }
 
         // 1. initialize
         const int R = image.rows, C = image.cols;
-        cv::Mat floodFillMap(R, C, CV_8U);
+        workspace.prepare(image.size());
+        cv::Mat & floodFillMap = workspace.floodFillMap;
+
+        // label the components found by flood fill, so that hands can be masked out of the next frame's planes
+        const bool maskHands = planeDetector && params->planeExcludeHands;
+        int numComponents = 0;
+        if (maskHands) {
+            workspace.componentMap.create(image.size(), CV_16U);
+            workspace.componentMap.setTo(0);
+            workspace.componentBounds.assign(1, cv::Rect());
+        }
 
         const Vec3f * ptr;
         uchar * visPtr;
@@ -55,14 +278,20 @@ namespace ark {
         }
 
         // 3. flood fill on point cloud 
+        util::computeConnectivityMap(image, connectivityMap, params->handClusterMaxDistance,
+            1, 6, params->handClusterMaxDistance * 8);
+
         std::shared_ptr<Hand> bestHandObject;
         float closestHandDist = FLT_MAX;
 
-        std::vector<Point2i> allIJPoints;
-        std::vector<Vec3f> allXYZPoints;
+        std::vector<Point2i> & allIJPoints = workspace.allIJPoints;
+        std::vector<Vec3f> & allXYZPoints = workspace.allXYZPoints;
 
-        allIJPoints.reserve(R * C);
-        allXYZPoints.reserve(R * C);
+        // clusters large enough to be hands
+        std::vector<VecP2iPtr> & clusterIJ = workspace.clusterIJ;
+        std::vector<VecV3fPtr> & clusterXYZ = workspace.clusterXYZ;
+        std::vector<int> & clusterSize = workspace.clusterSize;
+        std::vector<int> & clusterStride = workspace.clusterStride;
 
 #ifdef DEBUG
         cv::Mat floodFillVis = cv::Mat::zeros(R, C, CV_8UC3);
@@ -81,60 +310,137 @@ namespace ark {
             {
                 if (visPtr[c] > 0 && ptr[c][2] > 0)
                 {
-                    int points_in_comp = util::floodFill(image, Point2i(c, r),
-                        params->handClusterMaxDistance,
-                        &allIJPoints, &allXYZPoints, nullptr, 1, 6,
-                        params->handClusterMaxDistance * 8, &floodFillMap);
+                    int points_in_comp = util::floodFillConnected(connectivityMap, Point2i(c, r),
+                        &allIJPoints, &allXYZPoints, &image, 1, 6, &floodFillMap);
+
+                    // label before trimming, so that the mask also covers the forearm
+                    int component = 0;
+                    if (maskHands && points_in_comp >= CLUSTER_MIN_POINTS && numComponents < USHRT_MAX) {
+                        component = ++numComponents;
+                        int minX = C, minY = R, maxX = -1, maxY = -1;
+                        for (int k = 0; k < points_in_comp; ++k) {
+                            const Point2i & pt = allIJPoints[k];
+                            workspace.componentMap.at<ushort>(pt) = (ushort)component;
+                            minX = std::min(minX, pt.x); maxX = std::max(maxX, pt.x);
+                            minY = std::min(minY, pt.y); maxY = std::max(maxY, pt.y);
+                        }
+                        workspace.componentBounds.push_back(cv::Rect(minX, minY, maxX - minX + 1, maxY - minY + 1));
+                    }
+
+                    if (points_in_comp >= CLUSTER_MIN_POINTS && params->handTrimForearm) {
+                        points_in_comp = trimForearm(allIJPoints, allXYZPoints);
+                    }
 
                     if (points_in_comp >= CLUSTER_MIN_POINTS)
                     {
-                        VecP2iPtr ijPoints = std::make_shared<std::vector<Point2i> >(allIJPoints);
-                        VecV3fPtr xyzPoints = std::make_shared<std::vector<Vec3f> >(allXYZPoints);
+                        // decimate large (close) clusters on a regular grid to stay within the point budget
+                        int stride = 1;
+                        if (params->handPointBudget > 0 && points_in_comp > params->handPointBudget) {
+                            stride = (int)std::ceil(std::sqrt((double)points_in_comp / params->handPointBudget));
+                            stride = std::max(1, std::min(params->handMaxDecimation, stride));
+                        }
 
-                        // 4. for each cluster, test if hand
+                        if (stride > 1) {
+                            auto ij = std::make_shared<std::vector<Point2i> >();
+                            auto xyz = std::make_shared<std::vector<Vec3f> >();
+                            ij->reserve(points_in_comp / (stride * stride) + C);
+                            xyz->reserve(points_in_comp / (stride * stride) + C);
 
-                        // if matching required conditions, construct 3D object
-                        Hand::Ptr handPtr = std::make_shared<Hand>(ijPoints, xyzPoints, image,
-                            params, false, points_in_comp);
+                            for (int k = 0; k < points_in_comp; ++k) {
+                                const Point2i & pt = allIJPoints[k];
+                                if (pt.x % stride || pt.y % stride) continue;
+                                ij->push_back(pt);
+                                xyz->push_back(allXYZPoints[k]);
+                            }
 
-                        if (ijPoints->size() < CLUSTER_MIN_POINTS) continue;
+                            clusterSize.push_back((int)ij->size());
+                            clusterIJ.push_back(ij);
+                            clusterXYZ.push_back(xyz);
+                        }
+                        else {
+                            clusterIJ.push_back(std::make_shared<std::vector<Point2i> >(allIJPoints));
+                            clusterXYZ.push_back(std::make_shared<std::vector<Vec3f> >(allXYZPoints));
+                            clusterSize.push_back(points_in_comp);
+                        }
+                        clusterStride.push_back(stride);
+                        workspace.clusterComponent.push_back(component);
 
 #ifdef DEBUG
                         cv::Vec3b color = util::paletteColor(compID++);
                         for (uint i = 0; i < points_in_comp; ++i) {
                             floodFillVis.at<Vec3b>(allIJPoints[i]) = color;
                         }
+#endif
+                    }
+                }
+            }
+        }
 
-                        if (handPtr->getWristIJ().size() >= 2) {
-                            cv::circle(floodFillVis, handPtr->getWristIJ()[0], 5, cv::Scalar(100, 255, 255));
-                            cv::circle(floodFillVis, handPtr->getWristIJ()[1], 5, cv::Scalar(100, 255, 255));
-                        }
+        // 4. for each cluster, test if hand
+        //    clusters are independent, so their hand objects are constructed in parallel
+        const int numClusters = (int)clusterIJ.size();
+        std::vector<Hand::Ptr> & clusterHands = workspace.clusterHands;
+        clusterHands.resize(numClusters);
+
+        auto constructHand = [&](int i) {
+            // if matching required conditions, construct 3D object
+            clusterHands[i] = std::make_shared<Hand>(clusterIJ[i], clusterXYZ[i], image,
+                params, false, clusterSize[i], clusterStride[i], validator);
+
+            // fingertips of decimated hands are refined at full resolution
+            if (clusterStride[i] > 1 && clusterHands[i]->isValidHand()) {
+                clusterHands[i]->refineFingers(image, params->handFingerRefineMaxDepthDiff);
+            }
+        };
+
+#ifdef DEBUG
+        // debug visualizations use HighGUI, which must stay on this thread
+        for (int i = 0; i < numClusters; ++i) constructHand(i);
+#else
+        ThreadPool::global().parallelFor(0, numClusters, [&](int start, int end) {
+            for (int i = start; i < end; ++i) constructHand(i);
+        }, 1);
 #endif
 
-                        if (handPtr->isValidHand()) {
-                            float distance = handPtr->getDepth();
+        for (int i = 0; i < numClusters; ++i) {
+            Hand::Ptr handPtr = clusterHands[i];
+            const int stride = clusterStride[i];
+            if ((int)clusterIJ[i]->size() * stride * stride < CLUSTER_MIN_POINTS) continue;
 
-                            if (distance < closestHandDist) {
-                                bestHandObject = handPtr;
-                                closestHandDist = distance;
-                            }
+#ifdef DEBUG
+            if (handPtr->getWristIJ().size() >= 2) {
+                cv::circle(floodFillVis, handPtr->getWristIJ()[0], 5, cv::Scalar(100, 255, 255));
+                cv::circle(floodFillVis, handPtr->getWristIJ()[1], 5, cv::Scalar(100, 255, 255));
+            }
+#endif
+
+            if (handPtr->isValidHand()) {
+                float distance = handPtr->getDepth();
+
+                if (distance < closestHandDist) {
+                    bestHandObject = handPtr;
+                    closestHandDist = distance;
+                }
 
 #ifdef DEBUG
-                            cv::polylines(floodFillVis, handPtr->getContour(), true, cv::Scalar(255, 255, 255));
+                cv::polylines(floodFillVis, handPtr->getContour(), true, cv::Scalar(255, 255, 255));
 #endif
-                            if (handPtr->getSVMConfidence() >
-                                params->handSVMHighConfidenceThresh ||
-                                !params->handUseSVM) {
-                                // avoid duplicate hand
-                                if (bestHandObject == handPtr) bestHandObject = nullptr;
-                                hands.push_back(handPtr);
-                            }
-                        }
-                    }
+                if (handPtr->getSVMConfidence() >
+                    params->handSVMHighConfidenceThresh ||
+                    !params->handUseSVM) {
+                    // avoid duplicate hand
+                    if (bestHandObject == handPtr) bestHandObject = nullptr;
+                    hands.push_back(handPtr);
                 }
             }
         }
 
+#ifdef DEBUG
+        for (const cv::Vec4i & cut : forearmCuts) {
+            cv::line(floodFillVis, Point2i(cut[0], cut[1]), Point2i(cut[2], cut[3]), cv::Scalar(0, 0, 255), 2);
+        }
+#endif
+
         if (bestHandObject != nullptr) {
             // if no hands surpass 'high confidence threshold', at least add one hand
             hands.push_back(bestHandObject);
@@ -150,6 +456,16 @@ namespace ark {
                 return a->getDepth() < b->getDepth();
             });
         }
+
+        // 5. feed the hand regions back to the plane detector for the next frame
+        if (maskHands) {
+            updatePlaneMask();
+        }
+        else if (planeMaskSet) {
+            planeDetector->setExcludedMask(cv::Mat());
+            planeMaskSet = false;
+            lastPalmsIJ.clear();
+        }
 #ifdef DEBUG
         cv::imshow("[Hand Flood Fill Debug]", floodFillVis);
 #endif
@@ -0,0 +1,379 @@
+#include "stdafx.h"
+#include "Version.h"
+#include "HandPredictor.h"
+#include "Util.h"
+
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace ark {
+    namespace {
+        /** number of floats processed per SIMD step (state arrays are padded to a multiple of this) */
+        const int LANES = 4;
+
+        /** predict step over n floats: p += v dt + a dt^2 / 2, v += a dt */
+        void predictStep(float * p, float * v, const float * a, int n, float dt)
+        {
+            const float halfDtSq = 0.5f * dt * dt;
+            int j = 0;
+#if CV_SIMD128
+            const cv::v_float32x4 vdt = cv::v_setall_f32(dt), vhalfDtSq = cv::v_setall_f32(halfDtSq);
+            for (; j <= n - LANES; j += LANES) {
+                const cv::v_float32x4 va = cv::v_load(a + j), vv = cv::v_load(v + j);
+                cv::v_store(p + j, cv::v_load(p + j) + vv * vdt + va * vhalfDtSq);
+                cv::v_store(v + j, vv + va * vdt);
+            }
+#endif
+            for (; j < n; ++j) {
+                p[j] += v[j] * dt + a[j] * halfDtSq;
+                v[j] += a[j] * dt;
+            }
+        }
+
+        /** correct step over n floats: r = m - p, p += alpha r, v += beta / dt r, a += 2 gamma / dt^2 r */
+        void correctStep(float * p, float * v, float * a, const float * m, int n,
+                         float alpha, float beta_dt, float gamma_dt)
+        {
+            int j = 0;
+#if CV_SIMD128
+            const cv::v_float32x4 valpha = cv::v_setall_f32(alpha), vbeta = cv::v_setall_f32(beta_dt),
+                                  vgamma = cv::v_setall_f32(gamma_dt);
+            for (; j <= n - LANES; j += LANES) {
+                const cv::v_float32x4 vp = cv::v_load(p + j), r = cv::v_load(m + j) - vp;
+                cv::v_store(p + j, vp + r * valpha);
+                cv::v_store(v + j, cv::v_load(v + j) + r * vbeta);
+                cv::v_store(a + j, cv::v_load(a + j) + r * vgamma);
+            }
+#endif
+            for (; j < n; ++j) {
+                const float r = m[j] - p[j];
+                p[j] += alpha * r;
+                v[j] += beta_dt * r;
+                a[j] += gamma_dt * r;
+            }
+        }
+
+        /** extrapolate n floats by t: out = p + v t + a t^2 / 2 */
+        void extrapolate(const float * p, const float * v, const float * a, float * out, int n, float t)
+        {
+            const float halfTSq = 0.5f * t * t;
+            int j = 0;
+#if CV_SIMD128
+            const cv::v_float32x4 vt = cv::v_setall_f32(t), vhalfTSq = cv::v_setall_f32(halfTSq);
+            for (; j <= n - LANES; j += LANES) {
+                cv::v_store(out + j, cv::v_load(p + j) + cv::v_load(v + j) * vt + cv::v_load(a + j) * vhalfTSq);
+            }
+#endif
+            for (; j < n; ++j) {
+                out[j] = p[j] + v[j] * t + a[j] * halfTSq;
+            }
+        }
+
+        inline Vec3f loadPoint(const std::vector<float> & arr, int slot)
+        {
+            return Vec3f(arr[slot * 3], arr[slot * 3 + 1], arr[slot * 3 + 2]);
+        }
+
+        inline void storePoint(std::vector<float> & arr, int slot, const Vec3f & value)
+        {
+            arr[slot * 3] = value[0];
+            arr[slot * 3 + 1] = value[1];
+            arr[slot * 3 + 2] = value[2];
+        }
+    }
+
+    HandPredictor::HandPredictor() : HandPredictor(Config()) { }
+
+    HandPredictor::HandPredictor(const Config & config) : config(config)
+    {
+        // gains of the critically damped fading-memory filter with discount factor theta
+        const float theta = std::min(std::max(config.smoothing, 0.0f), 0.99f);
+        alpha = 1.0f - theta * theta * theta;
+        beta = 1.5f * (1.0f - theta) * (1.0f - theta) * (1.0f + theta);
+        gamma = 0.5f * (1.0f - theta) * (1.0f - theta) * (1.0f - theta);
+    }
+
+    bool HandPredictor::update(const std::vector<Hand::Ptr> & hands, Clock::time_point capture_time)
+    {
+        if (hasLastTime && capture_time <= lastTime) return false;
+
+        const float dt = hasLastTime ? std::chrono::duration<float>(capture_time - lastTime).count() : 0.0f;
+        const int n = (int)pos.size();
+
+        // 1. predict all points to the capture time; points without a measurement keep the prediction
+        if (dt > 0.0f) predictStep(pos.data(), vel.data(), acc.data(), n, dt);
+        meas = pos;
+        std::fill(slotMeasured.begin(), slotMeasured.end(), 0);
+
+        // 2. associate hands with tracks by palm center
+        std::vector<Vec3f> palms, trackPalms;
+        for (const Hand::Ptr & hand : hands) palms.push_back(hand->getPalmCenter());
+        for (const Track & track : tracks) trackPalms.push_back(loadPoint(pos, track.palmSlot));
+        const std::vector<int> handTrack = util::matchNearest(palms, trackPalms, config.maxHandDistance);
+
+        std::vector<char> trackSeen(tracks.size(), 0);
+        std::vector<int> currentIds(hands.size());
+        for (int i = 0; i < (int)hands.size(); ++i) {
+            if (handTrack[i] < 0) {
+                Track track;
+                track.id = nextTrackId++;
+                track.palmSlot = allocSlot(palms[i]);
+                tracks.push_back(track);
+                trackSeen.push_back(1);
+                associateFingers(tracks.back(), hands[i]->getFingers());
+                currentIds[i] = track.id;
+                continue;
+            }
+
+            Track & track = tracks[handTrack[i]];
+            trackSeen[handTrack[i]] = 1;
+            track.missed = 0;
+            storePoint(meas, track.palmSlot, palms[i]);
+            slotMeasured[track.palmSlot] = 1;
+            slotMissed[track.palmSlot] = 0;
+            associateFingers(track, hands[i]->getFingers());
+            currentIds[i] = track.id;
+        }
+
+        // 3. drop hands and fingertips that went undetected for too long
+        for (int t = (int)tracks.size() - 1; t >= 0; --t) {
+            Track & track = tracks[t];
+            if (!trackSeen[t]) {
+                track.currentFingers.clear();
+                if (++track.missed > config.maxMissedFrames) {
+                    freeSlot(track.palmSlot);
+                    for (int slot : track.fingerSlots) freeSlot(slot);
+                    tracks.erase(tracks.begin() + t);
+                    continue;
+                }
+            }
+
+            for (int f = (int)track.fingerSlots.size() - 1; f >= 0; --f) {
+                const int slot = track.fingerSlots[f];
+                if (slotMeasured[slot]) continue;
+                if (++slotMissed[slot] > config.maxMissedFrames) {
+                    freeSlot(slot);
+                    track.fingerSlots.erase(track.fingerSlots.begin() + f);
+                }
+            }
+        }
+
+        // 4. check earlier predictions against this frame, then correct all points with their measurements
+        if (hasLastTime) checkPending(capture_time, dt * 1000.0);
+        if (dt > 0.0f) {
+            correctStep(pos.data(), vel.data(), acc.data(), meas.data(), (int)pos.size(),
+                        alpha, beta / dt, 2.0f * gamma / (dt * dt));
+        }
+        for (size_t s = 0; s < slotMeasured.size(); ++s) {
+            if (slotMeasured[s]) ++slotAge[s];
+        }
+
+        currentTracks = currentIds;
+        lastTime = capture_time;
+        hasLastTime = true;
+        pendingSinceUpdate = false;
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        numTracks = (int)tracks.size();
+        numPoints = (int)(slotUsed.size() - freeSlots.size());
+        return true;
+    }
+
+    std::vector<HandPredictor::PredictedHand> HandPredictor::predict(Clock::time_point display_time)
+    {
+        std::vector<PredictedHand> result;
+        if (!hasLastTime) return result;
+
+        double horizonMs = std::chrono::duration<double, std::milli>(display_time - lastTime).count();
+        horizonMs = std::min(std::max(horizonMs, 0.0), config.maxHorizonMs);
+
+        extrapolated.resize(pos.size());
+        extrapolate(pos.data(), vel.data(), acc.data(), extrapolated.data(), (int)pos.size(),
+                    (float)(horizonMs / 1000.0));
+
+        PendingCheck check;
+        check.target = lastTime + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double, std::milli>(horizonMs));
+        check.horizonMs = horizonMs;
+
+        for (int id : currentTracks) {
+            auto it = std::find_if(tracks.begin(), tracks.end(), [id](const Track & t) { return t.id == id; });
+            if (it == tracks.end()) continue;
+
+            PredictedHand hand;
+            hand.trackId = id;
+            hand.horizonMs = horizonMs;
+            hand.palmCenter = loadPoint(extrapolated, it->palmSlot);
+            for (int slot : it->currentFingers) hand.fingers.push_back(loadPoint(extrapolated, slot));
+            result.push_back(hand);
+
+            check.slots.push_back(it->palmSlot);
+            check.slots.insert(check.slots.end(), it->currentFingers.begin(), it->currentFingers.end());
+        }
+
+        for (int slot : check.slots) {
+            check.generations.push_back(slotGeneration[slot]);
+            check.predicted.push_back(loadPoint(extrapolated, slot));
+            check.uncompensated.push_back(loadPoint(pos, slot));
+        }
+
+        // keep the latest prediction made for each frame
+        if (pendingSinceUpdate && !pending.empty()) pending.back() = check;
+        else if (!check.slots.empty()) {
+            pending.push_back(check);
+            if (pending.size() > MAX_PENDING) pending.pop_front();
+            pendingSinceUpdate = true;
+        }
+
+        return result;
+    }
+
+    std::vector<HandPredictor::PredictedHand> HandPredictor::predictAhead(double lead_ms)
+    {
+        return predict(Clock::now() + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double, std::milli>(lead_ms)));
+    }
+
+    void HandPredictor::reset()
+    {
+        pos.clear(); vel.clear(); acc.clear(); meas.clear();
+        slotUsed.clear(); slotMeasured.clear(); slotGeneration.clear();
+        slotAge.clear(); slotMissed.clear(); freeSlots.clear();
+        tracks.clear();
+        currentTracks.clear();
+        pending.clear();
+        pendingSinceUpdate = false;
+        hasLastTime = false;
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        numSamples = 0;
+        errorSum = errorSqSum = maxError = uncompensatedSum = horizonSum = 0.0;
+        numTracks = numPoints = 0;
+    }
+
+    HandPredictor::Stats HandPredictor::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        Stats stats;
+        stats.numSamples = numSamples;
+        stats.numTracks = numTracks;
+        stats.numPoints = numPoints;
+        if (numSamples > 0) {
+            stats.meanError = errorSum / numSamples;
+            stats.rmsError = std::sqrt(errorSqSum / numSamples);
+            stats.maxError = maxError;
+            stats.meanUncompensatedError = uncompensatedSum / numSamples;
+            stats.meanHorizonMs = horizonSum / numSamples;
+        }
+        return stats;
+    }
+
+    int HandPredictor::allocSlot(const Vec3f & position)
+    {
+        int slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else {
+            slot = (int)slotUsed.size();
+            slotUsed.push_back(0);
+            slotMeasured.push_back(0);
+            slotGeneration.push_back(0);
+            slotAge.push_back(0);
+            slotMissed.push_back(0);
+
+            // 3 coordinates per slot, padded to whole SIMD steps
+            const size_t size = (slotUsed.size() * 3 + LANES - 1) / LANES * LANES;
+            if (size > pos.size()) {
+                pos.resize(size, 0.0f); vel.resize(size, 0.0f);
+                acc.resize(size, 0.0f); meas.resize(size, 0.0f);
+            }
+        }
+
+        // a new point starts at rest; its correction is then zero until the next frame
+        slotUsed[slot] = 1;
+        slotMeasured[slot] = 1;
+        slotAge[slot] = 0;
+        slotMissed[slot] = 0;
+        ++slotGeneration[slot];
+        storePoint(pos, slot, position);
+        storePoint(meas, slot, position);
+        storePoint(vel, slot, Vec3f(0, 0, 0));
+        storePoint(acc, slot, Vec3f(0, 0, 0));
+        return slot;
+    }
+
+    void HandPredictor::freeSlot(int slot)
+    {
+        slotUsed[slot] = 0;
+        slotMeasured[slot] = 0;
+        storePoint(pos, slot, Vec3f(0, 0, 0));
+        storePoint(meas, slot, Vec3f(0, 0, 0));
+        storePoint(vel, slot, Vec3f(0, 0, 0));
+        storePoint(acc, slot, Vec3f(0, 0, 0));
+        freeSlots.push_back(slot);
+    }
+
+    void HandPredictor::associateFingers(Track & track, const std::vector<Vec3f> & fingers)
+    {
+        std::vector<Vec3f> trackFingers;
+        for (int slot : track.fingerSlots) trackFingers.push_back(loadPoint(pos, slot));
+        const std::vector<int> match = util::matchNearest(fingers, trackFingers, config.maxFingerDistance);
+
+        track.currentFingers.resize(fingers.size());
+        for (int i = 0; i < (int)fingers.size(); ++i) {
+            int slot;
+            if (match[i] < 0) {
+                slot = allocSlot(fingers[i]);
+                track.fingerSlots.push_back(slot);
+            }
+            else {
+                slot = track.fingerSlots[match[i]];
+                storePoint(meas, slot, fingers[i]);
+                slotMeasured[slot] = 1;
+                slotMissed[slot] = 0;
+            }
+            track.currentFingers[i] = slot;
+        }
+    }
+
+    void HandPredictor::checkPending(Clock::time_point capture_time, double frame_ms)
+    {
+        const Clock::duration tolerance = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double, std::milli>(frame_ms * 0.5));
+
+        long long samples = 0;
+        double sum = 0.0, sqSum = 0.0, maxErr = 0.0, uncompSum = 0.0, horizon = 0.0;
+
+        while (!pending.empty() && pending.front().target <= capture_time + tolerance) {
+            const PendingCheck & check = pending.front();
+            if (check.target >= capture_time - tolerance) {
+                for (size_t k = 0; k < check.slots.size(); ++k) {
+                    const int slot = check.slots[k];
+                    // only points still on the same track that were measured in this frame (and not just created)
+                    if (!slotUsed[slot] || slotGeneration[slot] != check.generations[k] ||
+                        !slotMeasured[slot] || slotAge[slot] == 0) continue;
+
+                    const Vec3f measured = loadPoint(meas, slot);
+                    const double err = cv::norm(check.predicted[k] - measured);
+                    ++samples;
+                    sum += err;
+                    sqSum += err * err;
+                    maxErr = std::max(maxErr, err);
+                    uncompSum += cv::norm(check.uncompensated[k] - measured);
+                    horizon += check.horizonMs;
+                }
+            }
+            pending.pop_front();
+        }
+
+        if (samples == 0) return;
+        std::lock_guard<std::mutex> lock(statsMutex);
+        numSamples += samples;
+        errorSum += sum;
+        errorSqSum += sqSum;
+        maxError = std::max(maxError, maxErr);
+        uncompensatedSum += uncompSum;
+        horizonSum += horizon;
+    }
+}
@@ -0,0 +1,160 @@
+#include "stdafx.h"
+#include "Version.h"
+#include "Init.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+
+#include "Util.h"
+#include "Hand.h"
+#include "HandClassifier.h"
+#include "HandDetector.h"
+#include "PlaneDetector.h"
+#include "ThreadPool.h"
+#include "Visualizer.h"
+
+namespace ark {
+    namespace {
+        typedef std::chrono::steady_clock Clock;
+
+        double millisSince(Clock::time_point start)
+        {
+            return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+
+        /** barrier shared by the scratch reservation tasks */
+        struct ScratchBarrier {
+            std::mutex mutex;
+            std::condition_variable condition;
+            int started = 0, finished = 0;
+        };
+
+        /**
+         * Preallocate the scratch buffers of each worker of the pool.
+         * Every task waits (up to 1 s, in case some workers are busy) for the others to start,
+         * so that each lands on a different worker.
+         */
+        void reserveWorkerScratch(ThreadPool & pool, const cv::Size & frame_size)
+        {
+            const int numWorkers = pool.getNumWorkers();
+            auto barrier = std::make_shared<ScratchBarrier>();
+
+            for (int i = 0; i < numWorkers; ++i) {
+                pool.submit([=]() {
+                    util::reserveScratch(frame_size);
+
+                    std::unique_lock<std::mutex> lock(barrier->mutex);
+                    if (++barrier->started == numWorkers) barrier->condition.notify_all();
+                    barrier->condition.wait_for(lock, std::chrono::seconds(1),
+                        [&] { return barrier->started >= numWorkers; });
+
+                    ++barrier->finished;
+                    barrier->condition.notify_all();
+                });
+            }
+
+            std::unique_lock<std::mutex> lock(barrier->mutex);
+            barrier->condition.wait(lock, [&] { return barrier->finished >= numWorkers; });
+        }
+
+        /**
+         * Synthetic xyz map for warm-up: a tilted background plane with a
+         * hand-sized blob in front of it touching the bottom of the frame
+         */
+        cv::Mat syntheticFrame(const cv::Size & size)
+        {
+            cv::Mat xyz(size, CV_32FC3);
+            const float focal = (float)size.width, cx = size.width * 0.5f, cy = size.height * 0.5f;
+            const cv::Rect blob(size.width * 3 / 8, size.height / 2, size.width / 4, size.height / 2);
+
+            for (int r = 0; r < size.height; ++r) {
+                Vec3f * ptr = xyz.ptr<Vec3f>(r);
+                for (int c = 0; c < size.width; ++c) {
+                    const float z = blob.contains(Point2i(c, r)) ? 0.4f : 1.0f + 0.3f * r / size.height;
+                    ptr[c] = Vec3f((c - cx) * z / focal, (r - cy) * z / focal, z);
+                }
+            }
+
+            return xyz;
+        }
+    }
+
+    std::string InitReport::toString() const
+    {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1) << "OpenARK init: " << totalMs << " ms total";
+
+        if (handValidatorMs >= 0.0) {
+            ss << "\n  hand validator: " << handValidatorMs << " ms"
+               << (handValidatorLoaded ? "" : " (models not found)");
+        }
+        if (threadPoolMs >= 0.0) ss << "\n  thread pool: " << threadPoolMs << " ms";
+        if (scratchMs >= 0.0) ss << "\n  scratch buffers: " << scratchMs << " ms";
+        if (pclViewerMs >= 0.0) ss << "\n  PCL viewer: " << pclViewerMs << " ms";
+
+        for (size_t i = 0; i < warmUpFrameMs.size(); ++i) {
+            ss << "\n  warm-up frame " << i << ": " << warmUpFrameMs[i] << " ms";
+        }
+
+        return ss.str();
+    }
+
+    InitReport init(const InitOptions & options)
+    {
+        InitReport report;
+        const Clock::time_point initStart = Clock::now();
+        Clock::time_point start;
+
+        if (options.loadHandValidator) {
+            start = Clock::now();
+            report.handValidatorLoaded = Hand::getValidator()->isTrained();
+            report.handValidatorMs = millisSince(start);
+        }
+
+        if (options.startThreadPool) {
+            start = Clock::now();
+            ThreadPool::global();
+            report.threadPoolMs = millisSince(start);
+        }
+
+        if (options.frameSize.area() > 0) {
+            start = Clock::now();
+            util::reserveScratch(options.frameSize);
+            if (options.startThreadPool) {
+                reserveWorkerScratch(ThreadPool::global(), options.frameSize);
+            }
+            report.scratchMs = millisSince(start);
+        }
+
+        if (options.openPCLViewer) {
+            start = Clock::now();
+            Visualizer::initPCLViewer();
+            report.pclViewerMs = millisSince(start);
+        }
+
+        if (options.frameSize.area() > 0 && options.warmUpFrames > 0) {
+            // only touch the SVM if the caller asked for it to be loaded
+            DetectionParams::Ptr params = options.params ? std::make_shared<DetectionParams>(*options.params)
+                                                         : DetectionParams::create();
+            params->handUseSVM = params->handUseSVM && options.loadHandValidator;
+
+            // throwaway detectors, so that no state from the synthetic frames is left behind
+            PlaneDetector::Ptr planeDetector = std::make_shared<PlaneDetector>(params);
+            HandDetector::Ptr handDetector = std::make_shared<HandDetector>(planeDetector, params);
+
+            const cv::Mat synthetic = syntheticFrame(options.frameSize);
+            for (int i = 0; i < options.warmUpFrames; ++i) {
+                // detectors may modify the frame in place
+                const cv::Mat frame = synthetic.clone();
+                start = Clock::now();
+                planeDetector->update(frame);
+                handDetector->update(frame);
+                report.warmUpFrameMs.push_back(millisSince(start));
+            }
+        }
+
+        report.totalMs = millisSince(initStart);
+        return report;
+    }
+}
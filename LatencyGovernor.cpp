@@ -0,0 +1,274 @@
+#include "stdafx.h"
+#include "Version.h"
+#include "LatencyGovernor.h"
+
+#include <iomanip>
+
+namespace ark {
+    namespace {
+        double millisBetween(LatencyGovernor::Clock::time_point start, LatencyGovernor::Clock::time_point end)
+        {
+            return std::chrono::duration<double, std::milli>(end - start).count();
+        }
+    }
+
+    LatencyGovernor::StageTimer::StageTimer(LatencyGovernor & governor, const std::string & stage)
+        : governor(governor), stage(stage), start(Clock::now()) { }
+
+    LatencyGovernor::StageTimer::~StageTimer()
+    {
+        governor.recordStage(stage, millisBetween(start, Clock::now()));
+    }
+
+    LatencyGovernor::LatencyGovernor(DetectionParams::Ptr params, const Config & config)
+        : config(config)
+    {
+        if (this->config.levels.empty()) this->config.levels = defaultLevels();
+        this->config.smoothing = std::min(std::max(this->config.smoothing, 0.01), 1.0);
+        this->config.maxStepUpBackoff = std::max(this->config.maxStepUpBackoff, 1);
+
+        const int numLevels = (int)this->config.levels.size();
+        stepUpBackoff.assign(numLevels, 1);
+
+        stats.numLevels = numLevels;
+        stats.budgetMs = this->config.budgetMs;
+        stats.framesAtLevel.assign(numLevels, 0);
+
+        frameStart = Clock::now();
+        setBaseParams(params);
+    }
+
+    LatencyGovernor::LatencyGovernor(DetectionParams::Ptr params)
+        : LatencyGovernor(params, Config()) { }
+
+    LatencyGovernor::LatencyGovernor(DetectionParams::Ptr params, double budget_ms)
+        : LatencyGovernor(params, [budget_ms]() { Config c; c.budgetMs = budget_ms; return c; }()) { }
+
+    void LatencyGovernor::addDetector(const Detector::Ptr & detector)
+    {
+        if (!detector) return;
+        detectors.push_back(detector);
+        detector->setParams(levelParams);
+    }
+
+    void LatencyGovernor::setBaseParams(const DetectionParams::Ptr params)
+    {
+        // copy, so that the caller may keep modifying its own instance
+        baseParams = std::make_shared<DetectionParams>(params ? *params : *DetectionParams::DEFAULT);
+        applyLevel();
+    }
+
+    DetectionParams::Ptr LatencyGovernor::getParams() const
+    {
+        return levelParams;
+    }
+
+    void LatencyGovernor::beginFrame()
+    {
+        frameStart = Clock::now();
+    }
+
+    double LatencyGovernor::endFrame()
+    {
+        const double frameMs = millisBetween(frameStart, Clock::now());
+        recordFrame(frameMs);
+        return frameMs;
+    }
+
+    void LatencyGovernor::recordFrame(double frame_ms)
+    {
+        int level;
+        double avgMs;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.avgFrameMs = stats.numFrames == 0 ? frame_ms :
+                stats.avgFrameMs + config.smoothing * (frame_ms - stats.avgFrameMs);
+            stats.lastFrameMs = frame_ms;
+            ++stats.numFrames;
+            if (frame_ms > config.budgetMs) ++stats.numFramesOverBudget;
+            ++stats.framesAtLevel[stats.level];
+
+            level = stats.level;
+            avgMs = stats.avgFrameMs;
+        }
+
+        ++frameIndex;
+        ++framesSinceTransition;
+
+        // a step up that held for a full window has succeeded: relax its backoff
+        if (lastWasStepUp && framesSinceTransition == config.stepUpFrames && stepUpBackoff[level] > 1) {
+            stepUpBackoff[level] /= 2;
+        }
+
+        if (avgMs > config.budgetMs) {
+            ++framesOver;
+            framesUnder = 0;
+        }
+        else if (avgMs < config.budgetMs * config.headroom) {
+            ++framesUnder;
+            framesOver = 0;
+        }
+        else {
+            framesOver = framesUnder = 0;
+        }
+
+        if (framesSinceTransition < config.cooldownFrames) return;
+
+        const int numLevels = (int)config.levels.size();
+        if (framesOver >= config.stepDownFrames && level + 1 < numLevels) {
+            changeLevel(level + 1, avgMs);
+        }
+        else if (level > 0 && framesUnder >= config.stepUpFrames * stepUpBackoff[level - 1]) {
+            changeLevel(level - 1, avgMs);
+        }
+    }
+
+    void LatencyGovernor::recordStage(const std::string & stage, double ms)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        StageStats & s = stats.stages[stage];
+        s.avgMs = s.count == 0 ? ms : s.avgMs + config.smoothing * (ms - s.avgMs);
+        s.lastMs = ms;
+        s.maxMs = std::max(s.maxMs, ms);
+        ++s.count;
+    }
+
+    bool LatencyGovernor::shouldRunPlanes() const
+    {
+        const int interval = std::max(config.levels[getLevel()].planeInterval, 1);
+        return frameIndex % interval == 0;
+    }
+
+    int LatencyGovernor::getLevel() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats.level;
+    }
+
+    int LatencyGovernor::addTransitionCallback(std::function<void(const Transition &)> func)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const int id = callbacks.empty() ? 0 : callbacks.rbegin()->first + 1;
+        callbacks[id] = func;
+        return id;
+    }
+
+    void LatencyGovernor::removeTransitionCallback(int id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        callbacks.erase(id);
+    }
+
+    LatencyGovernor::Stats LatencyGovernor::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    std::vector<LatencyGovernor::Level> LatencyGovernor::defaultLevels()
+    {
+        std::vector<Level> levels(5);
+
+        levels[1].handClusterIntervalScale = 1.5f;
+        levels[1].normalResolutionStep = 1;
+        levels[1].quantizeSVM = true;
+
+        levels[2] = levels[1];
+        levels[2].planeInterval = 2;
+
+        levels[3] = levels[2];
+        levels[3].handClusterIntervalScale = 2.0f;
+        levels[3].disableSVM = true;
+
+        levels[4] = levels[3];
+        levels[4].normalResolutionStep = 2;
+        levels[4].planeInterval = 4;
+
+        return levels;
+    }
+
+    std::string LatencyGovernor::Stats::toString() const
+    {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1) << "Latency governor: level " << level << "/" << numLevels - 1
+           << ", frame " << avgFrameMs << " ms avg / " << budgetMs << " ms budget, "
+           << numFramesOverBudget << "/" << numFrames << " frames over budget";
+        ss << "\n  transitions: " << numStepDowns << " down, " << numStepUps << " up ("
+           << numFailedStepUps << " undone)";
+
+        for (size_t i = 0; i < framesAtLevel.size(); ++i) {
+            ss << "\n  level " << i << ": " << framesAtLevel[i] << " frames";
+        }
+        for (const auto & stage : stages) {
+            ss << "\n  " << stage.first << ": " << stage.second.avgMs << " ms avg, "
+               << stage.second.maxMs << " ms max";
+        }
+
+        return ss.str();
+    }
+
+    void LatencyGovernor::changeLevel(int level, double frame_ms)
+    {
+        const bool stepUp = level < getLevel();
+
+        // stepping down again right after stepping up: that level is too slow, so wait longer next time
+        const bool failedStepUp = !stepUp && lastWasStepUp && framesSinceTransition < config.stepUpFrames;
+        if (failedStepUp) {
+            int & backoff = stepUpBackoff[level - 1];
+            backoff = std::min(backoff * 2, config.maxStepUpBackoff);
+        }
+
+        Transition transition;
+        std::vector<std::function<void(const Transition &)> > funcs;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            transition.frame = frameIndex;
+            transition.fromLevel = stats.level;
+            transition.toLevel = level;
+            transition.frameMs = frame_ms;
+
+            stats.level = level;
+            if (stepUp) ++stats.numStepUps;
+            else ++stats.numStepDowns;
+            if (failedStepUp) ++stats.numFailedStepUps;
+
+            stats.recentTransitions.push_back(transition);
+            if (stats.recentTransitions.size() > MAX_RECENT_TRANSITIONS) stats.recentTransitions.pop_front();
+
+            for (const auto & callback : callbacks) funcs.push_back(callback.second);
+        }
+
+        lastWasStepUp = stepUp;
+        framesSinceTransition = framesOver = framesUnder = 0;
+        applyLevel();
+
+        for (const auto & func : funcs) {
+            func(transition);
+        }
+    }
+
+    void LatencyGovernor::applyLevel()
+    {
+        const Level & level = config.levels[getLevel()];
+
+        DetectionParams::Ptr params = std::make_shared<DetectionParams>(*baseParams);
+        params->handClusterInterval = std::max(1,
+            (int)std::lround(baseParams->handClusterInterval * level.handClusterIntervalScale));
+        params->normalResolution = std::max(1, baseParams->normalResolution + level.normalResolutionStep);
+        if (level.quantizeSVM) params->handSVMQuantized = true;
+        if (level.disableSVM) params->handUseSVM = false;
+        levelParams = params;
+
+        // Detector::setParams copies the parameters and applies them at the detector's next update
+        auto it = detectors.begin();
+        while (it != detectors.end()) {
+            if (Detector::Ptr detector = it->lock()) {
+                detector->setParams(levelParams);
+                ++it;
+            }
+            else {
+                it = detectors.erase(it);
+            }
+        }
+    }
+}
@@ -12,6 +12,20 @@ namespace ark {
             return;
         }
 
+        if (!openSensor())
+        {
+            return;
+        }
+
+        numPixels = dd.img.numRows * dd.img.numColumns; // Number of pixels in camera
+        dists = new float[3 * numPixels]; // Dists contains XYZ values. needs to be 3x the size of numPixels
+        amps = new float[numPixels];
+        flags = new unsigned[numPixels];
+        frame.create(dd.img.numRows, dd.img.numColumns, CV_8UC3);
+    }
+
+    bool PMDCamera::openSensor()
+    {
         std::cout << "Trying to open pmd\n";
         auto res = pmdOpen(&hnd, SOURCE_PLUGIN, SOURCE_PARAM, PROC_PLUGIN, PROC_PARAM); //Open the PMD sensor
 
@@ -19,7 +33,7 @@ namespace ark {
         {
             pmdGetLastError(0, err, 128);
             fprintf(stderr, "Could not connect: %s\n", err);
-            return;
+            return false;
         }
 
         printf("opened sensor\n");
@@ -32,7 +46,7 @@ namespace ark {
             pmdGetLastError(hnd, err, 128);
             fprintf(stderr, "Couldn't transfer data: %s\n", err);
             pmdClose(hnd);
-            return;
+            return false;
         }
 
         printf("acquired image\n");
@@ -47,7 +61,7 @@ namespace ark {
             pmdGetLastError(hnd, err, 128);
             fprintf(stderr, "Couldn't get data description: %s\n", err);
             pmdClose(hnd);
-            return;
+            return false;
         }
 
         printf("retrieved source data description\n");
@@ -56,13 +70,19 @@ namespace ark {
         {
             fprintf(stderr, "Source data is not an image!\n");
             pmdClose(hnd);
-            return;
+            return false;
         }
 
-        numPixels = dd.img.numRows * dd.img.numColumns; // Number of pixels in camera
-        dists = new float[3 * numPixels]; // Dists contains XYZ values. needs to be 3x the size of numPixels
-        amps = new float[numPixels];
-        frame.create(dd.img.numRows, dd.img.numColumns, CV_8UC3);
+        return true;
+    }
+
+    bool PMDCamera::reconnect()
+    {
+        pmdClose(hnd);
+        if (!openSensor()) return false;
+
+        badInputFlag = false;
+        return true;
     }
     
     const std::string PMDCamera::getModelName() const {
@@ -103,6 +123,10 @@ namespace ark {
         printf("closing sensor\n");
         pmdClose(hnd);
         printf("sensor closed\n");
+
+        delete[] dists;
+        delete[] amps;
+        delete[] flags;
     }
 
     /***
@@ -111,19 +135,23 @@ namespace ark {
     void PMDCamera::update(cv::Mat & xyz_map, cv::Mat & rgb_map, cv::Mat & ir_map, 
                              cv::Mat & amp_map, cv::Mat & flag_map) 
     {
-        // fill in amp map
-        auto res = pmdGetAmplitudes(hnd, amps, numPixels * sizeof(float));
-
-        if (res != PMD_OK)
+        // fill in amp map (only if someone is subscribed to it)
+        if (isChannelInFrame(CHANNEL_AMP))
         {
-            pmdGetLastError(hnd, err, 128);
-            fprintf(stderr, "Couldn't get amplitudes: %s\n", err);
-            pmdClose(hnd);
-            return;
+            auto res = pmdGetAmplitudes(hnd, amps, numPixels * sizeof(float));
+
+            if (res != PMD_OK)
+            {
+                pmdGetLastError(hnd, err, 128);
+                fprintf(stderr, "Couldn't get amplitudes: %s\n", err);
+                badInputFlag = true;
+                requestReconnect();
+                return;
+            }
+
+            amp_map.data = reinterpret_cast<uchar *>(amps);
         }
 
-        amp_map.data = reinterpret_cast<uchar *>(amps);
-
         // fill in Z coordinates
         auto res = pmdGet3DCoordinates(hnd, dists, 3 * numPixels * sizeof(float)); //store x,y,z coordinates dists (type: float*)
         //float * zCoords = new float[1]; //store z-Coordinates of dists in zCoords
@@ -132,36 +160,39 @@ namespace ark {
         {
             pmdGetLastError(hnd, err, 128);
             fprintf(stderr, "Couldn't get 3D coordinates: %s\n", err);
-            pmdClose(hnd);
+            badInputFlag = true;
+            requestReconnect();
             return;
         }
 
         xyz_map = cv::Mat(xyzMap.size(), xyzMap.type(), dists);
 
-        // Flags. Helps with denoising.
-        auto flags = new unsigned[ampMap.cols*ampMap.rows];
-        auto res = pmdGetFlags(hnd, flags, numPixels * sizeof(unsigned));
-
-        if (res != PMD_OK)
+        // Flags. Helps with denoising. (only if someone is subscribed to them)
+        if (isChannelInFrame(CHANNEL_FLAG))
         {
-            pmdGetLastError(hnd, err, 128);
-            fprintf(stderr, "Couldn't get the flags: %s\n", err);
-            pmdClose(hnd);
-            return;
+            auto res = pmdGetFlags(hnd, flags, numPixels * sizeof(unsigned));
+
+            if (res != PMD_OK)
+            {
+                pmdGetLastError(hnd, err, 128);
+                fprintf(stderr, "Couldn't get the flags: %s\n", err);
+                badInputFlag = true;
+                requestReconnect();
+                return;
+            }
+
+            flag_map.data = reinterpret_cast<uchar *>(flags);
         }
 
-        flag_map.data = reinterpret_cast<uchar *>(flags);
-
         res = pmdUpdate(hnd);
         if (res != PMD_OK)
         {
             pmdGetLastError(hnd, err, 128);
             fprintf(stderr, "Couldn't update the PMD camera: %s\n", err);
-            pmdClose(hnd);
+            badInputFlag = true;
+            requestReconnect();
             return;
         }
-
-        delete flags;
     }
 
 
@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "PlaneDetector.h"
+#include "ThreadPool.h"
 
 namespace ark {
     PlaneDetector::PlaneDetector(DetectionParams::Ptr params) : Detector(params) { }
@@ -9,6 +10,29 @@ namespace ark {
         return normalMap;
     }
 
+    void PlaneDetector::setExcludedMask(const cv::Mat & mask)
+    {
+        std::lock_guard<std::mutex> lock(excludedMaskMutex);
+        excludedMaskPending = !mask.empty();
+
+        // reuses the buffer from previous frames
+        if (excludedMaskPending) mask.copyTo(excludedMask);
+    }
+
+    void PlaneDetector::Workspace::prepare(cv::Size frame_size)
+    {
+        if (frame_size != size) {
+            size = frame_size;
+            const int N = size.area();
+
+            floodFillMap.create(size, CV_8U);
+            allIndices.reserve(N);
+            allXyzPoints.reserve(N);
+        }
+
+        candidates.clear();
+    }
+
     void PlaneDetector::detect(cv::Mat & image)
     {
         planes.clear();
@@ -17,13 +41,35 @@ namespace ark {
         std::vector<VecP2iPtr> points;
         std::vector<VecV3fPtr> pointsXYZ;
 
-        util::computeNormalMap(image, normalMap, 4, params->normalResolution, false);
-        detectPlaneHelper(image, normalMap, equations, points, pointsXYZ, params);
-
-        for (uint i = 0; i < equations.size(); ++i) {
-            FramePlane::Ptr planePtr = std::make_shared<FramePlane>
-                (equations[i], points[i], pointsXYZ[i], image, params);
+        // skip the regions of hands found in the previous frame
+        bool useMask = false;
+        {
+            std::lock_guard<std::mutex> lock(excludedMaskMutex);
+            if (excludedMaskPending) {
+                std::swap(excludedMask, frameExcludedMask);
+                excludedMaskPending = false;
+                useMask = frameExcludedMask.size() == image.size();
+            }
+        }
+        const cv::Mat excluded = useMask ? frameExcludedMask : cv::Mat();
+
+        // segment on contiguous decimated normal and xyz images; points are mapped back to full resolution
+        // only for the planes that are output
+        const int resolution = params->normalResolution;
+        util::computeDecimatedNormalMap(image, normalMap, workspace.xyzMap, 4, resolution, excluded);
+        detectPlaneHelper(workspace.xyzMap, normalMap, equations, points, pointsXYZ, resolution, params);
+
+        // construct plane objects in parallel, then keep the large ones (in order)
+        std::vector<FramePlane::Ptr> & candidates = workspace.candidates;
+        candidates.resize(equations.size());
+        ThreadPool::global().parallelFor(0, (int)equations.size(), [&](int start, int end) {
+            for (int i = start; i < end; ++i) {
+                candidates[i] = std::make_shared<FramePlane>
+                    (equations[i], points[i], pointsXYZ[i], image, params);
+            }
+        }, 1);
 
+        for (FramePlane::Ptr & planePtr : candidates) {
             if (planePtr->getSurfArea() > params->planeMinArea) {
                 planes.emplace_back(planePtr);
             }
@@ -58,13 +104,14 @@ namespace ark {
     void PlaneDetector::detectPlaneHelper(const cv::Mat & xyz_map, const cv::Mat & normal_map,
         std::vector<Vec3f> & output_equations, 
         std::vector<VecP2iPtr> & output_points, std::vector<VecV3fPtr> & output_points_xyz, 
-        DetectionParams::Ptr params)
+        int resolution, DetectionParams::Ptr params)
     { 
         // 1. initialize
         const int R = xyz_map.rows, C = xyz_map.cols, N = R * C;
 
-        // initialize flood fill map
-        cv::Mat floodFillMap(R, C, CV_8U);
+        // initialize flood fill map (invalid and excluded pixels have zero depth and count as visited)
+        workspace.prepare(xyz_map.size());
+        cv::Mat & floodFillMap = workspace.floodFillMap;
         const Vec3f * ptr; uchar * visPtr;
         for (int r = 0; r < R; ++r)
         {
@@ -76,9 +123,12 @@ namespace ark {
             }
         }
 
+        // precompute which normals are similar to their neighbors
+        util::computeConnectivityMap(normal_map, connectivityMap, params->planeFloodFillThreshold, 1);
+
         int compId = -1;
-        std::vector<Point2i> allIndices;
-        allIndices.reserve(N);
+        std::vector<Point2i> & allIndices = workspace.allIndices;
+        std::vector<Vec3f> & allXyzPoints = workspace.allXyzPoints;
 
         // 2. find 'subplanes' i.e. all flat objects visible in frame and combine similar ones
         // stores points on each plane
@@ -90,36 +140,30 @@ namespace ark {
         // equations of the planes: ax + by - z + c = 0
         std::vector<Vec3f> planeEquation;
 
-        // compute constants
-        const int SUBPLANE_MIN_POINTS = params->subplaneMinPoints * N /
-            (params->normalResolution * params->normalResolution);
-
-        const int PLANE_MIN_POINTS = params->planeMinPoints * N /
-            (params->normalResolution * params->normalResolution);
+        // compute constants (the maps are already decimated, so N is the number of sampled points)
+        const int SUBPLANE_MIN_POINTS = params->subplaneMinPoints * N;
+        const int PLANE_MIN_POINTS = params->planeMinPoints * N;
+        const int PLANE_MIN_INLIERS = params->planeEquationMinInliers * N;
 
-        const int PLANE_MIN_INLIERS = params->planeEquationMinInliers * N /
-            (params->normalResolution * params->normalResolution);
-
-        for (int r = 0; r < R; r += params->normalResolution) {
+        for (int r = 0; r < R; ++r) {
             visPtr = floodFillMap.ptr<uchar>(r);
 
-            for (int c = 0; c < C; c += params->normalResolution) {
+            for (int c = 0; c < C; ++c) {
                 if (visPtr[c] == 0) continue;
 
                 Point2i pt(c, r);
                 // flood fill normals
-                int numPts = util::floodFill(normal_map, pt, params->planeFloodFillThreshold,
-                                             &allIndices, nullptr, nullptr,
-                                             params->normalResolution, 0, 0.0f, &floodFillMap);
+                int numPts = util::floodFillConnected(connectivityMap, pt, &allIndices, nullptr, nullptr,
+                                                      1, 0, &floodFillMap);
 
                 if (numPts >= SUBPLANE_MIN_POINTS) {
-                    std::vector<Vec3f> allXyzPoints(numPts);
+                    if ((int)allXyzPoints.size() < numPts) allXyzPoints.resize(numPts);
 
                     for (int k = 0; k < numPts; ++k) {
-                        allXyzPoints[k] = xyz_map.at<Vec3f>(allIndices[k]);;
+                        allXyzPoints[k] = xyz_map.at<Vec3f>(allIndices[k]);
                     }
 
-                    // find surface area
+                    // find surface area (only depends on the order of the points, so works on the decimated grid)
                     util::radixSortPoints(allIndices, C, R, numPts, &allXyzPoints);
                     double surfArea = util::surfaceArea(normal_map.size(), allIndices,
                         allXyzPoints, numPts);
@@ -172,25 +216,39 @@ namespace ark {
         }
 
         // 3. find equations of the combined planes and construct Plane objects with the data
-        for (unsigned i = 0; i < planeEquation.size(); ++i) {
-            int SZ = (int)planePointsIJ[i]->size();
-            if (SZ < PLANE_MIN_POINTS) continue;
+        //    (each plane is refined independently, in parallel)
+        const int numPlanes = (int)planeEquation.size();
+        std::vector<char> & planeAccepted = workspace.planeAccepted;
+        planeAccepted.assign(numPlanes, 0);
+
+        ThreadPool::global().parallelFor(0, numPlanes, [&](int start, int end) {
+            for (int i = start; i < end; ++i) {
+                int SZ = (int)planePointsIJ[i]->size();
+                if (SZ < PLANE_MIN_POINTS) continue;
 
-            std::vector<Vec3f> pointsXYZ;
-            util::removeOutliers(*planePointsXYZ[i], pointsXYZ, params->planeOutlierRemovalThreshold);
+                std::vector<Vec3f> pointsXYZ;
+                util::removeOutliers(*planePointsXYZ[i], pointsXYZ, params->planeOutlierRemovalThreshold);
 
-            planeEquation[i] = util::linearRegression(pointsXYZ);
+                planeEquation[i] = util::linearRegression(pointsXYZ);
 
-            int goodPts = 0;
+                int goodPts = 0;
 
-            for (uint j = 0; j < SZ; ++j) {
-                float norm = util::pointPlaneNorm((*planePointsXYZ[i])[j], planeEquation[i]);
-                if (norm < params->handPlaneMinNorm) {
-                    ++goodPts;
+                for (uint j = 0; j < SZ; ++j) {
+                    float norm = util::pointPlaneNorm((*planePointsXYZ[i])[j], planeEquation[i]);
+                    if (norm < params->handPlaneMinNorm) {
+                        ++goodPts;
+                    }
                 }
+
+                planeAccepted[i] = goodPts >= PLANE_MIN_INLIERS;
             }
+        }, 1);
+
+        for (int i = 0; i < numPlanes; ++i) {
+            if (!planeAccepted[i]) continue;
 
-            if (goodPts < PLANE_MIN_INLIERS) continue;
+            // map the points back to full resolution
+            for (Point2i & pt : *planePointsIJ[i]) pt *= resolution;
 
             // push to output
             output_points.push_back(planePointsIJ[i]);
@@ -0,0 +1,120 @@
+#include "stdafx.h"
+#include "Version.h"
+#include "PointCloudAdapter.h"
+
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace ark {
+    PointCloudAdapter::PointCloudAdapter(int pool_size) : poolSize(std::max(1, pool_size)) { }
+
+    PointCloudAdapter::Cloud::Ptr PointCloudAdapter::convert(const cv::Mat & xyz_map)
+    {
+        ASSERT(xyz_map.type() == CV_32FC3, "PointCloudAdapter: XYZ map must be of type CV_32FC3");
+
+        const int R = xyz_map.rows, C = xyz_map.cols;
+        Cloud::Ptr cloud = acquire(R, C);
+        cv::Mat dest = wrap(*cloud);
+
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        bool dense = true;
+
+        for (int r = 0; r < R; ++r) {
+            const float * src = xyz_map.ptr<float>(r);
+            float * dst = dest.ptr<float>(r);
+            int c = 0;
+
+#if CV_SIMD128
+            const cv::v_float32x4 vZero = cv::v_setzero_f32();
+            const cv::v_float32x4 vNaN = cv::v_setall_f32(nan);
+            const cv::v_float32x4 vOne = cv::v_setall_f32(1.0f);
+            cv::v_float32x4 vInvalid = vZero;
+
+            for (; c <= C - 4; c += 4) {
+                cv::v_float32x4 x, y, z;
+                cv::v_load_deinterleave(src + c * 3, x, y, z);
+
+                cv::v_float32x4 valid = z > vZero;
+                vInvalid = vInvalid | ~valid;
+                cv::v_store_interleave(dst + c * 4, cv::v_select(valid, x, vNaN),
+                    cv::v_select(valid, y, vNaN), cv::v_select(valid, z, vNaN), vOne);
+            }
+
+            if (cv::v_signmask(vInvalid)) dense = false;
+#endif
+
+            for (; c < C; ++c) {
+                const float * in = src + c * 3;
+                float * out = dst + c * 4;
+
+                if (in[2] > 0.0f) {
+                    out[0] = in[0];
+                    out[1] = in[1];
+                    out[2] = in[2];
+                }
+                else {
+                    out[0] = out[1] = out[2] = nan;
+                    dense = false;
+                }
+                out[3] = 1.0f;
+            }
+        }
+
+        cloud->is_dense = dense;
+        return cloud;
+    }
+
+    PointCloudAdapter::Cloud::Ptr PointCloudAdapter::convertDownsampled(const cv::Mat & xyz_map, float leaf_size)
+    {
+        Cloud::Ptr organized = convert(xyz_map);
+        Cloud::Ptr result(new Cloud());
+
+        voxelGrid.setInputCloud(organized);
+        voxelGrid.setLeafSize(leaf_size, leaf_size, leaf_size);
+        voxelGrid.filter(*result);
+
+        // release our reference so the organized cloud can be recycled
+        voxelGrid.setInputCloud(Cloud::ConstPtr());
+        return result;
+    }
+
+    void PointCloudAdapter::clear()
+    {
+        pool.clear();
+    }
+
+    cv::Mat PointCloudAdapter::wrap(Cloud & cloud)
+    {
+        static_assert(sizeof(pcl::PointXYZ) == 4 * sizeof(float), "PointCloudAdapter: unexpected PointXYZ layout");
+        return cv::Mat((int)cloud.height, (int)cloud.width, CV_32FC4, cloud.points.data());
+    }
+
+    PointCloudAdapter::Cloud::Ptr PointCloudAdapter::acquire(int rows, int cols)
+    {
+        // reuse a cloud no longer held by anyone else, preferring one of the right size
+        Cloud::Ptr * freeCloud = nullptr;
+        for (Cloud::Ptr & cloud : pool) {
+            if (cloud.use_count() != 1) continue;
+            freeCloud = &cloud;
+            if ((int)cloud->height == rows && (int)cloud->width == cols) break;
+        }
+
+        if (freeCloud == nullptr) {
+            if ((int)pool.size() >= poolSize) {
+                // all pooled clouds are in use: hand out an unpooled one
+                Cloud::Ptr cloud(new Cloud((uint32_t)cols, (uint32_t)rows));
+                return cloud;
+            }
+            pool.emplace_back(new Cloud());
+            freeCloud = &pool.back();
+        }
+
+        Cloud & cloud = **freeCloud;
+        if ((int)cloud.height != rows || (int)cloud.width != cols) {
+            cloud.points.resize((size_t)rows * cols);
+            cloud.width = (uint32_t)cols;
+            cloud.height = (uint32_t)rows;
+        }
+
+        return *freeCloud;
+    }
+}
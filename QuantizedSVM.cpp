@@ -0,0 +1,339 @@
+#include "stdafx.h"
+#include "Version.h"
+#include "QuantizedSVM.h"
+
+#include <chrono>
+#include <iomanip>
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace ark {
+    namespace classifier {
+        namespace {
+            /** number of floats processed per SIMD step (support vectors are padded to a multiple of this) */
+            const int LANES = 4;
+
+            /** convert a float to IEEE half precision (round to nearest) */
+            uint16_t floatToHalf(float value)
+            {
+                uint32_t bits;
+                memcpy(&bits, &value, sizeof bits);
+
+                const uint16_t sign = (uint16_t)((bits >> 16) & 0x8000u);
+                const int exponent = (int)((bits >> 23) & 0xffu) - 127 + 15;
+                uint32_t mantissa = bits & 0x7fffffu;
+
+                if (exponent >= 31) {
+                    // overflow (or NaN/infinity): saturate to infinity
+                    return (uint16_t)(sign | 0x7c00u);
+                }
+                if (exponent <= 0) {
+                    // subnormal half, or zero
+                    if (exponent < -10) return sign;
+                    mantissa |= 0x800000u;
+                    const int shift = 14 - exponent;
+                    uint32_t half = mantissa >> shift;
+                    if ((mantissa >> (shift - 1)) & 1u) ++half;
+                    return (uint16_t)(sign | half);
+                }
+
+                uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+                // round to nearest; a carry into the exponent is still correct
+                if (mantissa & 0x1000u) ++half;
+                return (uint16_t)(sign | half);
+            }
+
+            /** convert an IEEE half precision value to a float */
+            float halfToFloat(uint16_t half)
+            {
+                const uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+                int exponent = (half >> 10) & 0x1f;
+                uint32_t mantissa = half & 0x3ffu;
+                uint32_t bits;
+
+                if (exponent == 0) {
+                    if (mantissa == 0) {
+                        bits = sign;
+                    }
+                    else {
+                        // subnormal: normalize
+                        exponent = 1;
+                        while (!(mantissa & 0x400u)) {
+                            mantissa <<= 1;
+                            --exponent;
+                        }
+                        mantissa &= 0x3ffu;
+                        bits = sign | ((uint32_t)(exponent - 15 + 127) << 23) | (mantissa << 13);
+                    }
+                }
+                else if (exponent == 31) {
+                    bits = sign | 0x7f800000u | (mantissa << 13);
+                }
+                else {
+                    bits = sign | ((uint32_t)(exponent - 15 + 127) << 23) | (mantissa << 13);
+                }
+
+                float value;
+                memcpy(&value, &bits, sizeof value);
+                return value;
+            }
+
+            /** weighted squared distance sum_j w_j (x_j - v_j)^2 over n (multiple of LANES) floats */
+            float weightedDistanceSq(const float * x, const float * v, const float * w, int n)
+            {
+                int j = 0;
+                float result = 0.0f;
+#if CV_SIMD128
+                cv::v_float32x4 acc = cv::v_setzero_f32();
+                for (; j <= n - LANES; j += LANES) {
+                    const cv::v_float32x4 d = cv::v_load(x + j) - cv::v_load(v + j);
+                    acc = acc + d * d * cv::v_load(w + j);
+                }
+                result = cv::v_reduce_sum(acc);
+#endif
+                for (; j < n; ++j) {
+                    const float d = x[j] - v[j];
+                    result += d * d * w[j];
+                }
+                return result;
+            }
+        }
+
+        std::string QuantizedSVM::AccuracyReport::toString() const
+        {
+            std::stringstream ss;
+            ss << std::fixed << std::setprecision(4)
+               << "Quantized SVM on " << numSamples << " samples: mean abs error " << meanAbsError
+               << ", max abs error " << maxAbsError << ", "
+               << std::setprecision(2) << (numSamples ? 100.0 * numAgree / numSamples : 100.0) << "% same decisions\n"
+               << "  model size " << floatBytes << " -> " << quantizedBytes << " bytes, "
+               << "prediction time " << floatMs << " -> " << quantizedMs << " ms";
+            return ss.str();
+        }
+
+        QuantizedSVM::QuantizedSVM() { }
+
+        bool QuantizedSVM::quantize(const cv::Ptr<cv::ml::SVM> & svm, Precision precision)
+        {
+            numVectors = 0;
+            if (svm.empty() || !svm->isTrained()) return false;
+
+            const int type = svm->getType();
+            if (type != cv::ml::SVM::EPS_SVR && type != cv::ml::SVM::NU_SVR) return false;
+
+            const int kernelType = svm->getKernelType();
+            if (kernelType != cv::ml::SVM::LINEAR && kernelType != cv::ml::SVM::RBF) return false;
+
+            cv::Mat sv = svm->getSupportVectors();
+            cv::Mat alphaMat, svIdx;
+            const double decisionRho = svm->getDecisionFunction(0, alphaMat, svIdx);
+            alphaMat.convertTo(alphaMat, CV_32F);
+            svIdx.convertTo(svIdx, CV_32S);
+
+            this->precision = precision;
+            kernel = kernelType;
+            gamma = (float)svm->getGamma();
+            rho = (float)decisionRho;
+            numVectors = (int)svIdx.total();
+            numFeatures = sv.cols;
+            stride = (numFeatures + LANES - 1) / LANES * LANES;
+
+            alpha.assign(alphaMat.ptr<float>(0), alphaMat.ptr<float>(0) + numVectors);
+            const int * idx = svIdx.ptr<int>(0);
+
+            // map each feature's range over the support vectors to [-1, 1]
+            offset.assign(stride, 0.0f);
+            scale.assign(stride, 0.0f);
+            scaleSq.assign(stride, 0.0f);
+            const float qMax = precision == PRECISION_INT8 ? 127.0f : 1.0f;
+            for (int j = 0; j < numFeatures; ++j) {
+                float lo = FLT_MAX, hi = -FLT_MAX;
+                for (int i = 0; i < numVectors; ++i) {
+                    const float v = sv.at<float>(idx[i], j);
+                    lo = std::min(lo, v);
+                    hi = std::max(hi, v);
+                }
+
+                const float halfRange = (hi - lo) * 0.5f;
+                offset[j] = (hi + lo) * 0.5f;
+                scale[j] = halfRange > 0.0f ? halfRange / qMax : 1.0f;
+                scaleSq[j] = scale[j] * scale[j];
+            }
+
+            vectors8.clear();
+            vectors16.clear();
+            if (precision == PRECISION_INT8) vectors8.assign((size_t)numVectors * stride, 0);
+            else vectors16.assign((size_t)numVectors * stride, 0);
+
+            for (int i = 0; i < numVectors; ++i) {
+                const float * row = sv.ptr<float>(idx[i]);
+                for (int j = 0; j < numFeatures; ++j) {
+                    const float q = (row[j] - offset[j]) / scale[j];
+                    if (precision == PRECISION_INT8) {
+                        vectors8[(size_t)i * stride + j] = (int8_t)std::max(-127.0f, std::min(127.0f, std::round(q)));
+                    }
+                    else {
+                        vectors16[(size_t)i * stride + j] = floatToHalf(q);
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        bool QuantizedSVM::isTrained() const
+        {
+            return numVectors > 0;
+        }
+
+        QuantizedSVM::Precision QuantizedSVM::getPrecision() const
+        {
+            return precision;
+        }
+
+        int QuantizedSVM::getNumFeatures() const
+        {
+            return numFeatures;
+        }
+
+        size_t QuantizedSVM::getModelBytes() const
+        {
+            return vectors8.size() * sizeof(int8_t) + vectors16.size() * sizeof(uint16_t) +
+                   (alpha.size() + offset.size() + scale.size() + scaleSq.size()) * sizeof(float);
+        }
+
+        void QuantizedSVM::decode(int i, float * buf) const
+        {
+            const uint16_t * row = &vectors16[(size_t)i * stride];
+            for (int j = 0; j < stride; ++j) {
+                buf[j] = halfToFloat(row[j]);
+            }
+        }
+
+        float QuantizedSVM::distanceSq(const float * x, int i) const
+        {
+            if (precision == PRECISION_FP16) {
+                cv::AutoBuffer<float> buf(stride);
+                decode(i, buf);
+                return weightedDistanceSq(x, buf, scaleSq.data(), stride);
+            }
+
+            const int8_t * row = &vectors8[(size_t)i * stride];
+            int j = 0;
+            float result = 0.0f;
+#if CV_SIMD128
+            cv::v_float32x4 acc = cv::v_setzero_f32();
+            for (; j <= stride - LANES; j += LANES) {
+                const cv::v_float32x4 q = cv::v_cvt_f32(cv::v_load_expand_q(reinterpret_cast<const schar *>(row + j)));
+                const cv::v_float32x4 d = cv::v_load(x + j) - q;
+                acc = acc + d * d * cv::v_load(scaleSq.data() + j);
+            }
+            result = cv::v_reduce_sum(acc);
+#endif
+            for (; j < stride; ++j) {
+                const float d = x[j] - row[j];
+                result += d * d * scaleSq[j];
+            }
+            return result;
+        }
+
+        float QuantizedSVM::dot(const float * x, int i) const
+        {
+            if (precision == PRECISION_FP16) {
+                cv::AutoBuffer<float> buf(stride);
+                decode(i, buf);
+                float result = 0.0f;
+                for (int j = 0; j < stride; ++j) result += x[j] * buf[j];
+                return result;
+            }
+
+            const int8_t * row = &vectors8[(size_t)i * stride];
+            int j = 0;
+            float result = 0.0f;
+#if CV_SIMD128
+            cv::v_float32x4 acc = cv::v_setzero_f32();
+            for (; j <= stride - LANES; j += LANES) {
+                const cv::v_float32x4 q = cv::v_cvt_f32(cv::v_load_expand_q(reinterpret_cast<const schar *>(row + j)));
+                acc = acc + cv::v_load(x + j) * q;
+            }
+            result = cv::v_reduce_sum(acc);
+#endif
+            for (; j < stride; ++j) {
+                result += x[j] * row[j];
+            }
+            return result;
+        }
+
+        float QuantizedSVM::predict(const cv::Mat & features) const
+        {
+            ASSERT(isTrained(), "QuantizedSVM: model is not trained");
+            ASSERT(features.type() == CV_32F && (int)features.total() >= numFeatures,
+                   "QuantizedSVM: features must be CV_32F with at least getNumFeatures() values");
+
+            const cv::Mat f = features.isContinuous() ? features : features.clone();
+            const float * in = f.ptr<float>(0);
+            cv::AutoBuffer<float> buf(stride);
+            float * x = buf;
+            float sum = -rho;
+
+            if (kernel == cv::ml::SVM::RBF) {
+                // normalize the sample like the support vectors, so distances are computed in quantized units
+                for (int j = 0; j < stride; ++j) {
+                    x[j] = j < numFeatures ? (in[j] - offset[j]) / scale[j] : 0.0f;
+                }
+                for (int i = 0; i < numVectors; ++i) {
+                    sum += alpha[i] * std::exp(-gamma * distanceSq(x, i));
+                }
+            }
+            else {
+                // x . (offset + scale * q) = x . offset + (x * scale) . q
+                float base = 0.0f;
+                for (int j = 0; j < stride; ++j) {
+                    x[j] = j < numFeatures ? in[j] * scale[j] : 0.0f;
+                    if (j < numFeatures) base += in[j] * offset[j];
+                }
+                for (int i = 0; i < numVectors; ++i) {
+                    sum += alpha[i] * (base + dot(x, i));
+                }
+            }
+
+            return sum;
+        }
+
+        QuantizedSVM::AccuracyReport QuantizedSVM::compare(const cv::Ptr<cv::ml::SVM> & svm,
+            const QuantizedSVM & quantized, const cv::Mat & samples)
+        {
+            typedef std::chrono::steady_clock Clock;
+            AccuracyReport report;
+            report.numSamples = samples.rows;
+            report.quantizedBytes = quantized.getModelBytes();
+
+            cv::Mat alphaMat, svIdx;
+            svm->getDecisionFunction(0, alphaMat, svIdx);
+            report.floatBytes = svm->getSupportVectors().total() * sizeof(float) + alphaMat.total() * alphaMat.elemSize();
+
+            std::vector<float> floatResults(samples.rows), quantizedResults(samples.rows);
+
+            Clock::time_point start = Clock::now();
+            for (int i = 0; i < samples.rows; ++i) {
+                floatResults[i] = svm->predict(samples.row(i));
+            }
+            report.floatMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+            start = Clock::now();
+            for (int i = 0; i < samples.rows; ++i) {
+                quantizedResults[i] = quantized.predict(samples.row(i));
+            }
+            report.quantizedMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+            for (int i = 0; i < samples.rows; ++i) {
+                const double err = std::abs(floatResults[i] - quantizedResults[i]);
+                report.meanAbsError += err;
+                report.maxAbsError = std::max(report.maxAbsError, err);
+                if ((floatResults[i] > 0.5f) == (quantizedResults[i] > 0.5f)) ++report.numAgree;
+            }
+            if (samples.rows > 0) report.meanAbsError /= samples.rows;
+
+            return report;
+        }
+    }
+}
@@ -3,6 +3,11 @@
 #include "RGBCamera.h"
 
 namespace ark {
+    RGBCamera::~RGBCamera()
+    {
+        endCapture();
+    }
+
     void RGBCamera::update()
     {
     }
@@ -13,6 +18,106 @@ namespace ark {
     ***/
     cv::Mat RGBCamera::getFrame() const
     {
+        if (isCapturing()) return getLatestFrame().image;
         return frame;
     }
+
+    void RGBCamera::beginCapture(int ring_size, const ThreadConfig & config)
+    {
+        ASSERT(!isCapturing(), "beginCapture: already capturing from this camera");
+        ASSERT(ring_size > 0, "beginCapture: ring size must be positive");
+
+        {
+            std::lock_guard<std::mutex> lock(ringMutex);
+            ring.clear();
+            ringSize = (size_t)ring_size;
+            frameIndex = 0;
+        }
+
+        capturing = true;
+        captureThread = config.launch(std::bind(&RGBCamera::captureLoop, this));
+    }
+
+    void RGBCamera::endCapture()
+    {
+        capturing = false;
+        if (captureThread.joinable()) captureThread.join();
+    }
+
+    bool RGBCamera::isCapturing() const
+    {
+        return capturing;
+    }
+
+    RGBCamera::Frame RGBCamera::getLatestFrame() const
+    {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        if (ring.empty()) return Frame();
+        return ring.back();
+    }
+
+    bool RGBCamera::getFrameNear(Clock::time_point time, double tolerance_ms,
+                                 Frame & frame, double * skew_ms) const
+    {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        if (ring.empty()) return false;
+
+        const Frame * best = nullptr;
+        double bestSkew = 0.0;
+        for (const Frame & f : ring) {
+            const double skew = std::chrono::duration<double, std::milli>(f.timestamp - time).count();
+            if (best == nullptr || std::abs(skew) < std::abs(bestSkew)) {
+                best = &f;
+                bestSkew = skew;
+            }
+        }
+
+        if (std::abs(bestSkew) > tolerance_ms) return false;
+
+        frame = *best;
+        if (skew_ms) *skew_ms = bestSkew;
+        return true;
+    }
+
+    bool RGBCamera::hasFrameAfter(Clock::time_point time) const
+    {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        return !ring.empty() && ring.back().timestamp >= time;
+    }
+
+    void RGBCamera::captureLoop()
+    {
+        while (capturing) {
+            frameTime = Clock::time_point();
+            update();
+
+            if (frame.empty()) {
+                // no frame available (e.g. device unplugged): don't spin
+                boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+                continue;
+            }
+
+            Frame captured;
+            captured.timestamp = frameTime == Clock::time_point() ? Clock::now() : frameTime;
+
+            {
+                std::lock_guard<std::mutex> lock(ringMutex);
+                captured.index = frameIndex++;
+
+                // hand the frame over to the ring, and recycle the evicted frame's buffer
+                // for the next read if no one else holds on to it
+                cv::Mat recycled;
+                if (ring.size() >= ringSize) {
+                    recycled = ring.front().image;
+                    ring.pop_front();
+                }
+
+                captured.image = frame;
+                ring.push_back(captured);
+
+                frame = cv::Mat();
+                if (recycled.u && recycled.u->refcount == 1) frame = recycled;
+            }
+        }
+    }
 }
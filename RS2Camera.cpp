@@ -9,21 +9,64 @@
 
 /** RealSense SDK2 Cross-Platform Depth Camera Backend **/
 namespace ark {
-    RS2Camera::RS2Camera(bool use_rgb_stream) : align(RS2_STREAM_COLOR), useRGBStream(use_rgb_stream) {
+    namespace {
+        /** find a video stream profile of a device, whether or not the stream is enabled */
+        rs2::stream_profile findProfile(const rs2::device & dev, rs2_stream stream, rs2_format format,
+                                        int width, int height) {
+            for (const rs2::sensor & sensor : dev.query_sensors()) {
+                for (const rs2::stream_profile & prof : sensor.get_stream_profiles()) {
+                    if (prof.stream_type() != stream || prof.format() != format ||
+                        !prof.is<rs2::video_stream_profile>()) continue;
+
+                    const rs2::video_stream_profile vprof = prof.as<rs2::video_stream_profile>();
+                    if (vprof.width() == width && vprof.height() == height) return prof;
+                }
+            }
+            return rs2::stream_profile();
+        }
+    }
+
+    RS2Camera::RS2Camera(bool use_rgb_stream, int decimation, float min_depth, float max_depth)
+        : align(RS2_STREAM_COLOR), minDepth(min_depth), maxDepth(max_depth),
+          decimation(std::max(1, decimation)), useRGBStream(use_rgb_stream) {
+        if (this->decimation > 1) {
+            decimationFilter.set_option(RS2_OPTION_FILTER_MAGNITUDE, (float)this->decimation);
+        }
+
         pipe = std::make_shared<rs2::pipeline>();
 
-        query_intrinsics();
+        const bool found = query_intrinsics();
+        ASSERT(found, "FATAL: No camera with a depth stream detected.");
         badInputFlag = false;
-        rs2::pipeline_profile profile = pipe->start(config);
-
-        // get updated intrinsics
         rgbIntrinsics = new rs2_intrinsics();
         d2rExtrinsics = new rs2_extrinsics();
-        const std::vector<rs2::stream_profile> & stream_profiles = profile.get_streams();
+    }
+
+    void RS2Camera::start_pipeline() {
+        config.disable_all_streams();
+        config.enable_stream(RS2_STREAM_DEPTH, sensorWidth, sensorHeight, RS2_FORMAT_Z16);
+
+        // only stream RGB/IR images if someone is subscribed to them
+        imageStreamEnabled = isChannelInFrame(useRGBStream ? CHANNEL_RGB : CHANNEL_IR);
+        if (imageStreamEnabled) {
+            if (useRGBStream) config.enable_stream(RS2_STREAM_COLOR, sensorWidth, sensorHeight, RS2_FORMAT_BGR8);
+            else config.enable_stream(RS2_STREAM_INFRARED, sensorWidth, sensorHeight, RS2_FORMAT_Y8);
+        }
+
+        rs2::pipeline_profile profile = pipe->start(config);
+        pipelineStarted = true;
 
+        // get updated intrinsics
+        // (points are projected onto the RGB/IR pixel grid even if that stream is disabled)
+        const rs2_stream imageStream = useRGBStream ? RS2_STREAM_COLOR : RS2_STREAM_INFRARED;
         rs2::stream_profile rgbProfile;
-        if (useRGBStream) rgbProfile = profile.get_stream(RS2_STREAM_COLOR);
-        else rgbProfile = profile.get_stream(RS2_STREAM_INFRARED);
+        if (imageStreamEnabled) {
+            rgbProfile = profile.get_stream(imageStream);
+        }
+        else {
+            rgbProfile = findProfile(profile.get_device(), imageStream,
+                useRGBStream ? RS2_FORMAT_BGR8 : RS2_FORMAT_Y8, sensorWidth, sensorHeight);
+        }
 
         rs2::stream_profile depthProfile = profile.get_stream(RS2_STREAM_DEPTH);
         *reinterpret_cast<rs2_intrinsics *>(rgbIntrinsics) =
@@ -32,6 +75,18 @@ namespace ark {
             depthProfile.as<rs2::video_stream_profile>().get_intrinsics();
         *reinterpret_cast<rs2_extrinsics *>(d2rExtrinsics) = depthProfile.get_extrinsics_to(rgbProfile);
         scale = profile.get_device().first<rs2::depth_sensor>().get_depth_scale();
+
+        if (decimation > 1) {
+            // project onto the output grid: the IR/RGB pixel grid reduced by the decimation factor
+            rs2_intrinsics & rIntrin = *reinterpret_cast<rs2_intrinsics *>(rgbIntrinsics);
+            const float inv = 1.0f / decimation;
+            rIntrin.fx *= inv;
+            rIntrin.fy *= inv;
+            rIntrin.ppx = (rIntrin.ppx + 0.5f) * inv - 0.5f;
+            rIntrin.ppy = (rIntrin.ppy + 0.5f) * inv - 0.5f;
+            rIntrin.width = width;
+            rIntrin.height = height;
+        }
     }
 
     RS2Camera::~RS2Camera() {
@@ -65,37 +120,133 @@ namespace ark {
         return !useRGBStream;
     }
 
+    void RS2Camera::setDepthRange(float min_depth, float max_depth) {
+        std::lock_guard<std::mutex> lock(depthRangeMutex);
+        minDepth = min_depth;
+        maxDepth = max_depth;
+    }
+
+    int RS2Camera::getDecimation() const {
+        return decimation;
+    }
+
+    void RS2Camera::copyImage(const rs2::frame & frame, cv::Mat & image, int type) {
+        const cv::Mat src(sensorHeight, sensorWidth, type, const_cast<void *>(frame.get_data()));
+        if (decimation > 1) {
+            cv::resize(src, image, image.size(), 0.0, 0.0, cv::INTER_AREA);
+        }
+        else {
+            src.copyTo(image);
+        }
+    }
+
     void RS2Camera::update(cv::Mat & xyz_map, cv::Mat & rgb_map, cv::Mat & ir_map, 
             cv::Mat & amp_map, cv::Mat & flag_map) {
         rs2::frameset data;
 
         try {
+            if (!pipelineStarted) start_pipeline();
             data = pipe->wait_for_frames();
+            const auto arrival = std::chrono::steady_clock::now();
+            const auto arrivalSystem = std::chrono::system_clock::now();
 
-            if (useRGBStream) {
-                rs2::frame color = data.first(RS2_STREAM_COLOR);
-                memcpy(rgb_map.data, color.get_data(), 3 * width * height);
+            // the stream may still be disabled if restarting the pipeline for a new subscription failed
+            if (isChannelInFrame(CHANNEL_RGB)) {
+                if (imageStreamEnabled) copyImage(data.first(RS2_STREAM_COLOR), rgb_map, CV_8UC3);
+                else rgb_map.setTo(0);
             }
-            else {
-                rs2::frame ir = data.first(RS2_STREAM_INFRARED);
-                memcpy(ir_map.data, ir.get_data(), width * height);
+            else if (isChannelInFrame(CHANNEL_IR)) {
+                if (imageStreamEnabled) copyImage(data.first(RS2_STREAM_INFRARED), ir_map, CV_8UC1);
+                else ir_map.setTo(0);
+            }
+
+            // filter the raw depth frame, so that decimated-away and out of range pixels never reach project()
+            rs2::frame depth = data.first(RS2_STREAM_DEPTH);
+            setFrameTime(captureTime(depth, arrival, arrivalSystem));
+            if (decimation > 1) depth = decimationFilter.process(depth);
+
+            float minD, maxD;
+            {
+                std::lock_guard<std::mutex> lock(depthRangeMutex);
+                minD = minDepth;
+                maxD = maxDepth;
+            }
+            if (minD > 0.0f || maxD > 0.0f) {
+                if (minD != appliedMinDepth || maxD != appliedMaxDepth) {
+                    thresholdFilter.set_option(RS2_OPTION_MIN_DISTANCE, std::max(0.0f, minD));
+                    thresholdFilter.set_option(RS2_OPTION_MAX_DISTANCE,
+                        maxD > 0.0f ? maxD : thresholdFilter.get_option_range(RS2_OPTION_MAX_DISTANCE).max);
+                    appliedMinDepth = minD;
+                    appliedMaxDepth = maxD;
+                }
+                depth = thresholdFilter.process(depth);
             }
 
-            rs2::frame depth = data.first(RS2_STREAM_DEPTH); 
             project(depth, xyz_map);
-        } catch (std::runtime_error e) {
-            // try reconnecting
+        } catch (const std::exception & e) {
+            // restart the pipeline before the next frame (with backoff)
+            printf("Couldn't get frames from camera: %s\n", e.what());
             badInputFlag = true;
-            pipe->stop();
-            printf("Couldn't connect to camera, retrying in 0.5s...\n");
-            boost::this_thread::sleep_for(boost::chrono::milliseconds(500));
-            query_intrinsics();
-            pipe->start(config);
-            badInputFlag = false;
+            requestReconnect();
             return;
         }
+    }
+
+    std::chrono::steady_clock::time_point RS2Camera::captureTime(const rs2::frame & frame,
+            std::chrono::steady_clock::time_point arrival, std::chrono::system_clock::time_point arrival_system) {
+        typedef std::chrono::duration<double, std::milli> Millis;
+        const double timestamp = frame.get_timestamp();
+        double delay;
+
+        if (frame.get_frame_timestamp_domain() == RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK) {
+            // the device clock has an unknown origin: assume the fastest frame so far arrived without delay
+            const double offset = Millis(arrival.time_since_epoch()).count() - timestamp;
+            if (lastHardwareTimestamp < 0.0 || timestamp < lastHardwareTimestamp) {
+                hardwareClockOffset = offset;
+            }
+            else {
+                hardwareClockOffset = std::min(hardwareClockOffset, offset);
+            }
+            lastHardwareTimestamp = timestamp;
+            delay = offset - hardwareClockOffset;
+        }
+        else {
+            // system time or global time: milliseconds since the epoch of the system clock
+            delay = Millis(arrival_system.time_since_epoch()).count() - timestamp;
+        }
+
+        delay = std::max(0.0, delay);
+        return arrival - std::chrono::duration_cast<std::chrono::steady_clock::duration>(Millis(delay));
+    }
 
+    void RS2Camera::onChannelsChanged() {
+        // restart the pipeline to enable or disable the RGB/IR stream
+        // (if it is not started yet, the first update() starts it with the right streams)
+        if (!pipelineStarted) return;
+        const bool wanted = isChannelInFrame(useRGBStream ? CHANNEL_RGB : CHANNEL_IR);
+        if (wanted == imageStreamEnabled) return;
 
+        printf("%s %s stream\n", wanted ? "Enabling" : "Disabling", useRGBStream ? "RGB" : "IR");
+        if (!reconnect()) requestReconnect();
+    }
+
+    bool RS2Camera::reconnect() {
+        try {
+            pipe->stop();
+        } catch (...) {}
+        pipelineStarted = false;
+        lastHardwareTimestamp = -1.0;
+
+        try {
+            if (!query_intrinsics()) return false;
+            start_pipeline();
+        } catch (const std::exception & e) {
+            printf("Couldn't restart camera: %s\n", e.what());
+            return false;
+        }
+
+        badInputFlag = false;
+        return true;
     }
 
     void RS2Camera::project(const rs2::frame depth_frame, cv::Mat & xyz_map) {
@@ -103,6 +254,16 @@ namespace ark {
 
         if (!depthIntrinsics || !rgbIntrinsics || !d2rExtrinsics) return;
         rs2_intrinsics * dIntrin = reinterpret_cast<rs2_intrinsics *>(depthIntrinsics);
+
+        // decimated frames have their own (reduced) intrinsics
+        rs2_intrinsics decimatedIntrin;
+        if (decimation > 1) {
+            decimatedIntrin = depth_frame.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+            dIntrin = &decimatedIntrin;
+        }
+        const rs2::video_frame depthVideo = depth_frame.as<rs2::video_frame>();
+        const int depthWidth = depthVideo.get_width(), depthHeight = depthVideo.get_height();
+        const int depthStride = depthVideo.get_stride_in_bytes() / (int)sizeof(uint16_t);
         rs2_intrinsics * rIntrin = reinterpret_cast<rs2_intrinsics *>(rgbIntrinsics);
         rs2_extrinsics * drExtrin = reinterpret_cast<rs2_extrinsics *>(d2rExtrinsics);
 
@@ -114,14 +275,14 @@ namespace ark {
 
         cv::Vec3f * destPtr;
 
-        for (int r = 0; r < height; ++r)
+        for (int r = 0; r < depthHeight; ++r)
         {
-            srcPtr = depth_data + r * dIntrin->width;
+            srcPtr = depth_data + r * depthStride;
             srcPixel[1] = (float) r;
             srcPixelTL[1] = (float) r - 0.5f;
             srcPixelBR[1] = (float) r + 0.5f;
 
-            for (int c = 0; c < width; ++c)
+            for (int c = 0; c < depthWidth; ++c)
             {
                 if (srcPtr[c] == 0) continue;
 
@@ -159,16 +320,22 @@ namespace ark {
         }
     }
 
-    void RS2Camera::query_intrinsics() {
-        rs2_intrinsics * depthIntrinsics = new rs2_intrinsics();
-
+    bool RS2Camera::query_intrinsics() {
         rs2::context ctx;
         rs2::device_list list = ctx.query_devices();
 
-        ASSERT(list.size() > 0, "No camera detected.");
+        if (list.size() == 0) {
+            printf("No camera detected.\n");
+            return false;
+        }
         const rs2::device & dev = list.front();
         const std::vector<rs2::sensor> sensors = dev.query_sensors();
 
+        // reuse the intrinsics storage when reconnecting
+        if (!this->depthIntrinsics) this->depthIntrinsics = new rs2_intrinsics();
+        rs2_intrinsics * depthIntrinsics = reinterpret_cast<rs2_intrinsics *>(this->depthIntrinsics);
+        bool found = false;
+
         for (unsigned i = 0; i < sensors.size(); ++i) {
             const rs2::sensor & sensor = sensors[i];
             const std::vector<rs2::stream_profile> & stream_profiles = sensor.get_stream_profiles();
@@ -182,20 +349,23 @@ namespace ark {
                     if (stream_data_type == RS2_STREAM_DEPTH && stream_format == RS2_FORMAT_Z16) {
                         const rs2::video_stream_profile & prof = stream_profile.as<rs2::video_stream_profile>();
                         *depthIntrinsics = prof.get_intrinsics();
-                        this->depthIntrinsics = depthIntrinsics;
+                        found = true;
                         break;
                     }
                 }
             }
-            if (this->depthIntrinsics) break;
+            if (found) break;
         }
 
-        ASSERT(this->depthIntrinsics, "FATAL: Camera has no depth stream!");
-        width = depthIntrinsics->width;
-        height = depthIntrinsics->height;
+        if (!found) {
+            printf("Camera has no depth stream!\n");
+            return false;
+        }
 
-        config.enable_stream(RS2_STREAM_DEPTH, width, height, RS2_FORMAT_Z16);
-        if (useRGBStream) config.enable_stream(RS2_STREAM_COLOR, width, height, RS2_FORMAT_BGR8);
-        else config.enable_stream(RS2_STREAM_INFRARED, width, height, RS2_FORMAT_Y8);
+        sensorWidth = depthIntrinsics->width;
+        sensorHeight = depthIntrinsics->height;
+        width = sensorWidth / decimation;
+        height = sensorHeight / decimation;
+        return true;
     }
 }
@@ -82,8 +82,8 @@ namespace ark {
             {
                 wprintf_s(L"Stream configuration was changed, re-initializing\n");
                 sm->ReleaseFrame();
-                sm->Close();
                 badInputFlag = true;
+                requestReconnect();
                 return;
             }
         }
@@ -91,11 +91,11 @@ namespace ark {
         sample = sm->QuerySample();
 
         if (!sample || sample->depth == nullptr) {
-            wprintf_s(L"Couldn't connect to camera, retrying in 0.5s...\n");
-            sm->ReleaseFrame(); sm->Close();
+            // restart the pipeline before the next frame (with backoff)
+            wprintf_s(L"Couldn't connect to camera, reconnecting...\n");
+            sm->ReleaseFrame();
             badInputFlag = true;
-            boost::this_thread::sleep_for(boost::chrono::milliseconds(500));
-            initCamera();
+            requestReconnect();
             return;
         }
 
@@ -146,10 +146,12 @@ namespace ark {
 
             projection->Release();
 
-            // convert IR image
-            cv::Mat rgbTmp;
-            Converter::ConvertPXCImageToOpenCVMat(rgbSource, rgbImage, &rgbTmp);
-            rgb_map = rgbTmp(cv::Rect(0, 0, getWidth(), getHeight()));
+            // convert RGB image (the color stream itself is needed for registration)
+            if (isChannelInFrame(CHANNEL_RGB)) {
+                cv::Mat rgbTmp;
+                Converter::ConvertPXCImageToOpenCVMat(rgbSource, rgbImage, &rgbTmp);
+                rgb_map = rgbTmp(cv::Rect(0, 0, getWidth(), getHeight()));
+            }
 
             // release access
             depthAlign->ReleaseAccess(&depthImage);
@@ -176,8 +178,11 @@ namespace ark {
 
             Point3DF32 * pos3D = new Point3DF32[num_pixels];
 
+            // the IR stream is only enabled if someone is subscribed to it
+            const bool convertIR = irSource != nullptr && isChannelInFrame(CHANNEL_IR);
+
             depthSource->AcquireAccess(Image::ACCESS_READ, Image::PixelFormat::PIXEL_FORMAT_DEPTH_F32, &depthImage);
-            irSource->AcquireAccess(Image::ACCESS_READ, Image::PixelFormat::PIXEL_FORMAT_Y8, &irImage);
+            if (convertIR) irSource->AcquireAccess(Image::ACCESS_READ, Image::PixelFormat::PIXEL_FORMAT_Y8, &irImage);
             sts = projection->QueryVertices(depthSource, &pos3D[0]);
 
             if (sts < Status::STATUS_NO_ERROR)
@@ -191,13 +196,19 @@ namespace ark {
             projection->Release();
 
             // convert IR image
-            cv::Mat irTmp;
-            Converter::ConvertPXCImageToOpenCVMat(irSource, irImage, &irTmp);
-            ir_map = irTmp(cv::Rect(0, 0, getWidth(), getHeight()));
+            if (convertIR) {
+                cv::Mat irTmp;
+                Converter::ConvertPXCImageToOpenCVMat(irSource, irImage, &irTmp);
+                ir_map = irTmp(cv::Rect(0, 0, getWidth(), getHeight()));
+            }
+            else if (isChannelInFrame(CHANNEL_IR)) {
+                // subscribed, but the stream is not enabled yet
+                ir_map.setTo(0);
+            }
 
             // release access
             depthSource->ReleaseAccess(&depthImage);
-            irSource->ReleaseAccess(&irImage);
+            if (convertIR) irSource->ReleaseAccess(&irImage);
 
             // convert point cloud
             int k = 0, wid = getWidth();
@@ -247,17 +258,38 @@ namespace ark {
         return dists[flat + 2];
     }
 
+    void SR300Camera::onChannelsChanged() {
+        // reinitialize the pipeline to enable or disable the IR stream
+        if (useRGBStream || isChannelInFrame(CHANNEL_IR) == irStreamEnabled) return;
+        if (!reconnect()) requestReconnect();
+    }
+
+    bool SR300Camera::reconnect() {
+        if (!sm) return false;
+        sm->Close();
+        if (!initCamera()) return false;
+
+        badInputFlag = false;
+        return true;
+    }
+
     // Initialize camera (helper)
-    void SR300Camera::initCamera() {
-        if (!sm) return;
+    bool SR300Camera::initCamera() {
+        if (!sm) return false;
         cm = sm->QueryCaptureManager();
         auto sts = Status::STATUS_DATA_UNAVAILABLE;
 
         sm->EnableStream(Capture::STREAM_TYPE_DEPTH, REAL_WID, REAL_HI, depth_fps);
-        sm->EnableStream(useRGBStream ? Capture::STREAM_TYPE_COLOR : Capture::STREAM_TYPE_IR,
-                         REAL_WID, REAL_HI, depth_fps);
+
+        // the color stream is always needed to register depth to it; the IR stream only if subscribed
+        irStreamEnabled = !useRGBStream && isChannelInFrame(CHANNEL_IR);
+        if (useRGBStream || irStreamEnabled) {
+            sm->EnableStream(useRGBStream ? Capture::STREAM_TYPE_COLOR : Capture::STREAM_TYPE_IR,
+                             REAL_WID, REAL_HI, depth_fps);
+        }
 
         sts = sm->Init();
         device = cm->QueryDevice();
+        return sts >= Status::STATUS_NO_ERROR;
     }
 }
@@ -0,0 +1,188 @@
+#include "stdafx.h"
+#include "Version.h"
+#include "StreamingHandClassifier.h"
+#include "Util.h"
+
+namespace ark {
+    namespace classifier {
+        StreamingHandClassifier::StreamingHandClassifier(const SVMHandClassifier & classifier)
+            : StreamingHandClassifier(classifier, Config()) { }
+
+        StreamingHandClassifier::StreamingHandClassifier(const SVMHandClassifier & classifier, const Config & config)
+            : classifier(classifier), config(config)
+        {
+            this->config.voteFrames = std::max(this->config.voteFrames, 1);
+            this->config.minVotes = std::min(std::max(this->config.minVotes, 1), this->config.voteFrames);
+        }
+
+        std::vector<StreamingHandClassifier::Result> StreamingHandClassifier::update(const std::vector<Hand::Ptr> & hands)
+        {
+            std::vector<Vec3f> palms, trackPalms;
+            for (const Hand::Ptr & hand : hands) palms.push_back(hand->getPalmCenter());
+            for (const Track & track : tracks) trackPalms.push_back(track.palm);
+            const std::vector<int> handTrack = util::matchNearest(palms, trackPalms, config.maxHandDistance);
+
+            std::vector<char> trackSeen(tracks.size(), 0);
+            std::vector<int> resultTracks(hands.size());
+            std::vector<char> classified(hands.size(), 0);
+            std::vector<float> signature;
+
+            for (int i = 0; i < (int)hands.size(); ++i) {
+                Hand & hand = *hands[i];
+                const int numFingers = hand.getNumFingers();
+                computeSignature(hand.getContour(), signature);
+                ++stats.numHands;
+
+                if (handTrack[i] < 0) {
+                    Track track;
+                    track.id = nextTrackId++;
+                    track.palm = palms[i];
+                    tracks.push_back(track);
+                    trackSeen.push_back(1);
+
+                    ++stats.numNewTracks;
+                    classified[i] = classify(tracks.back(), hand, numFingers, signature, true);
+                    resultTracks[i] = (int)tracks.size() - 1;
+                    continue;
+                }
+
+                Track & track = tracks[handTrack[i]];
+                trackSeen[handTrack[i]] = 1;
+                track.palm = palms[i];
+                track.missed = 0;
+                resultTracks[i] = handTrack[i];
+
+                // compare with the geometry at the last classification, so that slow drift also adds up
+                const bool fingersChanged = numFingers != track.classifiedFingers;
+                const bool palmMoved = util::euclideanDistance(palms[i], track.classifiedPalm) > config.palmMoveThreshold;
+                float signatureChange = 0.0f;
+                for (int b = 0; b < SIGNATURE_BINS; ++b) {
+                    signatureChange += std::abs(signature[b] - track.classifiedSignature[b]);
+                }
+                const bool contourChanged = signatureChange / SIGNATURE_BINS > config.signatureThreshold;
+                const bool refresh = track.framesSkipped >= config.maxSkipFrames;
+
+                if (fingersChanged) ++stats.numFingerChanges;
+                if (palmMoved) ++stats.numPalmMoves;
+                if (contourChanged) ++stats.numContourChanges;
+
+                if (fingersChanged || palmMoved || contourChanged || refresh) {
+                    if (refresh && !(fingersChanged || palmMoved || contourChanged)) ++stats.numRefreshes;
+                    // a periodic refresh is not a change of gesture, so it only adds a vote
+                    classified[i] = classify(track, hand, numFingers, signature, fingersChanged || contourChanged);
+                }
+                else {
+                    // unchanged geometry: repeat the last vote
+                    ++track.framesSkipped;
+                    ++stats.numSkipped;
+                    track.votes.push_back(track.lastOutput);
+                    if ((int)track.votes.size() > config.voteFrames) track.votes.pop_front();
+                    updateLabel(track);
+                }
+            }
+
+            std::vector<Result> results(hands.size());
+            for (int i = 0; i < (int)hands.size(); ++i) {
+                const Track & track = tracks[resultTracks[i]];
+                Result & result = results[i];
+                result.trackId = track.id;
+                result.label = track.label;
+                result.classified = classified[i] != 0;
+
+                float sum = 0.0f;
+                for (float vote : track.votes) sum += vote;
+                result.confidence = track.votes.empty() ? 0.0f : sum / track.votes.size();
+            }
+
+            // drop hands that went undetected for too long
+            for (int t = (int)tracks.size() - 1; t >= 0; --t) {
+                if (!trackSeen[t] && ++tracks[t].missed > config.maxMissedFrames) {
+                    tracks.erase(tracks.begin() + t);
+                }
+            }
+
+            return results;
+        }
+
+        void StreamingHandClassifier::reset()
+        {
+            tracks.clear();
+        }
+
+        const StreamingHandClassifier::Stats & StreamingHandClassifier::getStats() const
+        {
+            return stats;
+        }
+
+        bool StreamingHandClassifier::classify(Track & track, Hand & hand, int num_fingers,
+                                               std::vector<float> & signature, bool allow_reset)
+        {
+            // the classifier has no SVM for hands without fingers: vote negative without running it
+            const bool run = num_fingers > 0;
+            const float output = run ? classifier.classify(hand, hand.getDepthMap()) : 0.0f;
+            if (run) ++stats.numClassified;
+            else ++stats.numSkipped;
+
+            track.lastOutput = output;
+            track.classifiedPalm = hand.getPalmCenter();
+            track.classifiedFingers = num_fingers;
+            track.classifiedSignature.swap(signature);
+            track.framesSkipped = 0;
+
+            if (allow_reset && std::abs(output - config.threshold) >= config.confidentMargin) {
+                // confident result for a new geometry: report it right away
+                track.votes.assign(config.minVotes, output);
+            }
+            else {
+                track.votes.push_back(output);
+                if ((int)track.votes.size() > config.voteFrames) track.votes.pop_front();
+            }
+            updateLabel(track);
+            return run;
+        }
+
+        void StreamingHandClassifier::updateLabel(Track & track)
+        {
+            int positive = 0;
+            for (float vote : track.votes) {
+                if (vote >= config.threshold) ++positive;
+            }
+            const int negative = (int)track.votes.size() - positive;
+
+            int label = track.label;
+            if (positive >= config.minVotes && positive > negative) label = 1;
+            else if (negative >= config.minVotes && negative > positive) label = 0;
+            else if (track.label < 0) label = -1;
+
+            if (label != track.label && track.label >= 0) ++stats.numLabelChanges;
+            track.label = label;
+        }
+
+        void StreamingHandClassifier::computeSignature(const std::vector<Point2i> & contour,
+                                                       std::vector<float> & signature)
+        {
+            signature.assign(SIGNATURE_BINS, 0.0f);
+            if (contour.empty()) return;
+
+            Point2f centroid(0.0f, 0.0f);
+            for (const Point2i & pt : contour) centroid += Point2f(pt);
+            centroid /= (float)contour.size();
+
+            // farthest contour point in each direction
+            for (const Point2i & pt : contour) {
+                const Point2f d = Point2f(pt) - centroid;
+                const double angle = util::pointToAngle(d);
+                int bin = (int)(angle / (2.0 * PI) * SIGNATURE_BINS) % SIGNATURE_BINS;
+                if (bin < 0) bin += SIGNATURE_BINS;
+                signature[bin] = std::max(signature[bin], (float)util::magnitude(d));
+            }
+
+            // normalize by the mean radius, so that the signature does not change with distance
+            float mean = 0.0f;
+            for (float r : signature) mean += r;
+            mean /= SIGNATURE_BINS;
+            if (mean <= 0.0f) return;
+            for (float & r : signature) r /= mean;
+        }
+    }
+}
@@ -0,0 +1,204 @@
+#include "stdafx.h"
+#include "Version.h"
+#include "TemporalFilter.h"
+
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace ark {
+    TemporalFilter::TemporalFilter(Mode mode, float alpha, float reset_thresh, int window) :
+        mode(mode), alpha(alpha), resetThresh(reset_thresh)
+    {
+        ASSERT(alpha > 0.0f && alpha <= 1.0f, "TemporalFilter: alpha must be in (0, 1]");
+        // window must be odd so that the median is well-defined
+        this->window = std::max(1, std::min(window, MAX_WINDOW)) | 1;
+    }
+
+    void TemporalFilter::apply(cv::Mat & xyz_map)
+    {
+        ASSERT(xyz_map.type() == CV_32FC3, "TemporalFilter: XYZ map must be of type CV_32FC3");
+        if (xyz_map.empty()) return;
+
+        if (resetRequested.exchange(false)) {
+            state.release();
+            stateSize = cv::Size();
+        }
+        allocate(xyz_map.size());
+
+        if (mode == MEDIAN) {
+            applyMedian(xyz_map);
+        }
+        else {
+            applyExponential(xyz_map);
+        }
+    }
+
+    void TemporalFilter::reset()
+    {
+        resetRequested = true;
+    }
+
+    TemporalFilter::Mode TemporalFilter::getMode() const
+    {
+        return mode;
+    }
+
+    int TemporalFilter::getWindow() const
+    {
+        return window;
+    }
+
+    void TemporalFilter::allocate(cv::Size size)
+    {
+        if (size == stateSize && !state.empty()) return;
+
+        stateSize = size;
+        ringHead = ringFilled = 0;
+
+        if (mode == MEDIAN) {
+            state.create(size.height * window, size.width, CV_32F);
+        }
+        else {
+            state.create(size, CV_32F);
+        }
+        state.setTo(0.0f);
+    }
+
+    void TemporalFilter::applyExponential(cv::Mat & xyz_map)
+    {
+        const int rows = xyz_map.rows, cols = xyz_map.cols;
+
+        for (int r = 0; r < rows; ++r) {
+            float * ptr = xyz_map.ptr<float>(r);
+            float * st = state.ptr<float>(r);
+            int c = 0;
+
+#if CV_SIMD128
+            const cv::v_float32x4 vAlpha = cv::v_setall_f32(alpha);
+            const cv::v_float32x4 vThresh = cv::v_setall_f32(resetThresh);
+            const cv::v_float32x4 vZero = cv::v_setzero_f32();
+            const cv::v_float32x4 vTiny = cv::v_setall_f32(FLT_MIN);
+
+            for (; c <= cols - 4; c += 4) {
+                cv::v_float32x4 x, y, z;
+                cv::v_load_deinterleave(ptr + c * 3, x, y, z);
+                cv::v_float32x4 s = cv::v_load(st + c);
+
+                // reset where the depth jumps or where either the state or the input is empty
+                cv::v_float32x4 reset = (cv::v_absdiff(z, s) > vThresh) | (s == vZero) | (z == vZero);
+                s = cv::v_select(reset, z, s + (z - s) * vAlpha);
+                cv::v_store(st + c, s);
+
+                // slide the point along its ray to the filtered depth
+                cv::v_float32x4 scale = cv::v_select(z > vZero, s / cv::v_max(z, vTiny), vZero);
+                cv::v_store_interleave(ptr + c * 3, x * scale, y * scale, s);
+            }
+#endif
+
+            for (; c < cols; ++c) {
+                float * pt = ptr + c * 3;
+                const float z = pt[2];
+                float & s = st[c];
+
+                if (z == 0.0f || s == 0.0f || std::fabs(z - s) > resetThresh) {
+                    s = z;
+                }
+                else {
+                    s += (z - s) * alpha;
+                    const float scale = s / z;
+                    pt[0] *= scale;
+                    pt[1] *= scale;
+                    pt[2] = s;
+                }
+            }
+        }
+    }
+
+    void TemporalFilter::applyMedian(cv::Mat & xyz_map)
+    {
+        const int rows = xyz_map.rows, cols = xyz_map.cols;
+
+        // copy current depth into the ring
+        for (int r = 0; r < rows; ++r) {
+            const float * ptr = xyz_map.ptr<float>(r);
+            float * slot = state.ptr<float>(ringHead * rows + r);
+            for (int c = 0; c < cols; ++c) {
+                slot[c] = ptr[c * 3 + 2];
+            }
+        }
+
+        ringHead = (ringHead + 1) % window;
+        ringFilled = std::min(ringFilled + 1, window);
+
+        const int n = ringFilled;
+        const float * slots[MAX_WINDOW];
+
+        for (int r = 0; r < rows; ++r) {
+            float * ptr = xyz_map.ptr<float>(r);
+            for (int k = 0; k < n; ++k) {
+                slots[k] = state.ptr<float>(k * rows + r);
+            }
+
+            int c = 0;
+
+#if CV_SIMD128
+            const cv::v_float32x4 vZero = cv::v_setzero_f32();
+            const cv::v_float32x4 vTiny = cv::v_setall_f32(FLT_MIN);
+            const cv::v_int32x4 vN = cv::v_setall_s32(n);
+            cv::v_float32x4 v[MAX_WINDOW];
+
+            for (; c <= cols - 4; c += 4) {
+                // count the valid samples of each pixel (each mask lane is -1 where valid)
+                cv::v_int32x4 negCount = cv::v_setzero_s32();
+                for (int k = 0; k < n; ++k) {
+                    v[k] = cv::v_load(slots[k] + c);
+                    negCount += cv::v_reinterpret_as_s32(v[k] > vZero);
+                }
+
+                // odd-even transposition sorting network
+                for (int pass = 0; pass < n; ++pass) {
+                    for (int k = pass & 1; k + 1 < n; k += 2) {
+                        cv::v_float32x4 lo = cv::v_min(v[k], v[k + 1]);
+                        v[k + 1] = cv::v_max(v[k], v[k + 1]);
+                        v[k] = lo;
+                    }
+                }
+
+                // empty samples sort first, so the median of the valid ones is at
+                // (n - count) + count / 2
+                const cv::v_int32x4 count = cv::v_setzero_s32() - negCount;
+                const cv::v_int32x4 medIdx = vN - count + (count >> 1);
+                cv::v_float32x4 med = vZero;
+                for (int k = 0; k < n; ++k) {
+                    med = cv::v_select(cv::v_reinterpret_as_f32(medIdx == cv::v_setall_s32(k)), v[k], med);
+                }
+
+                cv::v_float32x4 x, y, z;
+                cv::v_load_deinterleave(ptr + c * 3, x, y, z);
+                cv::v_float32x4 valid = z > vZero;
+                med = cv::v_select(valid, med, vZero);
+                cv::v_float32x4 scale = cv::v_select(valid, med / cv::v_max(z, vTiny), vZero);
+                cv::v_store_interleave(ptr + c * 3, x * scale, y * scale, med);
+            }
+#endif
+
+            float vals[MAX_WINDOW];
+            for (; c < cols; ++c) {
+                float * pt = ptr + c * 3;
+                if (pt[2] == 0.0f) continue;
+
+                // only valid samples count; the current one is valid, so there is at least one
+                int count = 0;
+                for (int k = 0; k < n; ++k) {
+                    if (slots[k][c] > 0.0f) vals[count++] = slots[k][c];
+                }
+                const int med = count / 2;
+                std::nth_element(vals, vals + med, vals + count);
+
+                const float scale = vals[med] / pt[2];
+                pt[0] *= scale;
+                pt[1] *= scale;
+                pt[2] = vals[med];
+            }
+        }
+    }
+}
@@ -0,0 +1,255 @@
+#include "stdafx.h"
+#include "Version.h"
+#include "ThreadConfig.h"
+
+#if defined(_WIN32)
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   include <windows.h>
+#elif defined(__linux__)
+#   include <pthread.h>
+#   include <sched.h>
+#   include <unistd.h>
+#   include <cerrno>
+#   include <sys/resource.h>
+#   include <sys/syscall.h>
+#endif
+
+namespace ark {
+    namespace {
+        /** last configuration that took effect on this thread, for settings the OS cannot report */
+        thread_local ThreadConfig appliedConfig;
+
+#if defined(_WIN32)
+        typedef HRESULT (WINAPI * SetThreadDescriptionFn)(HANDLE, PCWSTR);
+
+        /** set the thread name; SetThreadDescription is only available on Windows 10 1607+ */
+        bool setThreadName(const std::string & name)
+        {
+            static SetThreadDescriptionFn fn = (SetThreadDescriptionFn)
+                GetProcAddress(GetModuleHandleA("kernel32.dll"), "SetThreadDescription");
+            if (fn == nullptr) return false;
+
+            std::wstring wname(name.begin(), name.end());
+            return SUCCEEDED(fn(GetCurrentThread(), wname.c_str()));
+        }
+#endif
+    }
+
+    ThreadConfig::ThreadConfig() { }
+
+    ThreadConfig::ThreadConfig(const std::string & name) : name(name) { }
+
+    bool ThreadConfig::applyToCurrentThread(ThreadConfig * effective) const
+    {
+        ThreadConfig result = current();
+        result.stackSize = stackSize;
+        bool ok = true;
+
+#if defined(_WIN32)
+        HANDLE thread = GetCurrentThread();
+
+        if (!name.empty()) {
+            if (setThreadName(name)) result.name = name;
+            else ok = false;
+        }
+
+        if (!affinity.empty()) {
+            DWORD_PTR mask = 0;
+            for (int cpu : affinity) {
+                if (cpu >= 0 && cpu < (int)(sizeof(DWORD_PTR) * 8)) mask |= (DWORD_PTR)1 << cpu;
+            }
+            if (mask != 0 && SetThreadAffinityMask(thread, mask) != 0) {
+                result.affinity = affinity;
+            }
+            else {
+                std::cerr << "ThreadConfig: could not set CPU affinity of thread '" << name << "'\n";
+                ok = false;
+            }
+        }
+
+        int winPriority;
+        if (policy != POLICY_DEFAULT) {
+            winPriority = THREAD_PRIORITY_TIME_CRITICAL;
+        }
+        else {
+            // map niceness onto the five normal Windows priority levels
+            winPriority = std::max(-2, std::min(2, -priority / 5));
+        }
+
+        if (SetThreadPriority(thread, winPriority)) {
+            result.policy = policy;
+            result.priority = priority;
+        }
+        else {
+            std::cerr << "ThreadConfig: could not set priority of thread '" << name << "'\n";
+            ok = false;
+        }
+
+#elif defined(__linux__)
+        pthread_t thread = pthread_self();
+
+        if (!name.empty()) {
+            // Linux thread names are limited to 16 bytes including the terminator
+            std::string shortName = name.substr(0, 15);
+            if (pthread_setname_np(thread, shortName.c_str()) == 0) result.name = shortName;
+            else ok = false;
+        }
+
+        if (!affinity.empty()) {
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            for (int cpu : affinity) {
+                if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &cpuSet);
+            }
+
+            if (pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuSet) == 0) {
+                result.affinity = affinity;
+            }
+            else {
+                std::cerr << "ThreadConfig: could not set CPU affinity of thread '" << name << "'\n";
+                ok = false;
+            }
+        }
+
+        if (policy != POLICY_DEFAULT) {
+            const int sysPolicy = policy == POLICY_RR ? SCHED_RR : SCHED_FIFO;
+            sched_param param;
+            param.sched_priority = std::max(sched_get_priority_min(sysPolicy),
+                                   std::min(sched_get_priority_max(sysPolicy), priority));
+
+            if (pthread_setschedparam(thread, sysPolicy, &param) == 0) {
+                result.policy = policy;
+                result.priority = param.sched_priority;
+            }
+            else {
+                // usually EPERM: needs CAP_SYS_NICE or an rtprio limit; keep the default policy
+                std::cerr << "ThreadConfig: real-time scheduling not permitted for thread '" << name
+                          << "', using default policy\n";
+                ok = false;
+            }
+        }
+        else if (priority != 0) {
+            // on Linux, niceness is per-thread
+            const id_t tid = (id_t)syscall(SYS_gettid);
+            if (setpriority(PRIO_PROCESS, tid, priority) == 0) {
+                result.priority = priority;
+            }
+            else {
+                std::cerr << "ThreadConfig: could not set niceness of thread '" << name << "'\n";
+                ok = false;
+            }
+        }
+
+#else
+        // unsupported platform: only the name is recorded
+        result.name = name;
+        ok = affinity.empty() && policy == POLICY_DEFAULT && priority == 0;
+#endif
+
+        appliedConfig = result;
+        if (effective) *effective = result;
+        return ok;
+    }
+
+    boost::thread ThreadConfig::launch(std::function<void()> fn) const
+    {
+        boost::thread::attributes attrs;
+        if (stackSize > 0) attrs.set_stack_size(stackSize);
+
+        ThreadConfig config = *this;
+        return boost::thread(attrs, [config, fn]() {
+            config.applyToCurrentThread();
+            fn();
+        });
+    }
+
+    ThreadConfig ThreadConfig::current()
+    {
+        ThreadConfig result = appliedConfig;
+
+#if defined(_WIN32)
+        const int winPriority = GetThreadPriority(GetCurrentThread());
+        if (winPriority == THREAD_PRIORITY_TIME_CRITICAL) {
+            if (result.policy == POLICY_DEFAULT) result.policy = POLICY_FIFO;
+        }
+        else if (winPriority != THREAD_PRIORITY_ERROR_RETURN) {
+            result.policy = POLICY_DEFAULT;
+            result.priority = -winPriority * 5;
+        }
+
+#elif defined(__linux__)
+        pthread_t thread = pthread_self();
+
+        char nameBuf[16];
+        if (pthread_getname_np(thread, nameBuf, sizeof nameBuf) == 0) {
+            result.name = nameBuf;
+        }
+
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        if (pthread_getaffinity_np(thread, sizeof(cpu_set_t), &cpuSet) == 0) {
+            result.affinity.clear();
+            const int numCPUs = std::max(1, (int)std::thread::hardware_concurrency());
+            if (CPU_COUNT(&cpuSet) < numCPUs) {
+                for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                    if (CPU_ISSET(cpu, &cpuSet)) result.affinity.push_back(cpu);
+                }
+            }
+        }
+
+        int sysPolicy;
+        sched_param param;
+        if (pthread_getschedparam(thread, &sysPolicy, &param) == 0) {
+            if (sysPolicy == SCHED_FIFO || sysPolicy == SCHED_RR) {
+                result.policy = sysPolicy == SCHED_RR ? POLICY_RR : POLICY_FIFO;
+                result.priority = param.sched_priority;
+            }
+            else {
+                result.policy = POLICY_DEFAULT;
+                errno = 0;
+                const int nice = getpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid));
+                result.priority = errno == 0 ? nice : 0;
+            }
+        }
+
+        pthread_attr_t attr;
+        if (pthread_getattr_np(thread, &attr) == 0) {
+            size_t size;
+            if (pthread_attr_getstacksize(&attr, &size) == 0) result.stackSize = size;
+            pthread_attr_destroy(&attr);
+        }
+#endif
+
+        return result;
+    }
+
+    std::string ThreadConfig::toString() const
+    {
+        static const char * POLICY_NAMES[] = { "default", "fifo", "rr" };
+
+        std::stringstream ss;
+        ss << "'" << name << "' policy=" << POLICY_NAMES[policy] << " priority=" << priority;
+
+        ss << " affinity=";
+        if (affinity.empty()) {
+            ss << "any";
+        }
+        else {
+            for (size_t i = 0; i < affinity.size(); ++i) {
+                if (i) ss << ",";
+                ss << affinity[i];
+            }
+        }
+
+        ss << " stack=";
+        if (stackSize) ss << stackSize;
+        else ss << "default";
+
+        return ss.str();
+    }
+}
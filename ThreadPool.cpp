@@ -0,0 +1,358 @@
+#include "stdafx.h"
+#include "Version.h"
+#include "ThreadPool.h"
+
+namespace ark {
+    namespace {
+        /** pool and worker index of the calling thread, if it is a pool worker */
+        thread_local const ThreadPool * currentPool = nullptr;
+        thread_local int currentWorkerIndex = -1;
+
+        /** configuration of a shared pool, set before its creation */
+        struct SharedPoolConfig {
+            SharedPoolConfig(int num_workers, const ThreadConfig & worker_config)
+                : numWorkers(num_workers), workerConfig(worker_config) { }
+
+            std::mutex mutex;
+            bool created = false;
+            int numWorkers;
+            std::vector<int> cpuAffinity;
+            ThreadConfig workerConfig;
+        };
+
+        /** default configuration of the background (recording) worker: below normal priority */
+        ThreadConfig recorderThreadConfig()
+        {
+            ThreadConfig config("ark-recorder");
+            config.priority = 10;
+            return config;
+        }
+
+        SharedPoolConfig & globalPoolConfig()
+        {
+            static SharedPoolConfig config(-1, ThreadConfig("ark-worker"));
+            return config;
+        }
+
+        SharedPoolConfig & backgroundPoolConfig()
+        {
+            static SharedPoolConfig config(1, recorderThreadConfig());
+            return config;
+        }
+
+        ThreadPool * createSharedPool(SharedPoolConfig & config)
+        {
+            std::lock_guard<std::mutex> lock(config.mutex);
+            config.created = true;
+            return new ThreadPool(config.numWorkers, config.cpuAffinity, config.workerConfig);
+        }
+    }
+
+    ThreadPool::ThreadPool(int num_workers, const std::vector<int> & cpu_affinity,
+                           const ThreadConfig & worker_config)
+        : pending(0), stopping(false)
+    {
+        if (num_workers <= 0) {
+            num_workers = std::max(1, (int)std::thread::hardware_concurrency());
+        }
+
+        // one queue per worker + one shared queue for external submissions
+        for (int i = 0; i <= num_workers; ++i) {
+            queues.emplace_back(new TaskQueue());
+        }
+
+        workerConfigs.resize(num_workers);
+
+        for (int i = 0; i < num_workers; ++i) {
+            ThreadConfig config = worker_config;
+            if (!config.name.empty()) config.name += "-" + std::to_string(i);
+            if (!cpu_affinity.empty()) {
+                config.affinity.assign(1, cpu_affinity[i % cpu_affinity.size()]);
+            }
+            workerConfigs[i] = config;
+            workers.push_back(config.launch(std::bind(&ThreadPool::workerLoop, this, i)));
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        sleepCondition.notify_all();
+
+        for (boost::thread & worker : workers) {
+            if (worker.joinable()) worker.join();
+        }
+    }
+
+    void ThreadPool::submit(std::function<void()> task, Priority priority)
+    {
+        int self = getWorkerIndex();
+        TaskQueue & queue = *queues[self >= 0 ? self : workers.size()];
+
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks[priority].push_back(std::move(task));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            ++pending;
+        }
+        sleepCondition.notify_one();
+    }
+
+    void ThreadPool::parallelFor(int begin, int end, const std::function<void(int, int)> & body,
+                                 int grain, Priority priority)
+    {
+        const int n = end - begin;
+        if (n <= 0) return;
+
+        if (grain <= 0) {
+            // a few chunks per thread, to balance the load
+            grain = std::max(1, n / (4 * ((int)workers.size() + 1)));
+        }
+
+        if (n <= grain || workers.empty()) {
+            body(begin, end);
+            return;
+        }
+
+        TaskGroup group(*this, priority);
+        for (int start = begin; start < end; start += grain) {
+            const int stop = std::min(end, start + grain);
+            group.run([&body, start, stop]() {
+                body(start, stop);
+            });
+        }
+        group.wait();
+    }
+
+    bool ThreadPool::runPendingTask(Priority max_priority)
+    {
+        std::function<void()> task;
+        if (!takeTask(getWorkerIndex(), task, max_priority)) return false;
+        task();
+        return true;
+    }
+
+    int ThreadPool::getNumWorkers() const
+    {
+        return (int)workers.size();
+    }
+
+    int ThreadPool::getWorkerIndex() const
+    {
+        return currentPool == this ? currentWorkerIndex : -1;
+    }
+
+    int ThreadPool::getNumPending() const
+    {
+        return pending.load();
+    }
+
+    ThreadConfig ThreadPool::getWorkerConfig(int index) const
+    {
+        std::lock_guard<std::mutex> lock(workerConfigMutex);
+        return workerConfigs[index];
+    }
+
+    ThreadPool & ThreadPool::global()
+    {
+        // intentionally never destroyed, so that workers may outlive other static objects
+        static ThreadPool * pool = createSharedPool(globalPoolConfig());
+        return *pool;
+    }
+
+    bool ThreadPool::configureGlobal(int num_workers, const std::vector<int> & cpu_affinity,
+                                     const ThreadConfig & worker_config)
+    {
+        SharedPoolConfig & config = globalPoolConfig();
+        std::lock_guard<std::mutex> lock(config.mutex);
+        if (config.created) return false;
+
+        config.numWorkers = num_workers;
+        config.cpuAffinity = cpu_affinity;
+        config.workerConfig = worker_config;
+        return true;
+    }
+
+    ThreadPool & ThreadPool::background()
+    {
+        static ThreadPool * pool = createSharedPool(backgroundPoolConfig());
+        return *pool;
+    }
+
+    bool ThreadPool::configureBackground(const ThreadConfig & worker_config)
+    {
+        SharedPoolConfig & config = backgroundPoolConfig();
+        std::lock_guard<std::mutex> lock(config.mutex);
+        if (config.created) return false;
+
+        config.workerConfig = worker_config;
+        return true;
+    }
+
+    void ThreadPool::workerLoop(int index)
+    {
+        currentPool = this;
+        currentWorkerIndex = index;
+
+        {
+            // record the settings that actually took effect
+            std::lock_guard<std::mutex> lock(workerConfigMutex);
+            workerConfigs[index] = ThreadConfig::current();
+        }
+
+        std::function<void()> task;
+        while (true) {
+            if (takeTask(index, task)) {
+                try {
+                    task();
+                }
+                catch (const std::exception & e) {
+                    std::cerr << "OpenARK thread pool: uncaught exception in task: " << e.what() << "\n";
+                }
+                catch (...) {
+                    std::cerr << "OpenARK thread pool: uncaught exception in task\n";
+                }
+                task = nullptr;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepCondition.wait(lock, [this]() {
+                return pending.load() > 0 || stopping.load();
+            });
+
+            if (stopping && pending.load() == 0) break;
+        }
+    }
+
+    bool ThreadPool::takeTask(int self, std::function<void()> & task, Priority max_priority)
+    {
+        if (pending.load() <= 0) return false;
+
+        const int numWorkers = (int)workers.size();
+
+        for (int p = 0; p <= max_priority; ++p) {
+            // 1. own queue, newest first
+            if (self >= 0) {
+                TaskQueue & queue = *queues[self];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (!queue.tasks[p].empty()) {
+                    task = std::move(queue.tasks[p].back());
+                    queue.tasks[p].pop_back();
+                    --pending;
+                    return true;
+                }
+            }
+
+            // 2. shared queue, then steal from other workers, oldest first
+            for (int k = 0; k <= numWorkers; ++k) {
+                const int victim = (k == 0) ? numWorkers : (self + k) % numWorkers;
+                if (victim == self) continue;
+                if (victim < 0) continue;
+
+                TaskQueue & queue = *queues[victim];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (!queue.tasks[p].empty()) {
+                    task = std::move(queue.tasks[p].front());
+                    queue.tasks[p].pop_front();
+                    --pending;
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    TaskGroup::TaskGroup(ThreadPool & pool, ThreadPool::Priority priority)
+        : pool(pool), priority(priority), state(std::make_shared<State>())
+    {
+        state->remaining = 0;
+    }
+
+    TaskGroup::~TaskGroup()
+    {
+        try {
+            wait();
+        }
+        catch (...) {}
+    }
+
+    void TaskGroup::run(std::function<void()> task)
+    {
+        ++state->remaining;
+
+        std::shared_ptr<State> st = state;
+        ThreadPool * p = &pool;
+        ThreadPool::Priority pr = priority;
+
+        pool.submit([st, p, pr, task]() {
+            try {
+                task();
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(st->mutex);
+                if (!st->exception) st->exception = std::current_exception();
+            }
+            finish(st, *p, pr);
+        }, priority);
+    }
+
+    void TaskGroup::wait()
+    {
+        while (state->remaining.load() > 0) {
+            // help out instead of blocking (but don't get stuck in lower priority work)
+            if (pool.runPendingTask(priority)) continue;
+
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->condition.wait_for(lock, std::chrono::milliseconds(1), [this]() {
+                return state->remaining.load() == 0;
+            });
+        }
+
+        std::exception_ptr exception;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            std::swap(exception, state->exception);
+        }
+        if (exception) std::rethrow_exception(exception);
+    }
+
+    void TaskGroup::then(std::function<void()> continuation)
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        if (state->remaining.load() == 0) {
+            lock.unlock();
+            pool.submit(continuation, priority);
+        }
+        else {
+            state->continuation = continuation;
+        }
+    }
+
+    bool TaskGroup::done() const
+    {
+        return state->remaining.load() == 0;
+    }
+
+    void TaskGroup::finish(const std::shared_ptr<State> & state, ThreadPool & pool,
+                           ThreadPool::Priority priority)
+    {
+        if (--state->remaining > 0) return;
+
+        std::function<void()> continuation;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            std::swap(continuation, state->continuation);
+        }
+        state->condition.notify_all();
+
+        if (continuation) pool.submit(continuation, priority);
+    }
+}
@@ -0,0 +1,107 @@
+#include "stdafx.h"
+#include "Version.h"
+#include "TrainingDataBuilder.h"
+
+#include <chrono>
+
+#include "HandClassifier.h"
+#include "HandDetector.h"
+#include "ThreadPool.h"
+
+namespace ark {
+    namespace classifier {
+        TrainingDataBuilder::TrainingDataBuilder(DetectionParams::Ptr params)
+        {
+            this->params = std::make_shared<DetectionParams>(params ? *params : *DetectionParams::DEFAULT);
+            this->params->handUseSVM = false;
+        }
+
+        std::vector<TrainingDataBuilder::Sample> TrainingDataBuilder::readLabels(const std::string & labels_path,
+                                                                                 const std::string & frames_dir)
+        {
+            std::vector<Sample> samples;
+            std::ifstream ifs(labels_path);
+            if (!ifs) return samples;
+
+            int N;
+            if (!(ifs >> N)) return samples;
+            samples.reserve(N);
+
+            const boost::filesystem::path dir(frames_dir);
+            std::string name;
+            int label;
+            while ((int)samples.size() < N && (ifs >> name >> label)) {
+                samples.push_back(Sample{ (dir / name).string(), label });
+            }
+
+            return samples;
+        }
+
+        TrainingDataBuilder::Report TrainingDataBuilder::build(const std::vector<Sample> & samples,
+            FeatureStore::Kind kind, const std::string & out_path) const
+        {
+            typedef std::chrono::steady_clock Clock;
+            const Clock::time_point start = Clock::now();
+
+            Report report;
+            const int N = (int)samples.size();
+            report.numFrames = N;
+
+            std::vector<cv::Mat> features(N);
+            ThreadPool::global().parallelFor(0, N, [&](int begin, int end) {
+                // detectors keep per-frame state, so each range gets its own
+                HandDetector detector(true, params);
+
+                for (int i = begin; i < end; ++i) {
+                    cv::Mat xyzMap;
+                    {
+                        cv::FileStorage fs(samples[i].path, cv::FileStorage::READ);
+                        if (!fs.isOpened()) continue;
+                        fs["xyzMap"] >> xyzMap;
+                    }
+                    if (xyzMap.empty()) continue;
+
+                    detector.update(xyzMap);
+
+                    // use the largest candidate
+                    Hand::Ptr hand;
+                    size_t handSize = 0;
+                    for (const Hand::Ptr & h : detector.getHands()) {
+                        const size_t size = h->getPoints().size() * h->getPointStride() * h->getPointStride();
+                        if (size > handSize) {
+                            hand = h;
+                            handSize = size;
+                        }
+                    }
+                    if (!hand) continue;
+
+                    const cv::Mat & handMap = hand->getDepthMap();
+                    features[i] = kind == FeatureStore::KIND_CLASSIFIER ?
+                        SVMHandClassifier::extractFeatures(*hand, handMap) :
+                        SVMHandValidator::extractFeatures(*hand, handMap);
+                }
+            }, 1, ThreadPool::NORMAL);
+
+            std::vector<cv::Mat> storeFeatures;
+            std::vector<int> storeLabels;
+            for (int i = 0; i < N; ++i) {
+                if (features[i].empty()) {
+                    ++report.numSkipped;
+                    continue;
+                }
+                storeFeatures.push_back(features[i]);
+                storeLabels.push_back(samples[i].label);
+            }
+
+            if (FeatureStore::write(out_path, kind, storeFeatures, storeLabels)) {
+                report.numSamples = (int)storeFeatures.size();
+            }
+            else {
+                std::cerr << "TrainingDataBuilder: could not write " << out_path << "\n";
+            }
+
+            report.totalMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            return report;
+        }
+    }
+}
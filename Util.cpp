@@ -1,10 +1,53 @@
 #include "stdafx.h"
 #include "Version.h"
 #include "Util.h"
+#include "ThreadPool.h"
+
+#include <opencv2/core/hal/intrin.hpp>
 
 namespace ark {
 
     namespace util {
+        namespace {
+            /**
+             * Per-thread scratch buffers of the flood fill and point sorting routines.
+             * Grown on first use for a frame size, or ahead of time by reserveScratch().
+             */
+            struct Scratch {
+                std::vector<Point2i> floodFillStack;
+                std::vector<int> buckets, bucketSize;
+                std::vector<Point2i> sortPoints;
+                std::vector<Vec3f> sortXyzPoints;
+
+                void reserveFloodFill(size_t num_points)
+                {
+                    if (floodFillStack.size() < num_points) floodFillStack.resize(num_points);
+                }
+
+                void reserveSort(int wid, int hi)
+                {
+                    const size_t N = (size_t)wid * hi;
+                    if (buckets.size() < N) {
+                        buckets.resize(N);
+                        sortPoints.resize(N);
+                        sortXyzPoints.resize(N);
+                    }
+                    if (bucketSize.size() < (size_t)std::max(wid, hi)) {
+                        bucketSize.resize(std::max(wid, hi));
+                    }
+                }
+            };
+
+            // one set per thread, so that several detectors may run concurrently
+            thread_local Scratch scratch;
+        }
+
+        void reserveScratch(const cv::Size & frame_size)
+        {
+            scratch.reserveFloodFill((size_t)frame_size.area());
+            scratch.reserveSort(frame_size.width, frame_size.height);
+        }
+
         std::vector<std::string> split(char* string_in, char const * delimeters) {
             std::auto_ptr<char> buffer(new char[strlen(string_in) + 1]);
             strcpy(buffer.get(), string_in);
@@ -132,10 +175,10 @@ namespace ark {
         template<class T, int N>
         cv::Vec<T, N> linearRegression(const std::vector<cv::Vec<T, N>> & points, int num_points)
         {
-            if (num_points == -1) num_points = (int)points.size();
+            if (num_points < 0 || num_points > (int)points.size()) num_points = (int)points.size();
 
             typedef Eigen::Matrix<T, -1, -1> MatT;
-            MatT A(points.size(), N), b(num_points, 1);
+            MatT A(num_points, N), b(num_points, 1);
 
             for (int i = 0; i < num_points; ++i) {
                 for (int j = 0; j < N - 1; ++j) {
@@ -387,8 +430,10 @@ namespace ark {
         }
 
         void computeNormalMap(const cv::Mat & xyz_map, cv::Mat & output_mat,
-            int normal_dist, int resolution, bool fill_in)
+            int normal_dist, int resolution, bool fill_in, const cv::Mat & exclude_mask)
         {
+            const bool useMask = !exclude_mask.empty() && exclude_mask.size() == xyz_map.size();
+
             cv::Size stripes = xyz_map.size() / resolution;
 
             if (fill_in) {
@@ -402,12 +447,15 @@ namespace ark {
             int step = fill_in ? 1 : resolution;
             int multiplier = fill_in ? 1 : resolution;
 
-            cv::parallel_for_(cv::Range(0, R*C), [&](const cv::Range & range) {
-                for (int r = range.start; r < range.end; ++r) {
+            ThreadPool::global().parallelFor(0, R*C, [&](int start, int end) {
+                for (int r = start; r < end; ++r) {
                     int i = r / C * multiplier, j = r % C * multiplier;
-                    output_mat.ptr<Vec3f>(i)[j] =
-                        util::normalAtPoint(xyz_map,
-                            Point2i(j, i) * (resolution / step), normal_dist);
+                    const Point2i pt = Point2i(j, i) * (resolution / step);
+                    if (useMask && exclude_mask.at<uchar>(pt)) {
+                        output_mat.ptr<Vec3f>(i)[j] = 0;
+                        continue;
+                    }
+                    output_mat.ptr<Vec3f>(i)[j] = util::normalAtPoint(xyz_map, pt, normal_dist);
                 }
             });
 
@@ -416,6 +464,36 @@ namespace ark {
             }
         }
 
+        void computeDecimatedNormalMap(const cv::Mat & xyz_map, cv::Mat & output_normals,
+            cv::Mat & output_xyz, int normal_dist, int resolution, const cv::Mat & exclude_mask)
+        {
+            const bool useMask = !exclude_mask.empty() && exclude_mask.size() == xyz_map.size();
+
+            const cv::Size stripes = xyz_map.size() / resolution;
+            output_normals.create(stripes, CV_32FC3);
+            output_xyz.create(stripes, CV_32FC3);
+
+            const int C = stripes.width;
+            ThreadPool::global().parallelFor(0, stripes.height, [&](int start, int end) {
+                for (int i = start; i < end; ++i) {
+                    const Vec3f * inPtr = xyz_map.ptr<Vec3f>(i * resolution);
+                    const uchar * maskPtr = useMask ? exclude_mask.ptr<uchar>(i * resolution) : nullptr;
+                    Vec3f * normalPtr = output_normals.ptr<Vec3f>(i);
+                    Vec3f * xyzPtr = output_xyz.ptr<Vec3f>(i);
+
+                    for (int j = 0; j < C; ++j) {
+                        const int jj = j * resolution;
+                        if (maskPtr && maskPtr[jj]) {
+                            normalPtr[j] = xyzPtr[j] = 0;
+                            continue;
+                        }
+                        xyzPtr[j] = inPtr[jj];
+                        normalPtr[j] = util::normalAtPoint(xyz_map, Point2i(jj, i * resolution), normal_dist);
+                    }
+                }
+            });
+        }
+
         double averageDepth(cv::Mat xyzMap) {
             cv::Mat depth; cv::extractChannel(xyzMap, depth, 2);
             return cv::mean(depth, depth > 0.0f)[0];
@@ -507,6 +585,7 @@ namespace ark {
 
             if (cluster_size < 0 || cluster_size >(int)points_ij.size())
                 cluster_size = (int)points_ij.size(); // default cluster size = vector size
+            cluster_size = std::min(cluster_size, (int)points_xyz.size());
 
             if (cluster_size < 3) return 0;
 
@@ -534,14 +613,19 @@ namespace ark {
                         auto it2 = points_ij.begin();
 
                         if (i + 2 < rowStart.size()) it2 += rowStart[i + 2];
-                        else it2 = points_ij.end();
+                        else it2 += cluster_size;
 
                         nx = std::lower_bound(it1, it2, Point2i(points_ij[j].x, points_ij[nx].y),
                             PointComparer<Point2i>(0, true))
                             - points_ij.begin();
                     }
 
-                    if (j + 1 >= points_xyz.size() || nx + 1 >= points_xyz.size()) continue;
+                    // the vectors may be longer than the cluster (reused buffers), so stop at the cluster's end
+                    // (still advancing the lower row's cursor, so that it stays in step with j)
+                    if ((int)j + 1 >= cluster_size || nx + 1 >= cluster_size) {
+                        ++nx;
+                        continue;
+                    }
 
                     Vec3f quad[4] =
                     { points_xyz[j], points_xyz[j + 1], points_xyz[nx], points_xyz[nx + 1] };
@@ -721,6 +805,165 @@ namespace ark {
             return false;
         }
 
+        namespace {
+            /** Point accessor for flood filling XYZ maps */
+            struct XYZMapAccessor {
+                typedef const Vec3f * Row;
+
+                explicit XYZMapAccessor(const cv::Mat & xyz_map) : map(xyz_map) { }
+                int rows() const { return map.rows; }
+                int cols() const { return map.cols; }
+                Row row(int y) const { return map.ptr<Vec3f>(y); }
+                Vec3f at(const Point2i & pt) const { return map.ptr<Vec3f>(pt.y)[pt.x]; }
+
+                const cv::Mat & map;
+            };
+
+            /**
+             * Flood fill implementation, generic over the point representation
+             * (see util::floodFill for parameter documentation)
+             */
+            template<class Accessor>
+            int floodFillImpl(const Accessor & acc, const Point2i & seed,
+                float thresh, std::vector <Point2i> * output_ij_points,
+                std::vector <Vec3f> * output_xyz_points, cv::Mat * output_mask,
+                int inv1, int inv2, float inv2_thresh, cv::Mat * color)
+            {
+                const int R = acc.rows(), C = acc.cols();
+
+                // true if temporary 'visited' matrix allocated (we'll need to delete it after)
+                bool tempVisMat = !color;
+
+                // create 'visited' matrix
+                if (tempVisMat) {
+                    color = new cv::Mat(R, C, CV_8U);
+                    *color = cv::Scalar(255);
+                }
+
+                color->at<uchar>(seed) = 1;
+
+                // stack for storing the 2d points (permanently allocated)
+                std::vector<Point2i> & stk = scratch.floodFillStack;
+                scratch.reserveFloodFill((size_t)R * C);
+
+                thresh *= thresh; // use square of distance to save computations
+                float max_distance2 = inv2_thresh * inv2_thresh; // for interval2
+
+                // add seed to stack
+                stk[0] = seed;
+
+                int stkSize = 1, total = 0, nNext;
+
+                // stores next points
+                std::array<Point2i, 4> nextPts;
+
+                Point2i pt;
+                typename Accessor::Row xyzPtr;
+                Vec3f * oPtr;
+                uchar * visPtr;
+                bool sw;
+
+                if (output_ij_points) {
+                    output_ij_points->clear();
+                    output_ij_points->reserve(R * C);
+                }
+                if (output_xyz_points) {
+                    output_xyz_points->clear();
+                    output_xyz_points->reserve(R * C);
+                }
+
+                int origX;
+
+                // begin DFS / scanline hybrid flood fill
+                while (stkSize > 0) {
+                    // pop current point from stack
+                    pt = stk[--stkSize];
+
+                    // create pointers to current row for faster access
+                    xyzPtr = acc.row(pt.y);
+                    visPtr = color->ptr<uchar>(pt.y);
+                    if (output_mask) oPtr = output_mask->ptr<Vec3f>(pt.y);;
+
+                    origX = pt.x;
+                    sw = true;
+
+                    Vec3f xyz;
+                    while (visPtr[pt.x] > 0) {
+                        // if not visited, visit; otherwise ignore this point
+                        xyz = xyzPtr[pt.x];
+
+                        // mark as visited
+                        visPtr[pt.x] = 0;
+
+                        // output this point to mask, etc.
+                        if (output_mask) oPtr[pt.x] = xyz;
+                        if (output_ij_points) output_ij_points->push_back(pt);
+                        if (output_xyz_points) output_xyz_points->push_back(xyz);
+
+                        // increment the total number of points
+                        ++total;
+
+                        // make a list of adjacent points
+                        nNext = -1;
+                        if (pt.y >= inv1) nextPts[++nNext] = std::move(Point2i(pt.x, pt.y - inv1));
+                        if (pt.y < R - inv1) nextPts[++nNext] = std::move(Point2i(pt.x, pt.y + inv1));
+
+                        if (inv2 > 0) {
+                            if (pt.y >= inv2) nextPts[++nNext] = std::move(Point2i(pt.x, pt.y - inv2));
+                            if (pt.y < R - inv2) nextPts[++nNext] = std::move(Point2i(pt.x, pt.y + inv2));
+                        }
+
+                        // go to each adjacent point
+                        for (uint i = 0; i <= nNext; ++i) {
+                            Point2i & adjPt = nextPts[i];
+                            uchar & adjVis = color->at<uchar>(adjPt);
+
+                            // skip if already visited
+                            if (adjVis <= 1) continue;
+
+                            // update & push to stack if point is close enough
+                            if (util::norm(xyz - acc.at(adjPt)) <
+                                (i < 2 ? thresh : max_distance2)) {
+                                stk[stkSize++] = adjPt;
+                                adjVis = 1; // mark 'visiting'
+                            }
+                        }
+
+                        // scanline
+                        if (sw) {
+                            // go right
+                            pt.x += inv1;
+                            if (pt.x >= C || visPtr[pt.x] == 0 ||
+                                util::norm(xyz - xyzPtr[pt.x]) >= thresh) {
+                                sw = false;
+
+                                // reset to middle
+                                pt.x = origX - inv1;
+                                xyz = xyzPtr[origX];
+                                if (pt.x < 0 || util::norm(xyz - xyzPtr[pt.x]) >= thresh) {
+                                    break;
+                                }
+                            }
+                        }
+                        else {
+                            // go left
+                            pt.x -= inv1;
+                            if (pt.x < 0 || util::norm(xyz - xyzPtr[pt.x]) >= thresh) {
+                                break;
+                            }
+                        }
+                    }
+                }
+
+                if (tempVisMat) {
+                    delete color;
+                    color = nullptr;
+                }
+
+                return total;
+            }
+        }
+
         /**
          * Performs floodfill on ordered point cloud
          */
@@ -729,42 +972,136 @@ namespace ark {
             std::vector <Vec3f> * output_xyz_points, cv::Mat * output_mask,
             int inv1, int inv2, float inv2_thresh, cv::Mat * color)
         {
-            // true if temporary 'visited' matrix allocated (we'll need to delete it after)
-            bool tempVisMat = !color;
+            return floodFillImpl(XYZMapAccessor(xyz_map), seed, thresh, output_ij_points,
+                output_xyz_points, output_mask, inv1, inv2, inv2_thresh, color);
+        }
 
-            // create 'visited' matrix
-            if (tempVisMat) {
-                color = new cv::Mat(xyz_map.size(), CV_8U);
-                *color = cv::Scalar(255);
+        namespace {
+            /** Helper for computeConnectivityMap: mark the pixel at (r, c) as connected to the
+             *  pixel at (r, c + inv) (CONNECT_RIGHT) and (r + inv, c) (CONNECT_DOWN), etc. */
+            inline uchar connectForward(const cv::Mat & map, int r, int c, float thresh2,
+                int inv1, int inv2, float inv2_thresh2)
+            {
+                const Vec3f & pt = map.ptr<Vec3f>(r)[c];
+                uchar bits = 0;
+                if (c + inv1 < map.cols && util::norm(pt - map.ptr<Vec3f>(r)[c + inv1]) < thresh2) {
+                    bits |= CONNECT_RIGHT;
+                }
+                if (r + inv1 < map.rows && util::norm(pt - map.ptr<Vec3f>(r + inv1)[c]) < thresh2) {
+                    bits |= CONNECT_DOWN;
+                }
+                if (inv2 > 0 && r + inv2 < map.rows &&
+                    util::norm(pt - map.ptr<Vec3f>(r + inv2)[c]) < inv2_thresh2) {
+                    bits |= CONNECT_DOWN2;
+                }
+                return bits;
             }
+        }
 
-            color->at<uchar>(seed) = 1;
+        void computeConnectivityMap(const cv::Mat & map, cv::Mat & output, float thresh,
+            int inv1, int inv2, float inv2_thresh)
+        {
+            ASSERT(map.type() == CV_32FC3, "computeConnectivityMap: input must be of type CV_32FC3");
+            const int R = map.rows, C = map.cols;
+
+            output.create(R, C, CV_8U);
+            if (inv1 > 1) output.setTo(0);
+
+            const float thresh2 = thresh * thresh, inv2Thresh2 = inv2_thresh * inv2_thresh;
+
+            // pass 1: compute each edge exactly once, storing it on the pixel above/left of the edge
+            ThreadPool::global().parallelFor(0, (R + inv1 - 1) / inv1, [&](int start, int end) {
+                for (int i = start; i < end; ++i) {
+                    const int r = i * inv1;
+                    uchar * outPtr = output.ptr<uchar>(r);
+                    int c = 0;
+
+#if CV_SIMD128
+                    if (inv1 == 1 && r + 1 < R && (inv2 <= 0 || r + inv2 < R)) {
+                        const float * ptr = map.ptr<float>(r);
+                        const float * below = map.ptr<float>(r + 1);
+                        const float * below2 = inv2 > 0 ? map.ptr<float>(r + inv2) : nullptr;
+                        const cv::v_float32x4 vThresh2 = cv::v_setall_f32(thresh2);
+                        const cv::v_float32x4 vInv2Thresh2 = cv::v_setall_f32(inv2Thresh2);
+                        const cv::v_int32x4 vRight = cv::v_setall_s32(CONNECT_RIGHT);
+                        const cv::v_int32x4 vDown = cv::v_setall_s32(CONNECT_DOWN);
+                        const cv::v_int32x4 vDown2 = cv::v_setall_s32(CONNECT_DOWN2);
+                        int bits[4];
+
+                        // stop one vector early so that the right neighbor is always in range
+                        for (; c <= C - 5; c += 4) {
+                            cv::v_float32x4 x, y, z, xn, yn, zn;
+                            cv::v_load_deinterleave(ptr + c * 3, x, y, z);
+
+                            cv::v_load_deinterleave(ptr + c * 3 + 3, xn, yn, zn);
+                            xn -= x; yn -= y; zn -= z;
+                            cv::v_int32x4 result = cv::v_reinterpret_as_s32(
+                                xn * xn + yn * yn + zn * zn < vThresh2) & vRight;
+
+                            cv::v_load_deinterleave(below + c * 3, xn, yn, zn);
+                            xn -= x; yn -= y; zn -= z;
+                            result |= cv::v_reinterpret_as_s32(
+                                xn * xn + yn * yn + zn * zn < vThresh2) & vDown;
+
+                            if (below2) {
+                                cv::v_load_deinterleave(below2 + c * 3, xn, yn, zn);
+                                xn -= x; yn -= y; zn -= z;
+                                result |= cv::v_reinterpret_as_s32(
+                                    xn * xn + yn * yn + zn * zn < vInv2Thresh2) & vDown2;
+                            }
 
-            // stack for storing the 2d points
-            static std::vector<Point2i> stk;
-            const int R = xyz_map.rows, C = xyz_map.cols;
+                            cv::v_store(bits, result);
+                            outPtr[c] = (uchar)bits[0];
+                            outPtr[c + 1] = (uchar)bits[1];
+                            outPtr[c + 2] = (uchar)bits[2];
+                            outPtr[c + 3] = (uchar)bits[3];
+                        }
+                    }
+#endif
 
-            // permanently allocate memory for our stack
-            if (stk.size() < R * C) {
-                stk.resize(R * C);
-            }
+                    for (; c < C; c += inv1) {
+                        outPtr[c] = connectForward(map, r, c, thresh2, inv1, inv2, inv2Thresh2);
+                    }
+                }
+            });
 
-            thresh *= thresh; // use square of distance to save computations
-            float max_distance2 = inv2_thresh * inv2_thresh; // for interval2
+            // pass 2: mirror each edge onto the pixel below/right of it
+            for (int r = 0; r < R; r += inv1) {
+                uchar * outPtr = output.ptr<uchar>(r);
+                const uchar * abovePtr = r >= inv1 ? output.ptr<uchar>(r - inv1) : nullptr;
+                const uchar * above2Ptr = (inv2 > 0 && r >= inv2) ? output.ptr<uchar>(r - inv2) : nullptr;
+
+                for (int c = 0; c < C; c += inv1) {
+                    uchar bits = 0;
+                    if (c >= inv1 && (outPtr[c - inv1] & CONNECT_RIGHT)) bits |= CONNECT_LEFT;
+                    if (abovePtr && (abovePtr[c] & CONNECT_DOWN)) bits |= CONNECT_UP;
+                    if (above2Ptr && (above2Ptr[c] & CONNECT_DOWN2)) bits |= CONNECT_UP2;
+                    outPtr[c] |= bits;
+                }
+            }
+        }
 
-            // add seed to stack
-            stk[0] = seed;
+        int floodFillConnected(const cv::Mat & connectivity, const Point2i & seed,
+            std::vector<Point2i> * output_ij_points,
+            std::vector<Vec3f> * output_xyz_points, const cv::Mat * xyz_map,
+            int inv1, int inv2, cv::Mat * color)
+        {
+            ASSERT(output_xyz_points == nullptr || xyz_map != nullptr,
+                "floodFillConnected: XYZ map required to output XYZ points");
+            const int R = connectivity.rows, C = connectivity.cols;
 
-            int stkSize = 1, total = 0, nNext;
+            // true if temporary 'visited' matrix allocated (we'll need to delete it after)
+            bool tempVisMat = !color;
 
-            // stores next points
-            std::array<Point2i, 4> nextPts;
+            // create 'visited' matrix
+            if (tempVisMat) {
+                color = new cv::Mat(R, C, CV_8U);
+                *color = cv::Scalar(255);
+            }
 
-            Point2i pt;
-            const Vec3f * xyzPtr;
-            Vec3f * oPtr;
-            uchar * visPtr;
-            bool sw;
+            // stack for storing the 2d points (permanently allocated)
+            std::vector<Point2i> & stk = scratch.floodFillStack;
+            scratch.reserveFloodFill((size_t)R * C);
 
             if (output_ij_points) {
                 output_ij_points->clear();
@@ -775,86 +1112,37 @@ namespace ark {
                 output_xyz_points->reserve(R * C);
             }
 
-            int origX;
-
-            // begin DFS / scanline hybrid flood fill
-            while (stkSize > 0) {
-                // pop current point from stack
-                pt = stk[--stkSize];
-
-                // create pointers to current row for faster access
-                xyzPtr = xyz_map.ptr<Vec3f>(pt.y);
-                visPtr = color->ptr<uchar>(pt.y);
-                if (output_mask) oPtr = output_mask->ptr<Vec3f>(pt.y);;
-
-                origX = pt.x;
-                sw = true;
-
-                const Vec3f * xyz;
-                while (visPtr[pt.x] > 0) {
-                    // if not visited, visit; otherwise ignore this point
-                    xyz = &xyzPtr[pt.x];
-
-                    // mark as visited
-                    visPtr[pt.x] = 0;
-
-                    // output this point to mask, etc.
-                    if (output_mask) oPtr[pt.x] = *xyz;
-                    if (output_ij_points) output_ij_points->push_back(pt);
-                    if (output_xyz_points) output_xyz_points->push_back(*xyz);
+            // neighbor offsets, in the same order as the connectivity bits
+            const int NUM_DIRS = 6;
+            const Point2i offsets[NUM_DIRS] = {
+                Point2i(0, -inv1), Point2i(0, inv1), Point2i(-inv1, 0), Point2i(inv1, 0),
+                Point2i(0, -inv2), Point2i(0, inv2)
+            };
 
-                    // increment the total number of points
-                    ++total;
+            color->at<uchar>(seed) = 1;
+            stk[0] = seed;
+            int stkSize = 1, total = 0;
 
-                    // make a list of adjacent points
-                    nNext = -1;
-                    if (pt.y >= inv1) nextPts[++nNext] = std::move(Point2i(pt.x, pt.y - inv1));
-                    if (pt.y < R - inv1) nextPts[++nNext] = std::move(Point2i(pt.x, pt.y + inv1));
+            while (stkSize > 0) {
+                const Point2i pt = stk[--stkSize];
+                color->ptr<uchar>(pt.y)[pt.x] = 0;
 
-                    if (inv2 > 0) {
-                        if (pt.y >= inv2) nextPts[++nNext] = std::move(Point2i(pt.x, pt.y - inv2));
-                        if (pt.y < R - inv2) nextPts[++nNext] = std::move(Point2i(pt.x, pt.y + inv2));
-                    }
+                if (output_ij_points) output_ij_points->push_back(pt);
+                if (output_xyz_points) output_xyz_points->push_back(xyz_map->ptr<Vec3f>(pt.y)[pt.x]);
+                ++total;
 
-                    // go to each adjacent point
-                    for (uint i = 0; i <= nNext; ++i) {
-                        Point2i & adjPt = nextPts[i];
-                        uchar & adjVis = color->at<uchar>(adjPt);
+                const uchar bits = connectivity.ptr<uchar>(pt.y)[pt.x];
+                for (int i = 0; i < NUM_DIRS; ++i) {
+                    if (!(bits & (1 << i))) continue;
 
-                        // skip if already visited
-                        if (adjVis <= 1) continue;
+                    const Point2i adjPt = pt + offsets[i];
+                    uchar & adjVis = color->ptr<uchar>(adjPt.y)[adjPt.x];
 
-                        // update & push to stack if point is close enough
-                        if (util::norm(*xyz - xyz_map.at<Vec3f>(adjPt)) <
-                            (i < 2 ? thresh : max_distance2)) {
-                            stk[stkSize++] = adjPt;
-                            adjVis = 1; // mark 'visiting'
-                        }
-                    }
+                    // skip if already visited, visiting, or invalid
+                    if (adjVis <= 1) continue;
 
-                    // scanline
-                    if (sw) {
-                        // go right
-                        pt.x += inv1;
-                        if (pt.x >= C || visPtr[pt.x] == 0 ||
-                            util::norm(*xyz - xyzPtr[pt.x]) >= thresh) {
-                            sw = false;
-
-                            // reset to middle
-                            pt.x = origX - inv1;
-                            xyz = &xyzPtr[origX];
-                            if (pt.x < 0 || util::norm(*xyz - xyzPtr[pt.x]) >= thresh) {
-                                break;
-                            }
-                        }
-                    }
-                    else {
-                        // go left
-                        pt.x -= inv1;
-                        if (pt.x < 0 || util::norm(*xyz - xyzPtr[pt.x]) >= thresh) {
-                            break;
-                        }
-                    }
+                    adjVis = 1; // mark 'visiting'
+                    stk[stkSize++] = adjPt;
                 }
             }
 
@@ -996,31 +1284,14 @@ namespace ark {
             if (num_pts < 0 || num_pts >(int)points.size())
                 num_pts = (int)points.size();
 
-            static int * buckets = nullptr, *bucketSize = nullptr;
-            static int lastWid, lastHi;
-
-            static Point2i * tmpPoints = nullptr;
-            static Vec3f * tmpXyzPoints = nullptr;
-
-            int maxDim = std::max(wid, hi);
-
-            if (buckets == nullptr || lastWid != wid || lastHi != hi) {
-                if (buckets != nullptr) delete[] buckets;
-                if (bucketSize != nullptr) delete[] bucketSize;
-
-                // permanently allocate memory for buckets, to improve efficiency
-                buckets = new int[wid * hi];
-                bucketSize = new int[maxDim];
-
-                tmpPoints = new Point2i[wid * hi];
-                tmpXyzPoints = new Vec3f[wid * hi];
-
-                lastWid = wid;
-                lastHi = hi;
-            }
+            // permanently allocate memory for buckets, to improve efficiency
+            scratch.reserveSort(wid, hi);
+            std::vector<int> & buckets = scratch.buckets, & bucketSize = scratch.bucketSize;
+            std::vector<Point2i> & tmpPoints = scratch.sortPoints;
+            std::vector<Vec3f> & tmpXyzPoints = scratch.sortXyzPoints;
 
             // clear buckets
-            memset(bucketSize, 0, wid * sizeof(int));
+            memset(bucketSize.data(), 0, wid * sizeof(int));
 
             // order by x
             for (int i = 0; i < num_pts; ++i) {
@@ -1041,7 +1312,7 @@ namespace ark {
             }
 
             // clear buckets again
-            memset(bucketSize, 0, hi * sizeof(int));
+            memset(bucketSize.data(), 0, hi * sizeof(int));
 
             // order by y
             for (int i = 0; i < num_pts; ++i) {
@@ -1256,6 +1527,30 @@ namespace ark {
             return 0;
         }
 
+        std::vector<int> matchNearest(const std::vector<Vec3f> & a, const std::vector<Vec3f> & b, float max_dist)
+        {
+            std::vector<std::pair<float, std::pair<int, int> > > pairs;
+            const float maxDistSq = max_dist * max_dist;
+            for (int i = 0; i < (int)a.size(); ++i) {
+                for (int j = 0; j < (int)b.size(); ++j) {
+                    const Vec3f d = a[i] - b[j];
+                    const float distSq = d.dot(d);
+                    if (distSq <= maxDistSq) pairs.push_back(std::make_pair(distSq, std::make_pair(i, j)));
+                }
+            }
+            std::sort(pairs.begin(), pairs.end());
+
+            std::vector<int> match(a.size(), -1);
+            std::vector<char> taken(b.size(), 0);
+            for (const auto & pr : pairs) {
+                const int i = pr.second.first, j = pr.second.second;
+                if (match[i] >= 0 || taken[j]) continue;
+                match[i] = j;
+                taken[j] = 1;
+            }
+            return match;
+        }
+
         template<> bool PointComparer<Point2i>::operator()(Point2i a, Point2i b) {
             if (compare_y_then_x) {
                 if (a.y == b.y) return reverse ^ (a.x < b.x);
@@ -3,8 +3,11 @@
 #include "Visualizer.h"
 #include "Util.h"
 
+#include <pcl/surface/organized_fast_mesh.h>
+
 namespace ark {
     pcl::visualization::PCLVisualizer * Visualizer::viewer = nullptr;
+    PointCloudAdapter Visualizer::cloudAdapter;
 
     /***
     Maps matrix values to [0, 255] for viewing
@@ -173,6 +176,11 @@ namespace ark {
         viewer->spinOnce();
     }
 
+    void Visualizer::visualizeCloud(const cv::Mat & xyz_map)
+    {
+        visualizeCloud(cloudAdapter.convert(xyz_map));
+    }
+
     void Visualizer::visualizePlaneRegression(const cv::Mat & input_mat, cv::Mat & output, std::vector<double> &equation, const double threshold, bool clicked)
     {
         if (input_mat.type() == CV_32FC3)
@@ -227,6 +235,23 @@ namespace ark {
         {
             return;
         }
+
+        if (cloud->isOrganized()) {
+            // organized: neighborhoods are known from the pixel grid, no search tree needed
+            pcl::PointCloud<pcl::Normal>::Ptr normals(new pcl::PointCloud<pcl::Normal>);
+            pcl::IntegralImageNormalEstimation<pcl::PointXYZ, pcl::Normal> ne;
+            ne.setNormalEstimationMethod(ne.AVERAGE_3D_GRADIENT);
+            ne.setMaxDepthChangeFactor(0.02f);
+            ne.setNormalSmoothingSize(10.0f);
+            ne.setInputCloud(cloud);
+            ne.compute(*normals);
+
+            pcl::PointCloud<pcl::PointNormal>::Ptr cloud_with_normals(new pcl::PointCloud<pcl::PointNormal>);
+            pcl::concatenateFields(*cloud, *normals, *cloud_with_normals);
+            visualizeOrganizedMesh(cloud_with_normals);
+            return;
+        }
+
         initPCLViewer();
 
         // Normal estimation*
@@ -269,10 +294,70 @@ namespace ark {
         gp3.setSearchMethod(tree2);
         gp3.reconstruct(triangles);
 
+        showPolygonMesh(triangles);
+    }
+
+    void Visualizer::visulizePolygonMesh(const cv::Mat & xyz_map, const cv::Mat & normal_map)
+    {
+        if (xyz_map.empty()) return;
+
+        if (normal_map.empty()) {
+            visulizePolygonMesh(cloudAdapter.convert(xyz_map));
+            return;
+        }
+
+        ASSERT(normal_map.size() == xyz_map.size() && normal_map.type() == CV_32FC3,
+            "visulizePolygonMesh: normal map must be a CV_32FC3 map of the same size as the xyz map");
+
+        // reuse OpenARK's image-space normals directly
+        const int R = xyz_map.rows, C = xyz_map.cols;
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        pcl::PointCloud<pcl::PointNormal>::Ptr cloud(new pcl::PointCloud<pcl::PointNormal>(C, R));
+        cloud->is_dense = false;
+
+        for (int r = 0; r < R; ++r) {
+            const Vec3f * xyzPtr = xyz_map.ptr<Vec3f>(r);
+            const Vec3f * normalPtr = normal_map.ptr<Vec3f>(r);
+
+            for (int c = 0; c < C; ++c) {
+                pcl::PointNormal & pt = cloud->at(c, r);
+                if (xyzPtr[c][2] > 0) {
+                    pt.x = xyzPtr[c][0]; pt.y = xyzPtr[c][1]; pt.z = xyzPtr[c][2];
+                }
+                else {
+                    pt.x = pt.y = pt.z = nan;
+                }
+                pt.normal_x = normalPtr[c][0];
+                pt.normal_y = normalPtr[c][1];
+                pt.normal_z = normalPtr[c][2];
+            }
+        }
+
+        visualizeOrganizedMesh(cloud);
+    }
+
+    void Visualizer::visualizeOrganizedMesh(pcl::PointCloud<pcl::PointNormal>::Ptr cloud)
+    {
+        pcl::OrganizedFastMesh<pcl::PointNormal> ofm;
+        pcl::PolygonMesh triangles;
+
+        // triangulate neighboring pixels, cutting triangles across depth discontinuities
+        ofm.setTrianglePixelSize(1);
+        ofm.setTriangulationType(pcl::OrganizedFastMesh<pcl::PointNormal>::TRIANGLE_ADAPTIVE_CUT);
+        ofm.setMaxEdgeLength(0.025f);
+        ofm.setInputCloud(cloud);
+        ofm.reconstruct(triangles);
+
+        showPolygonMesh(triangles);
+    }
+
+    void Visualizer::showPolygonMesh(const pcl::PolygonMesh & mesh)
+    {
+        initPCLViewer();
         viewer->setBackgroundColor(0, 0, 0);
 
-        if (!viewer->updatePolygonMesh(triangles))
-            viewer->addPolygonMesh(triangles);
+        if (!viewer->updatePolygonMesh(mesh))
+            viewer->addPolygonMesh(mesh);
 
         viewer->spinOnce();
     }
@@ -14,7 +14,13 @@ namespace ark {
 
     void Webcam::update()
     {
-        cap.read(frame);
+        // stamp the frame when it is grabbed, before the (slower) decode
+        if (!cap.grab()) {
+            frame.release();
+            return;
+        }
+        frameTime = Clock::now();
+        cap.retrieve(frame);
     }
 
     /***
@@ -22,6 +28,7 @@ namespace ark {
     ***/
     Webcam::~Webcam()
     {
+        endCapture();
         cap.release();
     }
 }
\ No newline at end of file
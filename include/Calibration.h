@@ -19,6 +19,28 @@ namespace ark {
     class Calibration
     {
     public:
+        /**
+        * Result of an offline calibration (see XYZToUnityOffline).
+        */
+        struct OfflineResult {
+            /** rotation and translation from (x,y,z) to Unity coordinates (empty if the calibration failed) */
+            cv::Mat R, T;
+
+            /** root-mean-square and maximum distance between transformed (x,y,z) points and Unity points (meters) */
+            double rmsError = -1.0;
+            double maxError = -1.0;
+
+            /** number of frames read, and number of frames in which a board was found */
+            int numFrames = 0;
+            int numDetected = 0;
+
+            /** number of correspondences used to solve R and T */
+            int numPoints = 0;
+
+            /** for each board position, indices of the frames whose corners were used */
+            std::vector<std::vector<int>> viewFrames;
+        };
+
         /**
         * Compute a calibration from (x,y,z) real world coordinates to (x',y',z') Unity coordinates.
         * @param depth_cam instance of a live @see DepthCamera
@@ -28,6 +50,37 @@ namespace ark {
         */
         static void XYZToUnity(DepthCamera& depth_cam, int num_boards, int board_w, int board_h);
 
+        /**
+        * Compute a calibration from (x,y,z) real world coordinates to (x',y',z') Unity coordinates
+        * from a recording, in batch. Boards are detected in all frames in parallel; consecutive detections
+        * of the board at the same place are grouped into one board position (in the order of unity_points),
+        * and the sharpest, most complete views of each position are used to solve R and T.
+        * @param frame_paths frame files written by DepthCamera::writeImage, in recording order (@see listRecording)
+        * @param board_w width of the board (number of inner intersections)
+        * @param board_h height of the board (number of inner intersections)
+        * @param unity_points Unity coordinates of the board corners at each board position (@see defaultUnityData)
+        * @param views_per_position maximum number of views of each board position to use
+        * @param min_position_distance distance the board must move (meters) to be considered at a new position
+        * @return calibration and reprojection error
+        */
+        static OfflineResult XYZToUnityOffline(const std::vector<std::string> & frame_paths, int board_w, int board_h,
+                                               const std::vector<std::vector<Vec3f>> & unity_points,
+                                               int views_per_position = 5, float min_position_distance = 0.02f);
+
+        /**
+        * List the frame files in a recording directory, sorted by name.
+        * @param directory the directory frames were written to
+        */
+        static std::vector<std::string> listRecording(const std::string & directory);
+
+        /**
+        * Save a rotation and translation matrix in the format read by the Unity plugin.
+        * @param R the rotation matrix
+        * @param T the translation matrix
+        * @param filename path of the file
+        */
+        static void writeRT(const cv::Mat & R, const cv::Mat & T, const std::string & filename = "RT_Transform.txt");
+
         /**
         * Compute a calibration from (x,y,z) real world coordiantes to (i,j) RGB camera coordinates.
         * @param depth_cam instance of a live @see DepthCamera
@@ -62,6 +115,13 @@ namespace ark {
         */
         static std::vector<std::vector<Vec3f>> prepareUnityData(std::vector<Vec3f> upper_left, float distance, int num_rows, int num_cols);
 
+        /**
+        * Unity checkboard coordinates for the default board positions used by XYZToUnity.
+        * @param board_w width of the board (number of inner intersections)
+        * @param board_h height of the board (number of inner intersections)
+        */
+        static std::vector<std::vector<Vec3f>> defaultUnityData(int board_w, int board_h);
+
         /**
         * Write calibration data points to file
         * @param points data points to be written to file
@@ -81,5 +141,31 @@ namespace ark {
         */
         static void computeRT(cv::Mat x, cv::Mat y, cv::Mat *R, cv::Mat *t);
 
+        /**
+        * Solve R and T from corresponding (x,y,z) and Unity points, skipping points without depth,
+        * and compute the reprojection error.
+        * @param [in] XYZ_points (x,y,z) board corners for each view
+        * @param [in] Unity_points Unity board corners for each view
+        * @param [out] R resultant rotation matrix
+        * @param [out] T resultant translation matrix
+        * @param [out] rms_error root-mean-square reprojection error (meters)
+        * @param [out] max_error maximum reprojection error (meters)
+        * @return number of correspondences used
+        */
+        static int solveRT(const std::vector<std::vector<Vec3f>> & XYZ_points,
+                           const std::vector<std::vector<Vec3f>> & Unity_points,
+                           cv::Mat & R, cv::Mat & T, double & rms_error, double & max_error);
+
+        /**
+        * Find the checkboard corners on an amplitude (or IR) image. The image is upsampled 4x and sharpened first.
+        * @param [in] amp_map the amplitude image
+        * @param [in] board_sz number of inner intersections of the board
+        * @param [out] corners corners found, in amp_map coordinates
+        * @param [out] gray optionally, the upsampled and sharpened image the corners were found on
+        * @return true if the board was found
+        */
+        static bool findBoardCorners(const cv::Mat & amp_map, cv::Size board_sz,
+                                     std::vector<Point2f> & corners, cv::Mat * gray = nullptr);
+
     };
 }
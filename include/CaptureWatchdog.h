@@ -0,0 +1,171 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <boost/thread/thread.hpp>
+
+#include "Version.h"
+#include "DepthCamera.h"
+#include "ThreadConfig.h"
+
+namespace ark {
+    /**
+     * Watchdog monitoring the frames of a capturing depth camera.
+     *
+     * If no good frame arrives within the stall threshold (a number of expected frame intervals),
+     * the watchdog raises a STALL event and asks the camera to restart its device pipeline
+     * (see DepthCamera::requestReconnect), repeating the request while the stall lasts; the camera
+     * spaces the attempts with bounded exponential backoff. Once frames resume, a RECOVERED event
+     * is raised and the stall duration is recorded in the statistics.
+     *
+     * Example:
+     * @code
+     *   CaptureWatchdog watchdog(*camera, 30.0f);
+     *   watchdog.addEventCallback([](const CaptureWatchdog::Event & e) { ... });
+     *   camera->beginCapture();
+     *   watchdog.start();
+     * @endcode
+     */
+    class CaptureWatchdog {
+    public:
+        /** Types of watchdog events */
+        enum EventType {
+            /** no frame was received within the stall threshold */
+            STALL = 0,
+            /** a device restart was requested */
+            RECONNECT_ATTEMPT,
+            /** a device restart failed */
+            RECONNECT_FAILED,
+            /** frames are being received again after a stall */
+            RECOVERED
+        };
+
+        /** Watchdog event */
+        struct Event {
+            /** type of the event */
+            EventType type;
+
+            /** time since the last good frame (for RECOVERED, the total duration of the stall), in ms */
+            double stallMs;
+
+            /** number of reconnect attempts made during the current stall */
+            int attempt;
+        };
+
+        /** Watchdog statistics */
+        struct Stats {
+            /** number of stalls detected */
+            int numStalls = 0;
+
+            /** number of stalls that ended with frames resuming */
+            int numRecoveries = 0;
+
+            /** number of reconnect attempts requested, and number of those that failed */
+            int numReconnectAttempts = 0;
+            int numReconnectFailures = 0;
+
+            /** duration of the last stall, longest stall, and total time stalled (ms; completed stalls only) */
+            double lastStallMs = 0.0;
+            double maxStallMs = 0.0;
+            double totalStallMs = 0.0;
+
+            /** durations of the most recent stalls (ms), oldest first */
+            std::deque<double> recentStallMs;
+        };
+
+        /**
+         * Create a watchdog for a camera. The watchdog does not start until start() is called.
+         * @param camera the camera to monitor; must outlive the watchdog
+         * @param expected_fps frame rate the camera is expected to deliver
+         * @param stall_frames number of expected frame intervals without a good frame after which
+         *                     the camera is considered stalled
+         * @param min_stall_ms minimum stall threshold in ms, regardless of the expected frame rate
+         */
+        explicit CaptureWatchdog(DepthCamera & camera, float expected_fps = 30.0f,
+                                 float stall_frames = 10.0f, int min_stall_ms = 500);
+
+        /** Destroy the watchdog, stopping it */
+        ~CaptureWatchdog();
+
+        /**
+         * Start monitoring the camera on a new thread.
+         * @param config configuration of the watchdog thread
+         */
+        void start(const ThreadConfig & config = ThreadConfig("ark-watchdog"));
+
+        /** Stop monitoring the camera */
+        void stop();
+
+        /** Returns true if the watchdog is running */
+        bool isRunning() const;
+
+        /** Returns true if the camera is currently considered stalled */
+        bool isStalled() const;
+
+        /** Returns the stall threshold, in ms */
+        double getStallThresholdMs() const;
+
+        /**
+         * Add a function to call on each watchdog event.
+         * WARNING: called from the watchdog thread, or from the capture thread for RECONNECT_FAILED.
+         * @return unique ID for this callback, needed for removeEventCallback
+         */
+        int addEventCallback(std::function<void(const Event &)> func);
+
+        /** Remove the event callback with the specified unique ID */
+        void removeEventCallback(int id);
+
+        /** Get a snapshot of the watchdog statistics */
+        Stats getStats() const;
+
+        /** Returns the name of an event type */
+        static const char * eventName(EventType type);
+
+        /** Shared pointer to CaptureWatchdog instance */
+        typedef std::shared_ptr<CaptureWatchdog> Ptr;
+
+    private:
+        /** state shared with pending reconnect callbacks, which may outlive the watchdog */
+        struct State {
+            mutable std::mutex mutex;
+            Stats stats;
+            std::map<int, std::function<void(const Event &)> > callbacks;
+            std::atomic<bool> reconnectPending{ false };
+            std::atomic<bool> stalled{ false };
+
+            /** call the event callbacks */
+            void emit(const Event & event);
+        };
+
+        /** monitoring loop of the watchdog thread */
+        void watchLoop();
+
+        /** ask the camera to reconnect, counting the attempt */
+        void requestReconnect(int attempt, double stall_ms);
+
+        /** the camera being monitored */
+        DepthCamera & camera;
+
+        /** stall threshold in ms */
+        double stallThresholdMs;
+
+        /** shared state */
+        std::shared_ptr<State> state;
+
+        /** watchdog thread and stop signal */
+        boost::thread thread;
+        bool stopping = false;
+        std::mutex stopMutex;
+        std::condition_variable stopCondition;
+
+        /** maximum number of stall durations kept in Stats::recentStallMs */
+        static const size_t MAX_RECENT_STALLS = 64;
+    };
+}
@@ -2,9 +2,14 @@
 
 // Include this header for OpenARK core functionality (depth camera, hand/plane detection)
 #include "DepthCamera.h"
+#include "CaptureWatchdog.h"
 #include "FrameObject.h"
 #include "Hand.h"
 #include "FramePlane.h"
 #include "Detector.h"
 #include "HandDetector.h"
-#include "PlaneDetector.h"
\ No newline at end of file
+#include "HandPredictor.h"
+#include "PlaneDetector.h"
+#include "LatencyGovernor.h"
+#include "FramePipeline.h"
+#include "Init.h"
\ No newline at end of file
@@ -2,6 +2,9 @@
 
 #include "Version.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
 #include <map>
 
@@ -10,6 +13,8 @@
 #include "Hand.h"
 #include "FramePlane.h"
 #include "DetectionParams.h"
+#include "TemporalFilter.h"
+#include "ThreadConfig.h"
 
 namespace ark {
     /**
@@ -21,6 +26,18 @@ namespace ark {
         // Section A: Methods that should be implemented in child camera classes
     public:
 
+        /**
+         * Optional image channels (the XYZ map is always produced).
+         * @see subscribe
+         */
+        enum Channel {
+            CHANNEL_RGB = 0,
+            CHANNEL_IR,
+            CHANNEL_AMP,
+            CHANNEL_FLAG,
+            NUM_CHANNELS
+        };
+
         /**
          * Get the camera's model name.
          */
@@ -51,6 +68,10 @@ namespace ark {
          * The images needed will already be initialized to getHeight() * getWidth().
          * WARNING: if has***Map() is false for the camera class, then the ***_map is not guarenteed to be initialized.
          *          so for ex. if you plan to enable the RGB map, please override hasRGBMap() to return true, etc.
+         *          Likewise, only channels for which isChannelInFrame() is true are initialized;
+         *          cameras should skip fetching and converting the other channels.
+         *          Use isChannelInFrame() rather than isChannelActive() here: the latter may change
+         *          at any time if another thread subscribes.
          * @param [out] xyz_map XYZ map (projection point cloud). CV_32FC3
          * @param [out] rgb_map RGB image. CV_8UC3
          * @param [out] ir_map IR image. CV_8UC1
@@ -99,6 +120,38 @@ namespace ark {
          */
         virtual bool badInput(); 
 
+        /**
+         * Restart the device pipeline (e.g. close and reopen the device and its streams) after an error or stall.
+         * Called on the thread retrieving frames, right before update(), when a reconnect has been requested.
+         * @see requestReconnect
+         * @return true if the device was restarted; false on failure or if not supported by the camera
+         */
+        virtual bool reconnect();
+
+    protected:
+        /**
+         * Called (on the thread retrieving frames, before update()) when the set of active channels changes,
+         * so that the camera can enable or disable the corresponding streams on the device.
+         * By default does nothing: the camera simply skips inactive channels in update().
+         * @see isChannelInFrame
+         */
+        virtual void onChannelsChanged();
+
+        /**
+         * Returns true if the channel is active for the frame being retrieved. This is a snapshot of
+         * isChannelActive() taken once at the start of nextFrame(), so it does not change during
+         * onChannelsChanged() and update(). Only meaningful on the thread retrieving frames.
+         */
+        bool isChannelInFrame(Channel channel) const;
+
+        /**
+         * Called from update() to report the time at which the device captured the frame, if the driver
+         * provides a timestamp. Otherwise the frame time is taken when update() returns.
+         * @see getLastFrameTime
+         */
+        void setFrameTime(std::chrono::steady_clock::time_point time);
+
+    public:
         // Section C: Generic methods/variables that may be used by all cameras
 
         /**
@@ -139,6 +192,7 @@ namespace ark {
         /**
          * Add a callback function to be called after each frame update.
          * WARNING: may be called from a different thread than the one where the callback is added.
+         * The callback may use the image getters (e.g. getXYZMap) to read the new frame.
          * @param func the function. Must take exactly one argument--a reference to the updated DepthCamera instance
          * @see removeUpdateCallBack
          * @return unique ID for this callback function, needed for removeUpdateCallback.
@@ -147,6 +201,8 @@ namespace ark {
 
         /** Remove the update callback function with the specified unique ID. 
          *  (The ID may be obtained from by addUpdateCallback when the callback is added)
+         *  Does not wait for a call already running on the capture thread, so state used by the callback
+         *  must outlive it (e.g. be held by the callback through a shared pointer).
          * @see addUpdateCallBack
          */
         void removeUpdateCallback(int id);
@@ -163,6 +219,13 @@ namespace ark {
          */
         const cv::Mat getXYZMap() const;
 
+        /**
+         * Returns the current XYZ map together with the capture time of its frame (see getLastFrameTime()).
+         * Unlike calling getXYZMap() and getLastFrameTime() separately, the two always belong to the same frame.
+         * @param [out] frame_time capture time of the frame
+         */
+        const cv::Mat getXYZMap(std::chrono::steady_clock::time_point & frame_time) const;
+
         /**
          * Get the RGB Image from this camera, if available. Else, throws an error.
          * Type: CV_8UC3
@@ -199,6 +262,97 @@ namespace ark {
          */
         bool writeImage(std::string destination) const;
 
+        /**
+         * Writes the current frame into file in the background, on the background (recorder)
+         * thread pool, so that recording does not stall the capture loop.
+         * The frame is copied before this function returns.
+         * @param destination the directory which the frame should be written to
+         * @param on_done optional function called (from the pool) with the result once writing is done
+         * @see ThreadPool::background
+         */
+        void writeImageAsync(std::string destination,
+                             std::function<void(bool)> on_done = std::function<void(bool)>()) const;
+
+        /**
+         * Set the configuration (name, CPU affinity, scheduling policy/priority, stack size)
+         * of the capture thread. Update callbacks also run on this thread.
+         * Takes effect the next time beginCapture() is called.
+         * @see ThreadConfig
+         */
+        void setCaptureThreadConfig(const ThreadConfig & config);
+
+        /** Get the requested configuration of the capture thread */
+        ThreadConfig getCaptureThreadConfig() const;
+
+        /**
+         * Get the settings that actually took effect on the capture thread
+         * (e.g. real-time scheduling may be refused without privileges).
+         * Returns the requested configuration if capture has not started yet.
+         */
+        ThreadConfig getEffectiveCaptureThreadConfig() const;
+
+        /**
+         * Subscribe to an optional image channel. Channels nobody is subscribed to are not fetched,
+         * converted or swapped, and cameras may disable the underlying streams.
+         * Subscriptions are reference counted: each subscribe() must be matched by an unsubscribe().
+         * Note: calling get***Map() also subscribes to its channel permanently (for compatibility). While capturing,
+         * that first call waits (briefly) for a frame containing the image; subscribe before beginCapture() to avoid this.
+         * @param channel the channel
+         * @see unsubscribe
+         */
+        void subscribe(Channel channel);
+
+        /**
+         * Remove a subscription to an image channel added by subscribe().
+         * @param channel the channel
+         */
+        void unsubscribe(Channel channel);
+
+        /**
+         * Returns true if the channel is available from this camera (e.g. hasRGBMap()) and someone is subscribed to it.
+         */
+        bool isChannelActive(Channel channel) const;
+
+        /**
+         * Set a temporal filter to apply to the XYZ map of each new frame, after noise removal.
+         * May be called while capturing; takes effect from the next frame.
+         * @param filter the filter (nullptr to disable temporal filtering)
+         * @see TemporalFilter
+         */
+        void setTemporalFilter(const TemporalFilter::Ptr & filter);
+
+        /**
+         * Get the temporal filter applied to each new frame (nullptr if disabled).
+         */
+        TemporalFilter::Ptr getTemporalFilter() const;
+
+        /**
+         * Ask for the device to be restarted (see reconnect()) before the next frame is retrieved.
+         * While the device keeps failing, attempts are spaced with exponential backoff (see setReconnectBackoff).
+         * May be called from any thread, e.g. from the camera's update() on error or from a CaptureWatchdog.
+         * @param on_done optional function called with the result of the attempt (from the capture thread)
+         */
+        void requestReconnect(std::function<void(bool)> on_done = std::function<void(bool)>());
+
+        /**
+         * Set the delay after the first reconnect attempt and the maximum delay between attempts (in ms).
+         * The delay doubles after each attempt and is reset once a good frame is retrieved.
+         */
+        void setReconnectBackoff(int initial_ms, int max_ms);
+
+        /**
+         * Returns the time at which the device captured the last good frame, if the camera reports it
+         * (e.g. RealSense frame timestamps), otherwise the time at which it was retrieved from the device,
+         * before any filtering (a default-constructed time point if no frame has been retrieved yet).
+         * Within an update callback, this is the capture time of the frame being delivered.
+         */
+        std::chrono::steady_clock::time_point getLastFrameTime() const;
+
+        /**
+         * Returns the number of good frames retrieved so far.
+         */
+        long long getFrameCount() const;
+
         /** Shared pointer to depth camera instance */
         typedef std::shared_ptr<DepthCamera> Ptr;
 
@@ -209,6 +363,9 @@ namespace ark {
          */
         cv::Mat xyzMap;
 
+        /** capture time of the frame in xyzMap (steady clock ticks; guarded by imageMutex) */
+        long long xyzMapTicks = 0;
+
         /**
          * Matrix of confidence values of each corresponding point in the world.
          * Matrix type CV_32FC1
@@ -257,23 +414,41 @@ namespace ark {
          * Helper for initializing images used by the generic depth camera.
          * Allocates memory for back buffers if required.
          */
-        void initializeImages();
+        void initializeImages(int channels);
 
         /**
          * Helper for swapping a single back buffer to the foreground.
-         * If the image is not available, creates a dummy mat with null value.
-         * @param check_func member function pointer to function that, if true on call, buffers are swapped
-         *                   if false, a dummy mat is created
+         * If the channel is not active, creates a dummy mat with null value.
+         * @param channel the channel of the image
+         * @param channels bitmask of the channels active in the frame
          * @param img pointer to foreground image
          * @param buf pointer to back buffer
          */
-        void swapBuffer(bool (DepthCamera::* check_func)() const, cv::Mat & img, cv::Mat & buf);
+        void swapBuffer(Channel channel, int channels, cv::Mat & img, cv::Mat & buf);
+
+        /**
+         * Helper subscribing to a channel the first time its image is requested through a getter
+         * @return true if the channel was subscribed to by this call
+         */
+        bool subscribeImplicitly(Channel channel) const;
+
+        /**
+         * Helper waiting (while capturing, up to IMPLICIT_SUBSCRIBE_WAIT_MS) for a frame containing an image
+         * of a channel that was just subscribed to implicitly
+         * @param lock lock held on imageMutex
+         * @param img the foreground image of the channel
+         */
+        void waitForImage(std::unique_lock<std::mutex> & lock, const cv::Mat & img) const;
+
+        /** Returns true if the channel is available from this camera (has***Map()) */
+        bool hasChannel(Channel channel) const;
 
         /**
          * Helper for swapping all back buffers to the foreground. 
          * If an image is not available, creates a dummy mat with null value.
+         * @param channels bitmask of the channels active in the frame
          */
-        void swapBuffers();
+        void swapBuffers(int channels);
 
         /**
          * Removes noise from an XYZMap based on confidence provided in the AmpMap and FlagMap.
@@ -283,6 +458,12 @@ namespace ark {
         /** stores the callbacks functions to call after each update (ID, function) */
         std::map<int, std::function<void(DepthCamera &)> > updateCallbacks;
 
+        /** mutex protecting updateCallbacks */
+        std::mutex updateCallbackMutex;
+
+        /** call the update callbacks (on a copy of the map, so that callbacks may add or remove callbacks) */
+        void runUpdateCallbacks();
+
         /** 
          * helper function supporting the default capturing behavior 
          * @param fps_cap maximum FPS
@@ -292,9 +473,64 @@ namespace ark {
         void captureThreadingHelper(int fps_cap = 60, volatile bool * interrupt = nullptr,
                                     bool remove_noise = true);
 
+        /** number of subscribers of each channel, and channels subscribed to through getters */
+        int subscribers[NUM_CHANNELS] = { 0, 0, 0, 0 };
+        int implicitSubscriptions = 0;
+        mutable std::mutex subscriptionMutex;
+
+        /** bitmask of subscribed channels, and whether it changed since the last frame */
+        std::atomic<int> subscribedChannels{ 0 };
+        std::atomic<bool> channelsChanged{ false };
+
+        /** bitmask of the channels active in the frame being retrieved (thread retrieving frames only) */
+        int frameChannels = 0;
+
+        /** signaled (with imageMutex) each time new images are swapped to the front */
+        mutable std::condition_variable frameCondition;
+
+        /** maximum time a getter waits for the first image of a channel it subscribed to */
+        static const int IMPLICIT_SUBSCRIBE_WAIT_MS = 1000;
+
+        /** temporal filter applied after noise removal (accessed atomically) */
+        TemporalFilter::Ptr temporalFilter;
+
         /** interrupt for immediately terminating the capturing thread */
         bool captureInterrupt = true;
 
+        /**
+         * Helper performing a requested reconnect, unless backing off after a previous attempt.
+         * Called from nextFrame() before update().
+         */
+        void handleReconnect();
+
+        /** time of the last good frame (steady clock ticks) and number of good frames */
+        std::atomic<long long> lastFrameTicks{ 0 };
+
+        /** capture time of the frame being retrieved, if reported by update() (capture thread only) */
+        std::chrono::steady_clock::time_point frameTime;
+        std::atomic<long long> frameCount{ 0 };
+
+        /** true if a reconnect has been requested */
+        std::atomic<bool> reconnectRequested{ false };
+
+        /** functions to call with the result of the next reconnect attempt */
+        std::vector<std::function<void(bool)> > reconnectCallbacks;
+
+        /** reconnect backoff settings (ms) */
+        int reconnectBackoffInitial = 250, reconnectBackoffMax = 8000;
+
+        /** mutex protecting reconnectCallbacks and the backoff settings */
+        std::mutex reconnectMutex;
+
+        /** current backoff delay (ms) and earliest time for the next attempt (capture thread only) */
+        int reconnectBackoff = 0;
+        std::chrono::steady_clock::time_point nextReconnectTime;
+
+        /** requested and effective configuration of the capture thread */
+        ThreadConfig captureThreadConfig = ThreadConfig("ark-capture");
+        ThreadConfig effectiveCaptureThreadConfig = ThreadConfig("ark-capture");
+        mutable std::mutex captureThreadConfigMutex;
+
         /**
          * Minimum depth of points (in meters). Points under this depth are presumed to be noise. (0.0 to disable)
          * (Defined in DepthCamera.cpp)
@@ -89,6 +89,13 @@ namespace ark {
          */
         bool handUseSVM = true;
 
+        /**
+         * if true, the SVM check uses an int8-quantized copy of the hand validator
+         * (smaller and faster, at a small cost in accuracy; see QuantizedSVM).
+         * default: false
+         */
+        bool handSVMQuantized = false;
+
         /**
          * @see handSVMHighConfidenceThresh
          * minimum SVM confidence value ([0...1]) for first hand object
@@ -104,6 +111,78 @@ namespace ark {
          */
         double handSVMHighConfidenceThresh = 0.56f;
 
+        /**
+         * maximum number of points used to analyze each hand candidate.
+         * larger (i.e. closer) clusters are decimated on a regular pixel grid before the hand object is
+         * constructed, so that the cost of hand analysis is roughly independent of distance.
+         * fingertip positions are then refined on the full resolution depth map.
+         * set to 0 to disable decimation (e.g. 6000 keeps close hands cheap to analyze).
+         * default: 0
+         */
+        int handPointBudget = 0;
+
+        /**
+         * maximum grid stride (in pixels) used when decimating hand candidates to meet handPointBudget.
+         * the contour image is dilated by at least stride + 1 pixels to close the gaps between the points.
+         * default: 3
+         */
+        int handMaxDecimation = 3;
+
+        /**
+         * maximum depth difference (m) between a decimated fingertip and the full resolution points
+         * averaged to refine it
+         * default: 0.03
+         */
+        float handFingerRefineMaxDepthDiff = 0.03f;
+
+        /**
+         * if true, forearms are trimmed off hand candidates with a cheap pre-pass
+         * (principal axis and width profile of the cluster) before the hand object is constructed.
+         * the forearm is taken to be the end of the cluster that enters from the image border
+         * (see handForearmMaxEdgeDistance); clusters with neither end at the border are not trimmed.
+         * default: false
+         */
+        bool handTrimForearm = false;
+
+        /**
+         * maximum distance (pixels) from the image border of an end of a cluster for that end
+         * to be considered the forearm
+         * default: 4
+         */
+        int handForearmMaxEdgeDistance = 4;
+
+        /**
+         * minimum length (m) of a cluster along its principal axis for forearm trimming to be attempted
+         * default: 0.22
+         */
+        float handForearmMinLength = 0.22f;
+
+        /**
+         * width of the bins (m) of the width profile used for forearm trimming
+         * default: 0.01
+         */
+        float handForearmBinSize = 0.01f;
+
+        /**
+         * distance (m) from the hand end of the cluster within which the widest part of the profile
+         * is assumed to be the palm
+         * default: 0.15
+         */
+        float handForearmPalmSearch = 0.15f;
+
+        /**
+         * distance (m) past the palm within which the narrowest part of the profile is assumed to be the wrist
+         * default: 0.12
+         */
+        float handForearmWristSearch = 0.12f;
+
+        /**
+         * distance (m) past the estimated wrist at which the forearm is cut, so that
+         * the wrist remains visible to the hand's own wrist detection
+         * default: 0.03
+         */
+        float handForearmCutMargin = 0.03f;
+
         /**
          * Amount toerodedilate the contour image by to remove small points
          */
@@ -330,6 +409,29 @@ namespace ark {
          */
         double planeCombineThreshold = 0.0025;
 
+        /**
+         * if true, a hand detector using a plane detector passes it the regions of the hands found in each
+         * frame (including the forearm), and the plane detector skips those pixels in the next frame
+         * when computing normals and growing subplanes.
+         * default: true
+         */
+        bool planeExcludeHands = true;
+
+        /**
+         * margin (pixels) added around excluded hand regions
+         * @see planeExcludeHands
+         * default: 6
+         */
+        int planeHandMaskMargin = 6;
+
+        /**
+         * maximum motion (pixels per frame) along which excluded hand regions are extended,
+         * to cover where each hand is predicted to be in the next frame
+         * @see planeExcludeHands
+         * default: 40
+         */
+        int planeHandMaskMaxMotion = 40;
+
         /** Shared pointer to ObjectParams instance */
         typedef std::shared_ptr<DetectionParams> Ptr;
 
@@ -1,6 +1,7 @@
 #pragma once
 #include "DepthCamera.h"
 #include "FrameObject.h"
+#include "VersionedStore.h"
 
 namespace ark {
     /** Abstract object detector class. 
@@ -30,7 +31,11 @@ namespace ark {
          */
         void update(DepthCamera & camera);
 
-        /** Change this detector's object detection parameters. */
+        /**
+         * Change this detector's object detection parameters. May be called from any thread:
+         * the parameters are copied and take effect at the start of the next update,
+         * so a frame is never processed with a mix of old and new parameters.
+         */
         void setParams(const DetectionParams::Ptr params);
 
         /** Shared pointer to Detector instance */
@@ -40,10 +45,17 @@ namespace ark {
         /** Primary function for object detection, called after each update. Must override in child classes. */
         virtual void detect(cv::Mat & image) = 0;
 
-        /** Pointer to this detector's object detection parameters */
+        /** Pointer to this detector's object detection parameters (fixed for the duration of each update) */
         DetectionParams::Ptr params; 
 
     private:
+        /** apply parameters published by setParams, if any (called at the start of each update) */
+        void applyPendingParams();
+
+        /** parameters published by setParams, and this detector's view of them */
+        VersionedStore<DetectionParams> pendingParams;
+        VersionedStore<DetectionParams>::Reader pendingParamsReader;
+
         /** Stores the XYZ map for the current frame */
         cv::Mat image;
 
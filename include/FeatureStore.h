@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "Version.h"
+
+namespace ark {
+    namespace classifier {
+        /**
+        * Name of the binary feature store file (path from data dir).
+        * If present, the trainers load it instead of the text labels and features files.
+        */
+        const std::string DATA_STORE_FILE_NAME = "handfeatures.bin";
+
+        /**
+         * Compact binary store of labeled feature vectors for training hand classifiers.
+         *
+         * The file is memory-mapped on open, so loading costs no parsing. Features are stored by column
+         * (one contiguous block of floats per feature index, padded to a cache line), followed by the labels
+         * and the number of features of each sample; samples shorter than the longest one are padded with NaN.
+         * @see TrainingDataBuilder
+         */
+        class FeatureStore {
+        public:
+            /** What the features were extracted for */
+            enum Kind {
+                /** returned by getKind() if the store is not open */
+                KIND_UNKNOWN = -1,
+                /** SVMHandValidator features */
+                KIND_VALIDATOR = 0,
+                /** SVMHandClassifier features (feature 0 is the number of fingers) */
+                KIND_CLASSIFIER = 1
+            };
+
+            /**
+             * Open a feature store, mapping it into memory.
+             * @param path path to the store file
+             */
+            explicit FeatureStore(const std::string & path);
+
+            /** Returns true if the store was opened successfully */
+            bool isOpen() const;
+
+            /** Returns what the features were extracted for (KIND_UNKNOWN if the store is not open) */
+            Kind getKind() const;
+
+            /** Returns the number of samples */
+            int size() const;
+
+            /** Returns the number of feature columns (the length of the longest sample) */
+            int getNumColumns() const;
+
+            /** Returns the label of a sample */
+            int getLabel(int sample) const;
+
+            /** Returns the number of features of a sample */
+            int getNumFeatures(int sample) const;
+
+            /** Returns a pointer to the values of one feature for all samples (size() floats) */
+            const float * getColumn(int column) const;
+
+            /**
+             * Gather samples into a row-major matrix, as used by cv::ml::TrainData.
+             * @param samples indices of the samples to gather
+             * @param first_column first feature to include
+             * @param num_columns number of features to include
+             * @return matrix of type CV_32F with one row per sample
+             */
+            cv::Mat getRows(const std::vector<int> & samples, int first_column, int num_columns) const;
+
+            /**
+             * Gather the labels of samples.
+             * @param samples indices of the samples to gather
+             * @return matrix of type CV_32S, 1 x samples.size()
+             */
+            cv::Mat getLabels(const std::vector<int> & samples) const;
+
+            /**
+             * Write a feature store.
+             * @param path path to the store file
+             * @param kind what the features were extracted for
+             * @param features feature vector of each sample (CV_32F, 1xN; N may vary)
+             * @param labels label of each sample
+             * @return true on success
+             */
+            static bool write(const std::string & path, Kind kind,
+                              const std::vector<cv::Mat> & features, const std::vector<int> & labels);
+
+            /** Shared pointer to FeatureStore instance */
+            typedef std::shared_ptr<FeatureStore> Ptr;
+
+        private:
+            /** file header */
+            struct Header {
+                char magic[8];
+                uint32_t version;
+                uint32_t kind;
+                uint32_t numSamples;
+                uint32_t numColumns;
+                /** number of floats between the starts of consecutive columns */
+                uint64_t columnStride;
+                /** byte offsets of the column block, labels and feature counts */
+                uint64_t columnsOffset;
+                uint64_t labelsOffset;
+                uint64_t sizesOffset;
+            };
+
+            boost::interprocess::file_mapping file;
+            boost::interprocess::mapped_region region;
+
+            const Header * header = nullptr;
+            const float * columns = nullptr;
+            const int32_t * labels = nullptr;
+            const int32_t * sizes = nullptr;
+        };
+    }
+}
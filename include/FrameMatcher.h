@@ -0,0 +1,148 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <opencv2/core.hpp>
+
+#include "Version.h"
+#include "DepthCamera.h"
+#include "RGBCamera.h"
+
+namespace ark {
+    /**
+     * Pairs each frame of a capturing depth camera with the RGB frame closest to it in time,
+     * without blocking either capture thread on the other.
+     *
+     * Depth frames are queued as they arrive; next() hands out the oldest queued depth frame together
+     * with the nearest RGB frame from the RGB camera's ring, once no closer RGB frame can arrive.
+     * Depth frames with no RGB frame within the tolerance are dropped and counted as unmatched.
+     *
+     * Example:
+     * @code
+     *   rgbCam.beginCapture();
+     *   depthCam->beginCapture();
+     *   FrameMatcher matcher(*depthCam, rgbCam, 15.0);
+     *   FrameMatcher::Pair pair;
+     *   while (matcher.next(pair, 100)) { ... pair.xyzMap, pair.rgbImage, pair.skewMs ... }
+     * @endcode
+     */
+    class FrameMatcher {
+    public:
+        typedef RGBCamera::Clock Clock;
+
+        /** A depth frame paired with an RGB frame */
+        struct Pair {
+            /** xyz map of the depth frame */
+            cv::Mat xyzMap;
+
+            /** RGB image */
+            cv::Mat rgbImage;
+
+            /** capture times of the depth and RGB frames */
+            Clock::time_point depthTime, rgbTime;
+
+            /** pairing skew: RGB timestamp minus depth timestamp, in ms */
+            double skewMs = 0.0;
+
+            /** indices of the depth frame (see DepthCamera::getFrameCount) and of the RGB frame */
+            long long depthIndex = -1, rgbIndex = -1;
+        };
+
+        /** Matching statistics */
+        struct Stats {
+            /** number of depth frames paired with an RGB frame */
+            long long numMatched = 0;
+
+            /** number of depth frames dropped because no RGB frame was within the tolerance */
+            long long numUnmatched = 0;
+
+            /** number of depth frames dropped because the queue was full (next() not called often enough) */
+            long long numOverflow = 0;
+
+            /** skew of the last pair, and mean and maximum absolute skew over all pairs (ms) */
+            double lastSkewMs = 0.0;
+            double meanAbsSkewMs = 0.0;
+            double maxAbsSkewMs = 0.0;
+        };
+
+        /**
+         * Start matching frames from the given cameras.
+         * @param depth_cam depth camera; must outlive the matcher
+         * @param rgb_cam RGB camera, capturing asynchronously (see RGBCamera::beginCapture); must outlive the matcher
+         * @param tolerance_ms maximum allowed skew between paired frames, in ms
+         * @param max_pending maximum number of depth frames waiting to be paired; older frames are dropped
+         */
+        FrameMatcher(DepthCamera & depth_cam, RGBCamera & rgb_cam,
+                     double tolerance_ms = 20.0, int max_pending = 4);
+
+        /** Stop matching frames */
+        ~FrameMatcher();
+
+        /**
+         * Get the next depth frame paired with its nearest RGB frame.
+         * @param [out] pair the pair
+         * @param timeout_ms time to wait for a pair to become available, in ms (0 to return immediately)
+         * @return true if a pair was retrieved
+         */
+        bool next(Pair & pair, int timeout_ms = 0);
+
+        /** Returns the maximum allowed skew, in ms */
+        double getTolerance() const;
+
+        /** Get a snapshot of the matching statistics */
+        Stats getStats() const;
+
+        /** Shared pointer to FrameMatcher instance */
+        typedef std::shared_ptr<FrameMatcher> Ptr;
+
+    private:
+        /** a depth frame waiting to be paired */
+        struct Pending {
+            cv::Mat xyzMap;
+            Clock::time_point time;
+            long long index;
+        };
+
+        /**
+         * state shared with the depth update callback, which may still be running on the capture thread
+         * after the matcher is destroyed (removing a callback does not wait for it)
+         */
+        struct State {
+            explicit State(size_t max_pending) : maxPending(max_pending) { }
+
+            const size_t maxPending;
+
+            /** depth frames waiting to be paired, oldest first */
+            std::deque<Pending> pending;
+
+            /** sum of absolute skews, for the mean */
+            double totalAbsSkewMs = 0.0;
+
+            Stats stats;
+
+            /** mutex protecting pending and the statistics */
+            mutable std::mutex mutex;
+
+            /** depth update callback: queue the new frame */
+            void onDepthFrame(DepthCamera & camera);
+        };
+
+        /**
+         * Try to pair the oldest pending depth frames, dropping those that can't be paired
+         * @return true if a pair was made
+         */
+        bool tryMatch(Pair & pair);
+
+        DepthCamera & depthCam;
+        RGBCamera & rgbCam;
+        const double toleranceMs;
+
+        /** shared state */
+        std::shared_ptr<State> state;
+
+        /** ID of the depth update callback */
+        int callbackId;
+    };
+}
@@ -91,6 +91,12 @@ namespace ark {
         */
         double getSurfArea();
 
+        /**
+        * Gets the grid stride the points of this object were decimated with (1 if not decimated).
+        * Only pixels whose coordinates are both multiples of the stride are part of a decimated object.
+        */
+        int getPointStride() const;
+
         /**
          * Get the depth map of the visible portion of this object
          * @return depth map of visible object
@@ -154,6 +160,11 @@ namespace ark {
          */
         cv::Size fullMapSize;
 
+        /**
+         * Grid stride the points were decimated with (1 if not decimated)
+         */
+        int pointStride = 1;
+
         /**
          * Surface area in meters squared
          */
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Version.h"
+#include "DetectionParams.h"
+#include "FramePlane.h"
+#include "Hand.h"
+#include "HandDetector.h"
+#include "PlaneDetector.h"
+#include "ThreadPool.h"
+
+namespace ark {
+    /**
+     * Frame-parallel detection pipeline for offline processing of a single recording.
+     *
+     * Frames submitted in sequence are detected concurrently on a thread pool, each by one of several
+     * independent lanes (a PlaneDetector and a HandDetector per lane), so up to numLanes frames are in
+     * flight at once. Finished frames go through a reorder buffer and are passed to the result callback
+     * strictly in sequence order, one at a time: stateful stages (tracking, smoothing, classification with
+     * StreamingHandClassifier, prediction with HandPredictor, writing output) belong in that callback.
+     *
+     * Since the lanes see frames out of order, detection must not depend on previous frames: the
+     * hand-mask feedback into plane detection (DetectionParams::planeExcludeHands) is disabled in the
+     * lanes, and a TemporalFilter should be applied to the frames before they are submitted.
+     *
+     * Example:
+     * @code
+     *   HandPredictor predictor;
+     *   FramePipeline pipeline(params, [&](FramePipeline::Result & result) {
+     *       predictor.update(result.hands, result.captureTime);
+     *       ...
+     *   });
+     *   for (const std::string & path : framePaths) pipeline.submit(loadXYZMap(path));
+     *   pipeline.flush();
+     * @endcode
+     */
+    class FramePipeline {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        /** Pipeline configuration */
+        struct Config {
+            /** number of frames detected concurrently; if not positive, one per worker of the pool */
+            int numLanes = 0;
+
+            /**
+             * maximum number of frames submitted but not yet passed to the result callback
+             * (in flight and waiting in the reorder buffer); submit() blocks while it is reached.
+             * If not positive, twice the number of lanes.
+             */
+            int maxBuffered = 0;
+
+            /** if true, planes are detected (and removed before hand detection) */
+            bool detectPlanes = true;
+
+            /** if true, hands are detected */
+            bool detectHands = true;
+        };
+
+        /** Detection result of a frame */
+        struct Result {
+            /** index of the frame, in order of submission (starting at 0) */
+            int64_t sequence;
+
+            /** the frame's xyz map, and the capture time passed to submit() */
+            cv::Mat xyzMap;
+            Clock::time_point captureTime;
+
+            /** hands and planes detected in the frame */
+            std::vector<Hand::Ptr> hands;
+            std::vector<FramePlane::Ptr> planes;
+
+            /** time taken to detect the frame (ms) */
+            double detectMs = 0.0;
+
+            /** if detection failed, a description of the error (the result is still emitted, in order) */
+            std::string error;
+        };
+
+        /** Pipeline metrics */
+        struct Stats {
+            /** number of lanes */
+            int numLanes = 0;
+
+            /** number of frames submitted, passed to the callback, and failed */
+            int64_t numSubmitted = 0;
+            int64_t numEmitted = 0;
+            int64_t numFailed = 0;
+
+            /** largest number of finished frames waiting in the reorder buffer */
+            int maxReorderDepth = 0;
+
+            /** mean detection time per frame (ms), and number of frames emitted per second since the first submit */
+            double avgDetectMs = 0.0;
+            double framesPerSecond = 0.0;
+        };
+
+        /**
+         * Called with each result, in sequence order; never called concurrently.
+         * If it throws, the remaining results are still emitted, and the first exception is rethrown
+         * by the next call to submit() or flush().
+         */
+        typedef std::function<void(Result &)> ResultCallback;
+
+        /**
+         * Create a pipeline with the default configuration, running on the global thread pool.
+         * @param params detection parameters (if not specified, uses default params)
+         * @param on_result function to call with each result
+         */
+        FramePipeline(DetectionParams::Ptr params, ResultCallback on_result);
+
+        /**
+         * Create a pipeline.
+         * @param params detection parameters (if not specified, uses default params)
+         * @param on_result function to call with each result
+         * @param config pipeline configuration
+         * @param pool thread pool to detect frames on
+         */
+        FramePipeline(DetectionParams::Ptr params, ResultCallback on_result, const Config & config,
+                      ThreadPool & pool = ThreadPool::global());
+
+        /** Waits for all submitted frames to be passed to the result callback (without rethrowing callback errors) */
+        ~FramePipeline();
+
+        FramePipeline(const FramePipeline &) = delete;
+        FramePipeline & operator=(const FramePipeline &) = delete;
+
+        /**
+         * Submit the next frame of the sequence. Blocks while the pipeline is full (see Config::maxBuffered).
+         * Should be called from a single thread, which must not be a worker of the pool.
+         * @param xyz_map the frame's xyz map; it is not copied, so it must not be modified afterwards
+         *                (pass a clone if the buffer is reused)
+         * @param capture_time capture time of the frame, passed through to the result
+         * @return sequence index of the frame
+         * @throws the first exception thrown by the result callback since the last submit() or flush()
+         */
+        int64_t submit(const cv::Mat & xyz_map, Clock::time_point capture_time = Clock::time_point());
+
+        /**
+         * Wait until all submitted frames have been passed to the result callback
+         * @throws the first exception thrown by the result callback since the last submit() or flush()
+         */
+        void flush();
+
+        /**
+         * Change the detection parameters of all lanes; frames detected from now on use the new parameters
+         * (see Detector::setParams). planeExcludeHands is always disabled.
+         */
+        void setParams(const DetectionParams::Ptr params);
+
+        /** Get the number of lanes */
+        int getNumLanes() const;
+
+        /** Get a snapshot of the pipeline metrics */
+        Stats getStats() const;
+
+        /** Shared pointer to FramePipeline instance */
+        typedef std::shared_ptr<FramePipeline> Ptr;
+
+    private:
+        /** an independent set of detectors */
+        struct Lane {
+            PlaneDetector::Ptr planeDetector;
+            HandDetector::Ptr handDetector;
+        };
+
+        /** detect a frame on a lane (runs on the pool) */
+        void detectFrame(int lane, Result & result);
+
+        /** put a finished frame in the reorder buffer, then emit results in order if no other thread is */
+        void finishFrame(int lane, Result && result);
+
+        /** rethrow (and clear) the first exception thrown by the result callback, if any; mutex must be held */
+        void rethrowCallbackError();
+
+        /** copy the parameters, disabling the options that depend on previous frames */
+        static DetectionParams::Ptr laneParams(const DetectionParams::Ptr & params);
+
+        /** pipeline configuration */
+        Config config;
+
+        /** pool the frames are detected on */
+        ThreadPool & pool;
+
+        /** function called with each result */
+        ResultCallback onResult;
+
+        /** the lanes, and the indices of the lanes not detecting a frame */
+        std::vector<Lane> lanes;
+        std::vector<int> freeLanes;
+
+        /** finished frames waiting to be emitted, by sequence index */
+        std::map<int64_t, Result> reorderBuffer;
+
+        /** sequence index of the next frame to submit, and of the next frame to emit */
+        int64_t nextSequence = 0, nextEmit = 0;
+
+        /** true while a thread is emitting results */
+        bool emitting = false;
+
+        /** first exception thrown by the result callback, not yet rethrown */
+        std::exception_ptr callbackError;
+
+        /** time of the first submit, and sum of detection times */
+        Clock::time_point startTime;
+        double detectMsSum = 0.0;
+
+        /** metrics */
+        Stats stats;
+
+        /** guards all of the above, except the lanes themselves */
+        mutable std::mutex mutex;
+
+        /** signaled when a lane is freed or results are emitted */
+        std::condition_variable condition;
+    };
+}
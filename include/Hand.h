@@ -2,9 +2,14 @@
 
 #include "FrameObject.h"
 #include "FramePlane.h"
+#include "VersionedStore.h"
 #include "Version.h"
 
 namespace ark {
+    namespace classifier {
+        class SVMHandValidator;
+    }
+
     /**
     * Class representing a hand visible in the current frame.
     * Example on tracking hand and background plane object simulateously:
@@ -36,13 +41,18 @@ namespace ark {
         * @param params parameters for object/hand detection (if not specified, uses default params)
         * @param sorted if true, assumes that 'points' is already ordered and skips sorting to save time.
         * @param points_to_use optionally, the number of points in 'points' to use for the object. By default, uses all points.
+        * @param point_stride grid stride the points were decimated with, if any (see DetectionParams::handPointBudget)
+        * @param validator SVM hand validator to check the hand with, e.g. a snapshot taken by the detector at the
+        *                  start of the frame. If not specified, uses the current getValidator() or getQuantizedValidator().
         */
         Hand(std::shared_ptr<std::vector<Point2i>> points_ij,
             std::shared_ptr<std::vector<Vec3f>> points_xyz,
             const cv::Mat & depth_map,
             DetectionParams::Ptr params = nullptr,
             bool sorted = false,
-            int points_to_use = -1
+            int points_to_use = -1,
+            int point_stride = 1,
+            const classifier::SVMHandValidator * validator = nullptr
         );
 
         /**
@@ -176,6 +186,46 @@ namespace ark {
         */
         bool isValidHand() const;
 
+        /**
+        * Recompute the (x,y,z) positions of the fingertips from a full resolution depth map,
+        * averaging the points around each fingertip that are close to it in depth.
+        * Used to recover precision lost when the hand was built from decimated points.
+        * @param full_xyz_map full resolution xyz map the hand was detected in
+        * @param max_depth_diff maximum depth difference (m) from the current fingertip position
+        *                       for a point to be included
+        */
+        void refineFingers(const cv::Mat & full_xyz_map, float max_depth_diff);
+
+        /** Store holding a version of the SVM hand validator */
+        typedef VersionedStore<const classifier::SVMHandValidator> ValidatorStore;
+
+        /**
+        * Get the store holding the SVM hand validator shared by all hands. Its models are loaded (from SVM_PATHS)
+        * on first use, i.e. when the first hand candidate is checked, or ahead of time by ark::init().
+        */
+        static ValidatorStore & getValidatorStore();
+
+        /**
+        * Get the store holding an int8-quantized copy of the SVM hand validator,
+        * used if DetectionParams::handSVMQuantized is set. Built from the current validator on first use.
+        */
+        static ValidatorStore & getQuantizedValidatorStore();
+
+        /** Get the current SVM hand validator (@see getValidatorStore) */
+        static ValidatorStore::Snapshot getValidator();
+
+        /** Get the current quantized SVM hand validator (@see getQuantizedValidatorStore) */
+        static ValidatorStore::Snapshot getQuantizedValidator();
+
+        /**
+        * Load new SVM hand validator models and swap them in without stopping detection.
+        * Loading happens on the calling thread; detectors pick up the new models at their next frame,
+        * and hands already being checked finish with the old ones.
+        * @param path directory to load the models from
+        * @return true on success (on failure, the current models are kept)
+        */
+        static bool reloadValidator(const std::string & path);
+
         /** Shared pointer to a Hand */
         typedef std::shared_ptr<Hand> Ptr;
 
@@ -195,6 +245,11 @@ namespace ark {
          */
         void checkEdgeConnected();
 
+        /**
+        * SVM hand validator to use in checkForHand (if null, uses the current one)
+        */
+        const classifier::SVMHandValidator * validator = nullptr;
+
         /**
         * (x,y,z) position of the center of the hand
         */
@@ -8,6 +8,7 @@
 
 #include "Version.h"
 #include "Hand.h"
+#include "QuantizedSVM.h"
 
 namespace ark {
     namespace classifier {
@@ -139,6 +140,17 @@ namespace ark {
             virtual bool train(std::string dataPath,
                 const double hyperparams[5 * NUM_SVMS] = DEFAULT_HYPERPARAMS) override;
 
+            /**
+             * Build an int8 or fp16 copy of the SVM models and use them for classification from now on,
+             * to save memory and time on low-power machines (see QuantizedSVM).
+             * The quantized models are discarded when the models are retrained or reloaded.
+             * @return true on success, false if not trained
+             */
+            bool quantize(QuantizedSVM::Precision precision = QuantizedSVM::PRECISION_INT8);
+
+            /** Returns true if classification uses quantized models */
+            bool isQuantized() const;
+
             /**
              *  Use this classifier to classify a feature vector representing a hand object.
              *  Returns a double between 0 and 1.
@@ -201,6 +213,9 @@ namespace ark {
             // SVM storage
             cv::Ptr<cv::ml::SVM> svm[NUM_SVMS];
 
+            // quantized copies of the SVMs (untrained unless quantize() was called)
+            QuantizedSVM quantized[NUM_SVMS];
+
             /**
             * Helper for initializing classifiers
             */
@@ -262,6 +277,17 @@ namespace ark {
             virtual bool train(std::string dataPath,
                 const double hyperparams[5] = DEFAULT_HYPERPARAMS) override;
 
+            /**
+             * Build an int8 or fp16 copy of the SVM and use it for classification from now on,
+             * to save memory and time on low-power machines (see QuantizedSVM).
+             * The quantized copy is discarded when the SVM is retrained or reloaded.
+             * @return true on success, false if not trained
+             */
+            bool quantize(QuantizedSVM::Precision precision = QuantizedSVM::PRECISION_INT8);
+
+            /** Returns true if classification uses the quantized SVM */
+            bool isQuantized() const;
+
             /**
              *  Use this classifier to validate a feature vector representing a hand object.
              *  Returns a double between 0 and 1.
@@ -308,6 +334,9 @@ namespace ark {
             // the SVM
             cv::Ptr<cv::ml::SVM> svm;
 
+            // quantized copy of the SVM (untrained unless quantize() was called)
+            QuantizedSVM quantized;
+
             /**
             * Helper for initializing classifiers
             */
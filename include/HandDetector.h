@@ -33,6 +33,12 @@ namespace ark {
          */
         const std::vector<Hand::Ptr> & getHands() const;
 
+        /**
+         * Obtain the forearm cuts made in the current frame (see DetectionParams::handTrimForearm)
+         * @return one line segment (x1, y1, x2, y2), in image coordinates, per trimmed cluster
+         */
+        const std::vector<cv::Vec4i> & getForearmCuts() const;
+
         /** Shared pointer to HandDetector instance */
         typedef std::shared_ptr<HandDetector> Ptr;
 
@@ -49,5 +55,82 @@ namespace ark {
 
         /** stores currently detected hands */
         std::vector<Hand::Ptr> hands;
+
+        /** stores forearm cuts made in the current frame */
+        std::vector<cv::Vec4i> forearmCuts;
+
+        /**
+         * Estimate the wrist of a cluster from its principal axis and width profile,
+         * and remove the points of the forearm past it (the order of the remaining points is kept).
+         * The forearm is assumed to be the end of the cluster that touches the image border; if neither
+         * or both ends do, the cluster is left untouched.
+         * @return number of points remaining
+         */
+        int trimForearm(std::vector<Point2i> & points_ij, std::vector<Vec3f> & points_xyz);
+
+        /**
+         * Pass the regions of the hands of the current frame (including the forearm), extended along each hand's
+         * motion, to the plane detector, to be excluded from plane detection in the next frame
+         * (see DetectionParams::planeExcludeHands)
+         */
+        void updatePlaneMask();
+
+        /** palm centers (image coordinates) of the hands of the previous frame, for estimating hand motion */
+        std::vector<Point2i> lastPalmsIJ;
+
+        /** true if a mask was passed to the plane detector and has not been cleared since */
+        bool planeMaskSet = false;
+
+        /** connectivity map of the current frame, used for clustering (see util::computeConnectivityMap) */
+        cv::Mat connectivityMap;
+
+        /**
+         * Scratch buffers for hand detection, kept across frames so that no scratch memory
+         * is allocated per frame or per flood fill seed in steady state.
+         * Buffers are reallocated only when the frame size changes.
+         */
+        struct Workspace {
+            /** frame size the workspace is allocated for */
+            cv::Size size;
+
+            /** flood fill 'visited' map */
+            cv::Mat floodFillMap;
+
+            /** points of the current cluster */
+            std::vector<Point2i> allIJPoints;
+            std::vector<Vec3f> allXYZPoints;
+
+            /** clusters large enough to be hands, and their hand objects */
+            std::vector<VecP2iPtr> clusterIJ;
+            std::vector<VecV3fPtr> clusterXYZ;
+            std::vector<int> clusterSize;
+            std::vector<int> clusterStride;
+            std::vector<Hand::Ptr> clusterHands;
+
+            /**
+             * component label of each cluster (0 if none), map of the components found by flood fill before forearm
+             * trimming, and bounding box of each component (only used if DetectionParams::planeExcludeHands is set)
+             */
+            std::vector<int> clusterComponent;
+            cv::Mat componentMap;
+            std::vector<cv::Rect> componentBounds;
+
+            /** hand mask passed to the plane detector, and mask of a single component */
+            cv::Mat handMask, componentMask;
+
+            /** position of each cluster point along the principal axis, and width profile (forearm trimming) */
+            std::vector<float> axisPos;
+            std::vector<float> profileMin, profileMax;
+            std::vector<int> profileCount, profileEdge;
+
+            /** prepare the workspace for a frame of the given size */
+            void prepare(cv::Size frame_size);
+        };
+
+        /** workspace of this detector */
+        Workspace workspace;
+
+        /** this detector's snapshots of the SVM hand validators, refreshed at the start of each frame */
+        Hand::ValidatorStore::Reader validatorReader, quantizedValidatorReader;
     };
 }
\ No newline at end of file
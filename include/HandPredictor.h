@@ -0,0 +1,216 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Version.h"
+#include "Hand.h"
+
+namespace ark {
+    /**
+     * Compensates for pipeline latency by extrapolating the palm centers and fingertips of tracked hands
+     * to the time at which they will be displayed.
+     *
+     * Hands are associated across frames by palm center, and fingertips within a hand by position. Every
+     * tracked point runs through a constant-acceleration (alpha-beta-gamma) filter; since all points of a
+     * frame share the same capture time, the filter gains are the same for all of them and the filter
+     * runs as one vectorized pass over the coordinates of every tracked point.
+     *
+     * The predictor also checks its predictions against the frames later captured at (about) the
+     * predicted time, and reports the error next to the error of displaying the last position unchanged.
+     *
+     * Example:
+     * @code
+     *   HandPredictor predictor;
+     *   // after each detector update
+     *   predictor.update(handDetector->getHands(), camera->getLastFrameTime());
+     *   // before rendering
+     *   auto predicted = predictor.predict(HandPredictor::Clock::now() + displayLatency);
+     * @endcode
+     */
+    class HandPredictor {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        /** Predictor configuration */
+        struct Config {
+            /**
+             * smoothing factor of the filter, in [0, 1). 0 follows the measurements exactly;
+             * larger values smooth more but respond to changes in motion more slowly.
+             * The filter gains are derived from this (fading-memory polynomial filter).
+             */
+            float smoothing = 0.5f;
+
+            /** maximum distance (m) a palm center may move between frames to stay on the same track */
+            float maxHandDistance = 0.15f;
+
+            /** maximum distance (m) a fingertip may move between frames to stay on the same track */
+            float maxFingerDistance = 0.04f;
+
+            /** number of frames a hand or fingertip may go undetected before its track is dropped */
+            int maxMissedFrames = 3;
+
+            /** predictions further ahead of the last frame than this (ms) are clamped to it */
+            double maxHorizonMs = 100.0;
+        };
+
+        /** Predicted position of a hand */
+        struct PredictedHand {
+            /** ID of the hand's track (stays the same while the hand is tracked) */
+            int trackId;
+
+            /** predicted palm center */
+            Vec3f palmCenter;
+
+            /** predicted fingertips, in the order of Hand::getFingers() for the hand of the last update */
+            std::vector<Vec3f> fingers;
+
+            /** time between the frame the prediction is based on and the predicted time (ms) */
+            double horizonMs;
+        };
+
+        /** Prediction error statistics */
+        struct Stats {
+            /** number of predicted points checked against a later frame */
+            long long numSamples = 0;
+
+            /** mean, RMS and maximum distance between predicted and measured positions (m) */
+            double meanError = 0.0;
+            double rmsError = 0.0;
+            double maxError = 0.0;
+
+            /** mean distance between the last position before the prediction and the measured position (m) */
+            double meanUncompensatedError = 0.0;
+
+            /** mean prediction horizon of the checked points (ms) */
+            double meanHorizonMs = 0.0;
+
+            /** number of hands and points currently tracked */
+            int numTracks = 0;
+            int numPoints = 0;
+        };
+
+        /** Create a predictor with the default configuration */
+        HandPredictor();
+
+        /**
+         * Create a predictor.
+         * @param config predictor configuration
+         */
+        explicit HandPredictor(const Config & config);
+
+        /**
+         * Update the tracks with the hands detected in a frame.
+         * @param hands hands detected in the frame
+         * @param capture_time time at which the frame was captured (e.g. DepthCamera::getLastFrameTime())
+         * @return false if the frame was ignored because it is not newer than the last frame
+         */
+        bool update(const std::vector<Hand::Ptr> & hands, Clock::time_point capture_time);
+
+        /**
+         * Predict the positions of the hands of the last update at the given time.
+         * @param display_time time at which the result will be displayed
+         * @return one prediction per hand passed to the last update, in the same order
+         */
+        std::vector<PredictedHand> predict(Clock::time_point display_time);
+
+        /**
+         * Predict the positions of the hands of the last update at a time relative to now.
+         * @param lead_ms time from now at which the result will be displayed (ms)
+         */
+        std::vector<PredictedHand> predictAhead(double lead_ms);
+
+        /** Drop all tracks and statistics */
+        void reset();
+
+        /** Get the prediction error statistics */
+        Stats getStats() const;
+
+        /** Shared pointer to HandPredictor instance */
+        typedef std::shared_ptr<HandPredictor> Ptr;
+
+    private:
+        /** a tracked hand */
+        struct Track {
+            int id;
+
+            /** point slot of the palm center */
+            int palmSlot;
+
+            /** point slots of all tracked fingertips, and of the fingers of the last update (in order) */
+            std::vector<int> fingerSlots, currentFingers;
+
+            /** consecutive frames the hand was not detected */
+            int missed = 0;
+        };
+
+        /** a prediction waiting for a frame captured at its target time */
+        struct PendingCheck {
+            Clock::time_point target;
+            double horizonMs;
+
+            /** slot, slot generation, predicted position, and position before prediction of each point */
+            std::vector<int> slots;
+            std::vector<unsigned> generations;
+            std::vector<Vec3f> predicted, uncompensated;
+        };
+
+        /** allocate a point slot at the given position */
+        int allocSlot(const Vec3f & position);
+
+        /** free a point slot */
+        void freeSlot(int slot);
+
+        /** associate the fingertips of a hand with the fingertip slots of its track */
+        void associateFingers(Track & track, const std::vector<Vec3f> & fingers);
+
+        /** compare pending predictions with the points measured in the current frame */
+        void checkPending(Clock::time_point capture_time, double frame_ms);
+
+        /** predictor configuration, and filter gains derived from it */
+        Config config;
+        float alpha, beta, gamma;
+
+        /**
+         * filter state of all points: position, velocity, acceleration, and this frame's measurement,
+         * each holding 3 coordinates per slot (padded for vectorization)
+         */
+        std::vector<float> pos, vel, acc, meas;
+
+        /** per slot: true if in use, generation, frames tracked, consecutive frames missed, measured this frame */
+        std::vector<char> slotUsed, slotMeasured;
+        std::vector<unsigned> slotGeneration;
+        std::vector<int> slotAge, slotMissed;
+        std::vector<int> freeSlots;
+
+        /** tracked hands, and the track of each hand of the last update */
+        std::vector<Track> tracks;
+        std::vector<int> currentTracks;
+        int nextTrackId = 0;
+
+        /** capture time of the last update, and whether there was one */
+        Clock::time_point lastTime;
+        bool hasLastTime = false;
+
+        /** predictions waiting to be checked */
+        std::deque<PendingCheck> pending;
+
+        /** true if the last entry of pending was made since the last update (it is replaced, not added to) */
+        bool pendingSinceUpdate = false;
+
+        /** scratch buffer for extrapolated positions */
+        std::vector<float> extrapolated;
+
+        /** error statistics (sums over checked points), and number of tracks and points after the last update */
+        mutable std::mutex statsMutex;
+        long long numSamples = 0;
+        double errorSum = 0.0, errorSqSum = 0.0, maxError = 0.0, uncompensatedSum = 0.0, horizonSum = 0.0;
+        int numTracks = 0, numPoints = 0;
+
+        /** maximum number of predictions waiting to be checked */
+        static const size_t MAX_PENDING = 16;
+    };
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+#include "Version.h"
+#include "DetectionParams.h"
+
+namespace ark {
+    /**
+     * Options for ark::init(). Anything not requested is left uninitialized
+     * (and is initialized lazily on first use, as without calling init()).
+     */
+    struct InitOptions {
+        /**
+         * Frame size the pipeline will run at (e.g. the depth camera's resolution).
+         * Used to preallocate per-thread scratch buffers and to build the warm-up frame.
+         * If empty, no buffers are preallocated and no warm-up frame is run.
+         */
+        cv::Size frameSize;
+
+        /** if true, loads the SVM hand validator models from disk (see Hand::getValidator) */
+        bool loadHandValidator = true;
+
+        /** if true, starts the global thread pool (see ThreadPool::global) and sizes its workers' scratch buffers */
+        bool startThreadPool = true;
+
+        /** if true, opens the PCL viewer used by Visualizer */
+        bool openPCLViewer = false;
+
+        /**
+         * number of synthetic frames to run through temporary plane and hand detectors (0 to skip warm-up).
+         * This warms up the shared stages (thread pool, SVM, OpenCV internals); the temporary detectors are
+         * discarded afterwards, so no state from the synthetic frames reaches the application's detectors.
+         */
+        int warmUpFrames = 1;
+
+        /** detection parameters for the temporary warm-up detectors (default parameters if null) */
+        DetectionParams::Ptr params;
+    };
+
+    /**
+     * Cold-start timing reported by ark::init(), in milliseconds.
+     * Stages that were not requested have a time of -1.
+     */
+    struct InitReport {
+        /** time taken to load the SVM hand validator */
+        double handValidatorMs = -1.0;
+
+        /** true if the hand validator models were found and loaded */
+        bool handValidatorLoaded = false;
+
+        /** time taken to start the global thread pool */
+        double threadPoolMs = -1.0;
+
+        /** time taken to preallocate scratch buffers */
+        double scratchMs = -1.0;
+
+        /** time taken to open the PCL viewer */
+        double pclViewerMs = -1.0;
+
+        /** time taken by each warm-up frame */
+        std::vector<double> warmUpFrameMs;
+
+        /** total time taken by init() */
+        double totalMs = 0.0;
+
+        /** Returns a human-readable summary of the report */
+        std::string toString() const;
+    };
+
+    /**
+     * Explicitly initialize and warm up OpenARK, so that the first frames after launch
+     * run at steady-state speed. Preloads models, starts the thread pool, sizes scratch buffers
+     * for the camera resolution and runs synthetic frames through the detection pipeline.
+     * Should be called once after configuring the thread pool and before capturing; safe to call again.
+     * @param options what to initialize
+     * @return cold-start timing of each stage
+     */
+    InitReport init(const InitOptions & options = InitOptions());
+}
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Version.h"
+#include "DetectionParams.h"
+#include "Detector.h"
+
+namespace ark {
+    /**
+     * Keeps the processing latency of a frame loop within a budget by trading detection quality for speed.
+     *
+     * The governor times each frame (and optionally each stage within it). When the smoothed frame time
+     * stays over budget, it steps down to the next quality level, cheapening the detection parameters of
+     * the registered detectors (see Level); when there is enough headroom for a while, it steps back up.
+     * A step up that immediately has to be undone makes the next attempt at that level wait longer,
+     * so the governor settles instead of oscillating between two levels.
+     *
+     * Should be driven from the thread running the frame loop; getStats() may be called from any thread.
+     *
+     * Example:
+     * @code
+     *   LatencyGovernor governor(params, 1000.0 / 30.0);
+     *   governor.addDetector(planeDetector); governor.addDetector(handDetector);
+     *   while (...) {
+     *       governor.beginFrame();
+     *       if (governor.shouldRunPlanes()) {
+     *           LatencyGovernor::StageTimer t(governor, "planes");
+     *           planeDetector->update(*camera);
+     *       }
+     *       ...
+     *       governor.endFrame();
+     *   }
+     * @endcode
+     */
+    class LatencyGovernor {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        /**
+         * A quality level: how the base detection parameters are changed at this level.
+         * Level 0 should leave the parameters unchanged.
+         */
+        struct Level {
+            /** factor applied to handClusterInterval (fewer flood fill seeds) */
+            float handClusterIntervalScale = 1.0f;
+
+            /** amount added to normalResolution (coarser normal map and plane flood fill) */
+            int normalResolutionStep = 0;
+
+            /** if true, the SVM check uses the quantized hand validator (see DetectionParams::handSVMQuantized) */
+            bool quantizeSVM = false;
+
+            /** if true, hand candidates are no longer checked with the SVM */
+            bool disableSVM = false;
+
+            /** planes are only detected every planeInterval frames (1 = every frame) */
+            int planeInterval = 1;
+        };
+
+        /** Governor configuration */
+        struct Config {
+            /** frame budget, in ms */
+            double budgetMs = 1000.0 / 30.0;
+
+            /** quality levels, from full quality (level 0) to cheapest; if empty, uses defaultLevels() */
+            std::vector<Level> levels;
+
+            /** weight of the newest frame in the smoothed frame time, in (0, 1] */
+            double smoothing = 0.2;
+
+            /** consecutive frames over budget before stepping down */
+            int stepDownFrames = 5;
+
+            /** the smoothed frame time must be below this fraction of the budget to count as headroom */
+            double headroom = 0.7;
+
+            /** consecutive frames with headroom before stepping up */
+            int stepUpFrames = 60;
+
+            /** maximum factor by which stepUpFrames grows after failed step ups */
+            int maxStepUpBackoff = 16;
+
+            /** minimum number of frames between two transitions */
+            int cooldownFrames = 10;
+        };
+
+        /** A change of quality level */
+        struct Transition {
+            /** index of the frame at which the transition happened */
+            int64_t frame;
+
+            /** level before and after the transition */
+            int fromLevel, toLevel;
+
+            /** smoothed frame time that triggered the transition, in ms */
+            double frameMs;
+        };
+
+        /** Timing of a named stage */
+        struct StageStats {
+            /** number of times the stage ran */
+            int64_t count = 0;
+
+            /** time taken by the last run, smoothed time, and longest run (ms) */
+            double lastMs = 0.0;
+            double avgMs = 0.0;
+            double maxMs = 0.0;
+        };
+
+        /** Governor metrics */
+        struct Stats {
+            /** current quality level, and number of levels */
+            int level = 0;
+            int numLevels = 0;
+
+            /** frame budget, last frame time, and smoothed frame time (ms) */
+            double budgetMs = 0.0;
+            double lastFrameMs = 0.0;
+            double avgFrameMs = 0.0;
+
+            /** number of frames timed, and number of those over budget */
+            int64_t numFrames = 0;
+            int64_t numFramesOverBudget = 0;
+
+            /** number of frames spent at each level */
+            std::vector<int64_t> framesAtLevel;
+
+            /** number of steps down and up, and number of step ups undone right away */
+            int numStepDowns = 0;
+            int numStepUps = 0;
+            int numFailedStepUps = 0;
+
+            /** most recent transitions, oldest first */
+            std::deque<Transition> recentTransitions;
+
+            /** timing of each stage, by name */
+            std::map<std::string, StageStats> stages;
+
+            /** Returns a human-readable summary of the metrics */
+            std::string toString() const;
+        };
+
+        /** Times a stage of the current frame, from construction to destruction */
+        class StageTimer {
+        public:
+            StageTimer(LatencyGovernor & governor, const std::string & stage);
+            ~StageTimer();
+
+            StageTimer(const StageTimer &) = delete;
+            StageTimer & operator=(const StageTimer &) = delete;
+
+        private:
+            LatencyGovernor & governor;
+            std::string stage;
+            Clock::time_point start;
+        };
+
+        /**
+         * Create a governor with the default configuration.
+         * @param params base (full quality) detection parameters (if not specified, uses default params)
+         */
+        explicit LatencyGovernor(DetectionParams::Ptr params = nullptr);
+
+        /**
+         * Create a governor.
+         * @param params base (full quality) detection parameters (if not specified, uses default params)
+         * @param config governor configuration
+         */
+        LatencyGovernor(DetectionParams::Ptr params, const Config & config);
+
+        /**
+         * Create a governor with the default configuration and a frame budget.
+         * @param params base (full quality) detection parameters
+         * @param budget_ms frame budget in ms
+         */
+        LatencyGovernor(DetectionParams::Ptr params, double budget_ms);
+
+        /**
+         * Register a detector. Its parameters are replaced with the parameters of the current level
+         * now and on each transition (see Detector::setParams).
+         */
+        void addDetector(const Detector::Ptr & detector);
+
+        /**
+         * Change the base (full quality) detection parameters, e.g. when the user toggles an option.
+         * The registered detectors get the new parameters with the current level applied.
+         */
+        void setBaseParams(const DetectionParams::Ptr params);
+
+        /** Returns the detection parameters for the current level */
+        DetectionParams::Ptr getParams() const;
+
+        /** Mark the start of a frame */
+        void beginFrame();
+
+        /**
+         * Mark the end of the frame started by beginFrame(), and change level if needed.
+         * @return the time taken by the frame, in ms
+         */
+        double endFrame();
+
+        /**
+         * Record a frame time measured by the caller (instead of using beginFrame/endFrame),
+         * and change level if needed.
+         */
+        void recordFrame(double frame_ms);
+
+        /** Record the time taken by a stage of the current frame */
+        void recordStage(const std::string & stage, double ms);
+
+        /** Returns true if planes should be detected in the current frame at the current level */
+        bool shouldRunPlanes() const;
+
+        /** Returns the current quality level (0 = full quality) */
+        int getLevel() const;
+
+        /**
+         * Add a function to call on each transition.
+         * WARNING: called from the thread calling endFrame/recordFrame.
+         * @return unique ID for this callback, needed for removeTransitionCallback
+         */
+        int addTransitionCallback(std::function<void(const Transition &)> func);
+
+        /** Remove the transition callback with the specified unique ID */
+        void removeTransitionCallback(int id);
+
+        /** Get a snapshot of the governor metrics */
+        Stats getStats() const;
+
+        /**
+         * Returns the default quality levels: full quality; sparser seeds, coarser normals and the
+         * quantized validator; planes every other frame; no SVM check; planes every 4th frame.
+         */
+        static std::vector<Level> defaultLevels();
+
+        /** Shared pointer to LatencyGovernor instance */
+        typedef std::shared_ptr<LatencyGovernor> Ptr;
+
+    private:
+        /** switch to the given level, recording the transition */
+        void changeLevel(int level, double frame_ms);
+
+        /** compute the parameters for the current level and pass them to the detectors */
+        void applyLevel();
+
+        /** governor configuration */
+        Config config;
+
+        /** base and current-level detection parameters */
+        DetectionParams::Ptr baseParams, levelParams;
+
+        /** registered detectors */
+        std::vector<std::weak_ptr<Detector> > detectors;
+
+        /** start of the current frame */
+        Clock::time_point frameStart;
+
+        /** index of the current frame */
+        int64_t frameIndex = 0;
+
+        /** consecutive frames over budget / with headroom, and frames since the last transition */
+        int framesOver = 0, framesUnder = 0, framesSinceTransition = 0;
+
+        /** stepUpFrames multiplier for each level, doubled when a step up to it fails */
+        std::vector<int> stepUpBackoff;
+
+        /** true if the last transition was a step up */
+        bool lastWasStepUp = false;
+
+        /** metrics */
+        mutable std::mutex mutex;
+        Stats stats;
+        std::map<int, std::function<void(const Transition &)> > callbacks;
+
+        /** maximum number of transitions kept in Stats::recentTransitions */
+        static const size_t MAX_RECENT_TRANSITIONS = 64;
+    };
+}
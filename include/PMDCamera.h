@@ -35,6 +35,12 @@ namespace ark {
         void update(cv::Mat & xyz_map, cv::Mat & rgb_map, cv::Mat & ir_map, 
                              cv::Mat & amp_map, cv::Mat & flag_map) override;
 
+        /**
+         * Close and reopen the PMD sensor.
+         * @return true on success
+         */
+        bool reconnect() override;
+
         /**
          * Get the camera's model name.
          */
@@ -87,6 +93,12 @@ namespace ark {
         */
         float getZ(int i, int j) const;
 
+        /**
+        * Open the sensor and retrieve its data description.
+        * @return true on success
+        */
+        bool openSensor();
+
         // Private Variables
         const char* SOURCE_PLUGIN = "camboardpico";
         const char* SOURCE_PARAM = "";
@@ -96,8 +108,9 @@ namespace ark {
         PMDDataDescription dd;
         char err[128]; // Char array for storing PMD's error log
         int numPixels;
-        float* dists;
-        float* amps;
+        float* dists = nullptr;
+        float* amps = nullptr;
+        unsigned* flags = nullptr;
         cv::Mat frame;
     };
 
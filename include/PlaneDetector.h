@@ -22,11 +22,21 @@ namespace ark {
         typedef std::shared_ptr<PlaneDetector> Ptr;
 
         /** 
-         * Get the normal map from this plane detector, if available 
+         * Get the normal map from this plane detector, if available.
+         * The map is decimated: pixel (i, j) holds the normal at pixel
+         * (i * normalResolution, j * normalResolution) of the frame.
          * @return the normal map; if one is not available, returns an empty image
          */
         cv::Mat getNormalMap();
 
+        /**
+         * Set the pixels to exclude from plane detection in the next update, e.g. the regions of hands
+         * found in the previous frame (see DetectionParams::planeExcludeHands). Excluded pixels are skipped when
+         * computing normals and growing subplanes. May be called from any thread; the mask is copied.
+         * @param mask CV_8U mask of the frame size, nonzero where pixels are excluded. Pass an empty mask to clear.
+         */
+        void setExcludedMask(const cv::Mat & mask);
+
     protected:
         /** Implementation of plane detection algorithm */
         void detect(cv::Mat & image) override;
@@ -36,24 +46,68 @@ namespace ark {
         std::vector<FramePlane::Ptr> planes;
 
         /**
-         * Matrix storing the surface normal vectors (facing viewer) at each point in the observable world.
+         * Matrix storing the surface normal vectors (facing viewer) at every normalResolution-th point
+         * in the observable world, on a contiguous grid of size (frame size / normalResolution).
          * This is computed automatically from the depth map if required.
          * Implementers of subclasses do not need to deal with this at all.
          * Matrix type CV_32FC3
          */
         cv::Mat normalMap;
 
+        /** connectivity map of the normal map, used for growing subplanes (see util::computeConnectivityMap) */
+        cv::Mat connectivityMap;
+
+        /** pixels excluded by setExcludedMask, and the mask used by the current update (buffers swapped each update) */
+        cv::Mat excludedMask, frameExcludedMask;
+        bool excludedMaskPending = false;
+        std::mutex excludedMaskMutex;
+
+        /**
+         * Scratch buffers for plane detection, kept across frames so that no scratch memory
+         * is allocated per frame or per subplane in steady state.
+         * Buffers are reallocated only when the frame size changes.
+         */
+        struct Workspace {
+            /** decimated frame size the workspace is allocated for */
+            cv::Size size;
+
+            /** flood fill 'visited' map */
+            cv::Mat floodFillMap;
+
+            /** decimated xyz map, matching the normal map (allocated by util::computeDecimatedNormalMap) */
+            cv::Mat xyzMap;
+
+            /** points of the current subplane */
+            std::vector<Point2i> allIndices;
+            std::vector<Vec3f> allXyzPoints;
+
+            /** per-plane results of the refinement step */
+            std::vector<char> planeAccepted;
+
+            /** plane objects constructed for the current frame */
+            std::vector<FramePlane::Ptr> candidates;
+
+            /** prepare the workspace for a decimated frame of the given size */
+            void prepare(cv::Size frame_size);
+        };
+
+        /** workspace of this detector */
+        Workspace workspace;
+
         /**
-         * helper function for getting the equations of planes given xyz and normal maps.
-         * @param[in] xyz_map the xyz map
-         * @param[in] normal_map the normal map
+         * helper function for getting the equations of planes given decimated xyz and normal maps
+         * (see util::computeDecimatedNormalMap).
+         * @param[in] xyz_map the decimated xyz map; points with zero depth are skipped
+         * @param[in] normal_map the decimated normal map
          * @param[out] output_equations vector to be filled with equations of planes (in the form ax + by - z + c = 0)
-         * @param[out] output_points vector to be filled with vectors of ij coordinate points on planes
+         * @param[out] output_points vector to be filled with vectors of ij coordinate points on planes,
+         *                           in full resolution frame coordinates
          * @param[out] output_points_xyz vector to be filled with vectors of xyz coordinate points on planes
+         * @param[in] resolution decimation factor of the maps
          * @param[in] params plane detection parameters
          */
         void detectPlaneHelper(const cv::Mat & xyz_map, const cv::Mat & normal_map, std::vector<Vec3f> & output_equations,
             std::vector<VecP2iPtr> & output_points, std::vector<VecV3fPtr> & output_points_xyz,
-            DetectionParams::Ptr params = nullptr);
+            int resolution, DetectionParams::Ptr params = nullptr);
     };
 }
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/filters/voxel_grid.h>
+#include <memory>
+#include <vector>
+
+#include "Version.h"
+
+namespace ark {
+    /**
+     * Bridge from OpenARK XYZ maps (CV_32FC3) to organized PCL point clouds.
+     *
+     * pcl::PointXYZ is padded to 16 bytes, so a XYZ map can't be reinterpreted directly; instead each
+     * frame is converted with a single pass over the map into a pooled, preallocated cloud
+     * (pixel (r, c) maps to cloud->at(c, r); pixels without depth become NaN and the cloud is marked non-dense).
+     * Clouds are recycled once no one else holds a pointer to them, so steady-state conversion does not allocate.
+     *
+     * Usage: keep one adapter per consumer and call convert() on each new XYZ map.
+     */
+    class PointCloudAdapter {
+    public:
+        /** PCL point cloud type produced by the adapter */
+        typedef pcl::PointCloud<pcl::PointXYZ> Cloud;
+
+        /**
+         * Create a new adapter.
+         * @param pool_size maximum number of clouds kept for reuse
+         */
+        explicit PointCloudAdapter(int pool_size = 2);
+
+        /**
+         * Convert a XYZ map into an organized point cloud.
+         * @param xyz_map the XYZ map (CV_32FC3)
+         * @return organized cloud with width = xyz_map.cols and height = xyz_map.rows
+         */
+        Cloud::Ptr convert(const cv::Mat & xyz_map);
+
+        /**
+         * Convert a XYZ map into a voxel grid downsampled (unorganized) point cloud.
+         * @param xyz_map the XYZ map (CV_32FC3)
+         * @param leaf_size voxel size, in meters
+         * @return downsampled cloud
+         */
+        Cloud::Ptr convertDownsampled(const cv::Mat & xyz_map, float leaf_size = 0.01f);
+
+        /** Release all pooled clouds */
+        void clear();
+
+        /**
+         * Get a CV_32FC4 matrix header over an organized cloud's memory (no data is copied).
+         * Channels are x, y, z and padding; the header is valid as long as the cloud is not resized.
+         */
+        static cv::Mat wrap(Cloud & cloud);
+
+        /** Shared pointer to PointCloudAdapter instance */
+        typedef std::shared_ptr<PointCloudAdapter> Ptr;
+
+    private:
+        /** get a cloud of the given size from the pool, allocating one if none is free */
+        Cloud::Ptr acquire(int rows, int cols);
+
+        /** pooled clouds */
+        std::vector<Cloud::Ptr> pool;
+
+        /** maximum pool size */
+        int poolSize;
+
+        /** filter used for downsampling */
+        pcl::VoxelGrid<pcl::PointXYZ> voxelGrid;
+    };
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/ml.hpp>
+
+#include "Version.h"
+
+namespace ark {
+    namespace classifier {
+        /**
+         * Compact copy of a trained (OpenCV) regression SVM for fast, low-memory evaluation.
+         *
+         * Support vectors are stored as int8 or fp16, after mapping each feature to [-1, 1] with a
+         * per-feature offset and scale computed from the support vectors' range. Decision values are
+         * evaluated directly on the quantized vectors with SIMD instructions where available.
+         * Supports EPS_SVR and NU_SVR models with LINEAR or RBF kernels.
+         */
+        class QuantizedSVM {
+        public:
+            /** Storage precision of the support vectors */
+            enum Precision {
+                /** 8-bit integers, 1 byte per feature */
+                PRECISION_INT8 = 0,
+                /** IEEE half-precision floats, 2 bytes per feature */
+                PRECISION_FP16
+            };
+
+            /** Accuracy and cost of a quantized model compared to its float model */
+            struct AccuracyReport {
+                /** number of samples compared */
+                int numSamples = 0;
+
+                /** mean and maximum absolute difference between float and quantized predictions */
+                double meanAbsError = 0.0;
+                double maxAbsError = 0.0;
+
+                /** number of samples for which both models make the same hand / not hand decision (threshold 0.5) */
+                int numAgree = 0;
+
+                /** total prediction time of the float and quantized models (ms) */
+                double floatMs = 0.0;
+                double quantizedMs = 0.0;
+
+                /** support vector storage of the float and quantized models (bytes) */
+                size_t floatBytes = 0;
+                size_t quantizedBytes = 0;
+
+                /** Returns a human-readable summary of the report */
+                std::string toString() const;
+            };
+
+            /** Create an empty quantized model */
+            QuantizedSVM();
+
+            /**
+             * Create a quantized copy of a trained SVM.
+             * @param svm the trained model
+             * @param precision storage precision of the support vectors
+             * @return false if the model is not trained or its type or kernel is not supported
+             */
+            bool quantize(const cv::Ptr<cv::ml::SVM> & svm, Precision precision = PRECISION_INT8);
+
+            /** Returns true if this model holds a quantized SVM */
+            bool isTrained() const;
+
+            /** Returns the storage precision of the support vectors */
+            Precision getPrecision() const;
+
+            /** Returns the number of features the model expects */
+            int getNumFeatures() const;
+
+            /** Returns the memory used by the support vectors and their coefficients (bytes) */
+            size_t getModelBytes() const;
+
+            /**
+             * Evaluate the model on a feature vector.
+             * @param features feature vector (CV_32F, 1 x getNumFeatures())
+             * @return the regression value, as cv::ml::SVM::predict would return
+             */
+            float predict(const cv::Mat & features) const;
+
+            /**
+             * Compare a quantized model to the float model it was made from.
+             * @param svm the float model
+             * @param quantized the quantized model
+             * @param samples samples to compare on (CV_32F; one sample per row)
+             */
+            static AccuracyReport compare(const cv::Ptr<cv::ml::SVM> & svm, const QuantizedSVM & quantized,
+                                          const cv::Mat & samples);
+
+            /** Shared pointer to QuantizedSVM instance */
+            typedef std::shared_ptr<QuantizedSVM> Ptr;
+
+        private:
+            /** squared distance from the normalized sample to support vector i, in original units */
+            float distanceSq(const float * x, int i) const;
+
+            /** dot product of the scaled sample with quantized support vector i */
+            float dot(const float * x, int i) const;
+
+            /** decode support vector i into buf (fp16 only) */
+            void decode(int i, float * buf) const;
+
+            Precision precision = PRECISION_INT8;
+            int kernel = -1;
+            float gamma = 0.0f;
+            float rho = 0.0f;
+
+            int numVectors = 0;
+            int numFeatures = 0;
+
+            /** number of features per stored vector, padded to a multiple of the SIMD width */
+            int stride = 0;
+
+            /** coefficient of each support vector */
+            std::vector<float> alpha;
+
+            /** per-feature offset and scale: value = offset + scale * q */
+            std::vector<float> offset, scale, scaleSq;
+
+            /** quantized support vectors, row-major with the padded stride */
+            std::vector<int8_t> vectors8;
+            std::vector<uint16_t> vectors16;
+        };
+    }
+}
@@ -1,27 +1,95 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
 #include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+#include <boost/thread/thread.hpp>
+
 #include "Version.h"
+#include "ThreadConfig.h"
 
 namespace ark {
     /**
     * Abstract class that defines the behavior of a RGB camera.
+    *
+    * The camera may be read synchronously (update(), then getFrame()) or captured on its own thread
+    * with beginCapture(), in which case the most recent frames are kept in a small timestamped ring
+    * (see getLatestFrame() and getFrameNear()). Timestamps use the same clock as
+    * DepthCamera::getLastFrameTime(), so that RGB frames can be aligned to depth frames (see FrameMatcher).
     */
     class RGBCamera
     {
     public:
-        virtual ~RGBCamera() = default;
+        /** Clock used for frame timestamps */
+        typedef std::chrono::steady_clock Clock;
+
+        /** A timestamped frame */
+        struct Frame {
+            /** the image (empty if no frame is available) */
+            cv::Mat image;
+
+            /** time at which the frame was grabbed */
+            Clock::time_point timestamp;
+
+            /** index of the frame since capture began */
+            long long index = -1;
+        };
+
+        virtual ~RGBCamera();
         /**
         * Updates the current frame on the RGB camera.
         * Should be overriden by a concerte implementation specific to the RGB camera
+        * Implementations should set frameTime to the time the frame was grabbed.
         */
         virtual void update();
 
         /**
-        * Returns the current frame.
+        * Returns the current frame (the most recent frame in the ring, if capturing asynchronously).
         * @return the current frame
         */
         cv::Mat getFrame() const;
 
+        /**
+        * Begin capturing frames continuously on a separate thread.
+        * @param ring_size number of recent frames to keep
+        * @param config configuration of the capture thread
+        */
+        void beginCapture(int ring_size = 4, const ThreadConfig & config = ThreadConfig("ark-rgb"));
+
+        /**
+        * Stop capturing frames on the capture thread.
+        */
+        void endCapture();
+
+        /**
+        * Returns true if the camera is capturing on a separate thread.
+        */
+        bool isCapturing() const;
+
+        /**
+        * Returns the most recent frame captured on the capture thread (an empty frame if there is none).
+        */
+        Frame getLatestFrame() const;
+
+        /**
+        * Find the captured frame closest in time to a given time point.
+        * @param time the time point to match
+        * @param tolerance_ms maximum allowed difference between the frame's timestamp and time, in ms
+        * @param [out] frame the closest frame
+        * @param [out] skew_ms optionally, the frame's timestamp minus time, in ms
+        * @return true if a frame within the tolerance was found
+        */
+        bool getFrameNear(Clock::time_point time, double tolerance_ms,
+                          Frame & frame, double * skew_ms = nullptr) const;
+
+        /**
+        * Returns true if a frame captured at or after the given time point is in the ring,
+        * i.e. no frame that is closer to time than the ones already captured can arrive anymore.
+        */
+        bool hasFrameAfter(Clock::time_point time) const;
+
     protected:
         /**
         * Camera handle.
@@ -32,5 +100,32 @@ namespace ark {
         * Current frame.
         */
         cv::Mat frame;
+
+        /**
+        * Time at which the current frame was grabbed (set by update()).
+        */
+        Clock::time_point frameTime;
+
+    private:
+        /** main loop of the capture thread */
+        void captureLoop();
+
+        /** recent frames, oldest first */
+        std::deque<Frame> ring;
+
+        /** maximum number of frames in the ring */
+        size_t ringSize = 4;
+
+        /** number of frames captured since capture began */
+        long long frameIndex = 0;
+
+        /** mutex protecting the ring */
+        mutable std::mutex ringMutex;
+
+        /** capture thread */
+        boost::thread captureThread;
+
+        /** true while the capture thread should keep running */
+        std::atomic<bool> capturing{ false };
     };
 }
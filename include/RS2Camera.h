@@ -21,8 +21,14 @@ namespace ark {
         * Public constructor initializing the RealSense Camera.
         * @param use_rgb_stream if true, uses the RGB stream and disable the IR stream (which is on by default)
         *                       This results in a smaller field of view and has an appreciable performance cost.
+        * @param decimation factor by which the depth stream is decimated by librealsense before projection
+        *                   (1 to disable). The XYZ map and IR/RGB images are reduced to
+        *                   (width / decimation) x (height / decimation).
+        * @param min_depth, max_depth depth range (meters) kept by librealsense's threshold filter before projection;
+        *                   pixels outside the range are never projected. (0 to disable each bound)
         */
-        explicit RS2Camera(bool use_rgb_stream = false);
+        explicit RS2Camera(bool use_rgb_stream = false, int decimation = 1,
+                           float min_depth = 0.0f, float max_depth = 0.0f);
 
         /**
         * Destructor for the RealSense Camera.
@@ -56,6 +62,22 @@ namespace ark {
          */
         bool hasIRMap() const override;
 
+        /**
+         * Set the depth range (meters) kept by the threshold filter applied before projection.
+         * May be called while capturing; takes effect from the next frame.
+         * @param min_depth, max_depth depth range (0 to disable each bound)
+         */
+        void setDepthRange(float min_depth, float max_depth);
+
+        /** Get the decimation factor applied to the depth stream */
+        int getDecimation() const;
+
+        /**
+         * Restart the RealSense pipeline, re-querying the device and its intrinsics.
+         * @return true on success
+         */
+        bool reconnect() override;
+
         /** Shared pointer to SR300 camera instance */
         typedef std::shared_ptr<RS2Camera> Ptr;
 
@@ -75,8 +97,32 @@ namespace ark {
         /** Converts an RS2 raw depth image to an ordered point cloud based on the current camera's intrinsics */
         void project(const rs2::frame depth_frame, cv::Mat & xyz_map);
 
-        /** Query RealSense camera intrinsics */
-        void query_intrinsics();
+        /**
+         * Query RealSense camera intrinsics and the size of the streams
+         * @return false if no camera with a depth stream is connected
+         */
+        bool query_intrinsics();
+
+        /**
+         * Configure the streams for the channels of the current frame, start the pipeline
+         * and update the stream intrinsics, extrinsics and depth scale (capture thread only)
+         */
+        void start_pipeline();
+
+        /** Restart the pipeline if the RGB/IR stream needs to be enabled or disabled */
+        void onChannelsChanged() override;
+
+        /** Copy (and downscale, if decimating) a color or IR frame into an image of the output size */
+        void copyImage(const rs2::frame & frame, cv::Mat & image, int type);
+
+        /**
+         * Convert the device timestamp of a frame to the steady clock
+         * @param frame the frame
+         * @param arrival steady clock time at which the frame was received
+         * @param arrival_system system clock time at which the frame was received
+         */
+        std::chrono::steady_clock::time_point captureTime(const rs2::frame & frame,
+            std::chrono::steady_clock::time_point arrival, std::chrono::system_clock::time_point arrival_system);
 
         // internal storage
         std::shared_ptr<rs2::pipeline> pipe;
@@ -90,8 +136,34 @@ namespace ark {
         // pointer to depth-to-RGB extrinsics (RealSense C API: rs_intrinsics)
         void * d2rExtrinsics = nullptr;
 
+        /** filters applied to the raw depth frames before projection */
+        rs2::decimation_filter decimationFilter;
+        rs2::threshold_filter thresholdFilter;
+
+        /** requested depth range of the threshold filter, and the range currently applied (capture thread only) */
+        float minDepth, maxDepth;
+        float appliedMinDepth = -1.0f, appliedMaxDepth = -1.0f;
+        std::mutex depthRangeMutex;
+
         double scale;
+        /** size of the output images (the sensor size divided by the decimation factor) */
         int width, height;
+        /** size of the sensor streams */
+        int sensorWidth, sensorHeight;
+        int decimation;
         bool useRGBStream;
+        /** true if the RGB/IR stream is enabled in the current configuration */
+        bool imageStreamEnabled = false;
+        /**
+         * true once the pipeline is started; it is started by the first update() rather than the constructor,
+         * so that channels subscribed before capture begins are enabled without restarting it
+         */
+        bool pipelineStarted = false;
+
+        /**
+         * offset from the device's hardware clock to the steady clock (ms): the smallest delay between
+         * capture and arrival seen so far, and the last hardware timestamp (to detect the clock wrapping)
+         */
+        double hardwareClockOffset = 0.0, lastHardwareTimestamp = -1.0;
     };
 }
@@ -56,6 +56,12 @@ namespace ark {
          */
         bool hasIRMap() const override;
 
+        /**
+         * Close and reinitialize the SenseManager pipeline.
+         * @return true on success
+         */
+        bool reconnect() override;
+
         /** Shared pointer to SR300 camera instance */
         typedef std::shared_ptr<SR300Camera> Ptr;
 
@@ -67,6 +73,9 @@ namespace ark {
         void update(cv::Mat & xyz_map, cv::Mat & rgb_map, cv::Mat & ir_map, 
                             cv::Mat & amp_map, cv::Mat & flag_map) override;
 
+        /** Reinitialize the pipeline if the IR stream needs to be enabled or disabled */
+        void onChannelsChanged() override;
+
     private:
         /**
         * Getter method for the x-coordinate at (i,j).
@@ -94,10 +103,12 @@ namespace ark {
 
         /**
          * Initialize the camera, opening channels and resetting to initial configurations
+         * @return true on success
          */
-        void initCamera();
+        bool initCamera();
 
         // Private Variables
+        bool irStreamEnabled = false;
         float* dists;
         float* amps;
         cv::Mat frame;
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "Version.h"
+#include "Hand.h"
+#include "HandClassifier.h"
+
+namespace ark {
+    namespace classifier {
+        /**
+         * Classifies a stream of hands with a SVMHandClassifier, only re-running the classifier
+         * when a hand's geometry changes.
+         *
+         * Hands are tracked across frames by palm center. A tracked hand is reclassified when its number of
+         * fingers changes, its palm center moves, or its contour signature (radial profile of the contour)
+         * changes by more than a threshold since it was last classified, and in any case every maxSkipFrames
+         * frames; otherwise its last result is reused. Each track keeps a buffer of its recent votes, and its
+         * label is only reported once enough votes agree. A confident result after a geometry change is
+         * accepted immediately, so that changes of gesture are reported with little added latency.
+         * Hands without fingers are not passed to the classifier (which has no SVM for them): they vote negative.
+         *
+         * Example:
+         * @code
+         *   SVMHandClassifier svm(paths);
+         *   StreamingHandClassifier stream(svm);
+         *   // each frame
+         *   auto results = stream.update(handDetector->getHands());
+         * @endcode
+         */
+        class StreamingHandClassifier {
+        public:
+            /** Streaming classifier configuration */
+            struct Config {
+                /** classifier output at or above which a vote counts as positive */
+                float threshold = 0.5f;
+
+                /** number of recent votes kept per hand */
+                int voteFrames = 5;
+
+                /** number of agreeing votes needed for a label to be reported */
+                int minVotes = 3;
+
+                /**
+                 * if a hand is reclassified after a geometry change and the output is at least this far from
+                 * the threshold, the vote buffer is reset to the new result, which is reported right away
+                 */
+                float confidentMargin = 0.3f;
+
+                /** distance (m) the palm center may move before the hand is reclassified */
+                float palmMoveThreshold = 0.01f;
+
+                /** mean change in the (normalized) contour signature before the hand is reclassified */
+                float signatureThreshold = 0.08f;
+
+                /** maximum number of consecutive frames the classifier may be skipped for a hand */
+                int maxSkipFrames = 30;
+
+                /** maximum distance (m) a palm center may move between frames to stay on the same track */
+                float maxHandDistance = 0.15f;
+
+                /** number of frames a hand may go undetected before its track is dropped */
+                int maxMissedFrames = 3;
+            };
+
+            /** Classification result for a hand */
+            struct Result {
+                /** ID of the hand's track (stays the same while the hand is tracked) */
+                int trackId;
+
+                /** mean classifier output over the vote buffer */
+                float confidence;
+
+                /** stable label: 1 if positive, 0 if negative, -1 if the votes do not agree yet */
+                int label;
+
+                /** true if the classifier was run on the hand in this frame */
+                bool classified;
+            };
+
+            /** Streaming classifier statistics */
+            struct Stats {
+                /** number of hands processed (summed over frames) */
+                long long numHands = 0;
+
+                /** number of times the classifier was run, and skipped */
+                long long numClassified = 0;
+                long long numSkipped = 0;
+
+                /** reasons for running the classifier (a run may have several) */
+                long long numNewTracks = 0;
+                long long numFingerChanges = 0;
+                long long numPalmMoves = 0;
+                long long numContourChanges = 0;
+                long long numRefreshes = 0;
+
+                /** number of times the stable label of a track changed */
+                long long numLabelChanges = 0;
+            };
+
+            /**
+             * Create a streaming classifier.
+             * @param classifier the trained classifier to run; must outlive the streaming classifier
+             */
+            explicit StreamingHandClassifier(const SVMHandClassifier & classifier);
+
+            /**
+             * Create a streaming classifier.
+             * @param classifier the trained classifier to run; must outlive the streaming classifier
+             * @param config streaming classifier configuration
+             */
+            StreamingHandClassifier(const SVMHandClassifier & classifier, const Config & config);
+
+            /**
+             * Classify the hands of a frame.
+             * @param hands hands detected in the frame
+             * @return one result per hand, in the same order
+             */
+            std::vector<Result> update(const std::vector<Hand::Ptr> & hands);
+
+            /** Drop all tracks (statistics are kept) */
+            void reset();
+
+            /** Get the streaming classifier statistics */
+            const Stats & getStats() const;
+
+            /** Shared pointer to StreamingHandClassifier instance */
+            typedef std::shared_ptr<StreamingHandClassifier> Ptr;
+
+        private:
+            /** number of angular bins in a contour signature */
+            static const int SIGNATURE_BINS = 16;
+
+            /** a tracked hand */
+            struct Track {
+                int id;
+
+                /** palm center in the last frame, and geometry when the hand was last classified */
+                Vec3f palm, classifiedPalm;
+                int classifiedFingers;
+                std::vector<float> classifiedSignature;
+
+                /** last classifier output, recent votes, and stable label */
+                float lastOutput = 0.0f;
+                std::deque<float> votes;
+                int label = -1;
+
+                /** frames since the hand was last classified, and consecutive frames not detected */
+                int framesSkipped = 0;
+                int missed = 0;
+            };
+
+            /**
+             * classify a hand and update its track
+             * @return true if the classifier was run (false for hands without fingers)
+             */
+            bool classify(Track & track, Hand & hand, int num_fingers, std::vector<float> & signature,
+                          bool allow_reset);
+
+            /** update the stable label of a track from its votes */
+            void updateLabel(Track & track);
+
+            /** compute the radial profile of a contour around its centroid, normalized by its mean radius */
+            static void computeSignature(const std::vector<Point2i> & contour, std::vector<float> & signature);
+
+            /** classifier to run */
+            const SVMHandClassifier & classifier;
+
+            /** streaming classifier configuration */
+            Config config;
+
+            /** tracked hands */
+            std::vector<Track> tracks;
+            int nextTrackId = 0;
+
+            /** statistics */
+            Stats stats;
+        };
+    }
+}
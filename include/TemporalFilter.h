@@ -0,0 +1,110 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <memory>
+
+#include "Version.h"
+
+namespace ark {
+    /**
+     * Temporal denoising filter for XYZ maps.
+     * Time-of-flight and stereo depth flickers from frame to frame, mostly around object edges,
+     * which causes spurious clusters in the detectors downstream. This filter smooths the depth
+     * of each pixel across consecutive frames, either with an exponential moving average
+     * (reset whenever the depth jumps, so that real edges are not smeared) or with a running median.
+     *
+     * Only the depth (z) channel is filtered; x and y are rescaled along the pixel's viewing ray
+     * so that the point stays on the same pixel. Pixels with no depth in the current frame are left empty.
+     *
+     * All per-pixel state lives in one contiguous buffer which is allocated once per resolution
+     * and then reused for every frame.
+     * @see DepthCamera::setTemporalFilter
+     */
+    class TemporalFilter {
+    public:
+        /** Filtering modes */
+        enum Mode {
+            /** exponential moving average with edge-aware reset */
+            EXPONENTIAL,
+            /** per-pixel median of the valid (nonzero) depths among the last 'window' frames */
+            MEDIAN
+        };
+
+        /** Maximum supported median window size (frames) */
+        static const int MAX_WINDOW = 9;
+
+        /**
+         * Construct a new temporal filter.
+         * @param mode filtering mode
+         * @param alpha smoothing factor for EXPONENTIAL mode, in (0, 1]; higher values follow the input more closely
+         * @param reset_thresh depth difference (in meters) above which the EXPONENTIAL state is reset to the new depth
+         * @param window number of frames for MEDIAN mode (odd; clamped to [1, MAX_WINDOW])
+         */
+        explicit TemporalFilter(Mode mode = EXPONENTIAL, float alpha = 0.4f,
+                                float reset_thresh = 0.02f, int window = 3);
+
+        /**
+         * Filter an XYZ map in place, updating the filter's state.
+         * The state is reset automatically if the size of the map changes.
+         * @param [in, out] xyz_map the XYZ map (CV_32FC3)
+         */
+        void apply(cv::Mat & xyz_map);
+
+        /**
+         * Discard all past frames (e.g. after the camera was reconnected).
+         * May be called from any thread: the state is cleared at the start of the next apply().
+         */
+        void reset();
+
+        /** Get the filtering mode */
+        Mode getMode() const;
+
+        /** Get the number of frames used in MEDIAN mode */
+        int getWindow() const;
+
+        /** Shared pointer to TemporalFilter instance */
+        typedef std::shared_ptr<TemporalFilter> Ptr;
+
+    private:
+        /** EXPONENTIAL mode implementation */
+        void applyExponential(cv::Mat & xyz_map);
+
+        /** MEDIAN mode implementation */
+        void applyMedian(cv::Mat & xyz_map);
+
+        /** (re)allocate the state buffer for the given frame size, if needed */
+        void allocate(cv::Size size);
+
+        /** filtering mode */
+        Mode mode;
+
+        /** EXPONENTIAL smoothing factor */
+        float alpha;
+
+        /** EXPONENTIAL reset threshold (meters) */
+        float resetThresh;
+
+        /** MEDIAN window size (frames) */
+        int window;
+
+        /**
+         * Filter state (CV_32F). In EXPONENTIAL mode, holds the smoothed depth (rows x cols).
+         * In MEDIAN mode, holds a ring of the last 'window' depth frames, stacked vertically
+         * (window * rows x cols).
+         */
+        cv::Mat state;
+
+        /** size of the frames the state was allocated for */
+        cv::Size stateSize;
+
+        /** MEDIAN mode: index of the ring slot to write the next frame to */
+        int ringHead = 0;
+
+        /** MEDIAN mode: number of valid frames in the ring */
+        int ringFilled = 0;
+
+        /** set by reset(), so that the state is only touched by the thread calling apply() */
+        std::atomic<bool> resetRequested{ false };
+    };
+}
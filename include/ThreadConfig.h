@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+#include "Version.h"
+
+namespace ark {
+    /**
+     * Configuration of an OpenARK thread (capture, detection worker, recorder, ...):
+     * name, CPU affinity, scheduling policy and priority, and stack size.
+     *
+     * Settings that cannot be applied on the current platform or without privileges
+     * (e.g. real-time scheduling for an unprivileged user) are skipped with a warning;
+     * use current() or the effective configuration reported by applyToCurrentThread() to see
+     * what actually took effect.
+     */
+    struct ThreadConfig {
+        /** Scheduling policies */
+        enum Policy {
+            /** the operating system's default time-sharing policy */
+            POLICY_DEFAULT = 0,
+            /** real-time first-in first-out (SCHED_FIFO on Linux; time-critical thread priority on Windows) */
+            POLICY_FIFO,
+            /** real-time round-robin (SCHED_RR on Linux; time-critical thread priority on Windows) */
+            POLICY_RR
+        };
+
+        /** thread name, shown by debuggers and tools like top (truncated to 15 characters on Linux) */
+        std::string name;
+
+        /** CPUs the thread may run on (empty: no restriction) */
+        std::vector<int> affinity;
+
+        /** scheduling policy */
+        Policy policy = POLICY_DEFAULT;
+
+        /**
+         * Scheduling priority. For real-time policies, this is the real-time priority
+         * (clamped to the range supported by the system, 1-99 on Linux; higher is more important).
+         * For POLICY_DEFAULT, this is a niceness offset (-20 to 19; lower is more important, 0 to leave unchanged).
+         */
+        int priority = 0;
+
+        /** stack size in bytes (0: system default). Only takes effect for threads started with launch(). */
+        size_t stackSize = 0;
+
+        /** Construct a default configuration (nothing is changed when applied) */
+        ThreadConfig();
+
+        /** Construct a configuration with the given name, and default settings otherwise */
+        explicit ThreadConfig(const std::string & name);
+
+        /**
+         * Apply this configuration (except stack size) to the calling thread.
+         * @param [out] effective optionally, receives the settings that actually took effect
+         * @return true if all settings were applied
+         */
+        bool applyToCurrentThread(ThreadConfig * effective = nullptr) const;
+
+        /**
+         * Start a new thread with this configuration, running fn.
+         * The configuration is applied by the new thread before fn is called.
+         */
+        boost::thread launch(std::function<void()> fn) const;
+
+        /**
+         * Query the effective settings of the calling thread from the operating system.
+         * Settings the platform does not report are taken from the last configuration applied to the thread.
+         */
+        static ThreadConfig current();
+
+        /** Returns a human-readable description of this configuration */
+        std::string toString() const;
+    };
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Version.h"
+#include "ThreadConfig.h"
+
+namespace ark {
+    /**
+     * Work-stealing thread pool shared by all parallel stages of OpenARK
+     * (normal map computation, plane segmentation, per-hand analysis, SVM training, frame recording, ...).
+     *
+     * Each worker owns a queue; tasks submitted from a worker go to its own queue (LIFO for locality),
+     * and idle workers steal from the other queues (FIFO). Tasks submitted from outside the pool go to
+     * a shared queue. Higher priority tasks are always taken first.
+     *
+     * A global pool (see global()) is used by default, so that several cameras and detectors
+     * share the same cores predictably instead of each spawning their own threads.
+     * @see TaskGroup
+     */
+    class ThreadPool {
+    public:
+        /** Task priorities */
+        enum Priority {
+            /** latency-critical work, e.g. per-frame detection */
+            HIGH = 0,
+            /** default priority */
+            NORMAL = 1,
+            /** background work, e.g. writing recordings to disk */
+            LOW = 2
+        };
+
+        /** Number of distinct priorities */
+        static const int NUM_PRIORITIES = 3;
+
+        /**
+         * Create a new thread pool.
+         * @param num_workers number of worker threads. If not positive, uses one worker per hardware thread.
+         * @param cpu_affinity CPUs to pin workers to; worker i is pinned to cpu_affinity[i % size].
+         *                     If empty, workers use the affinity from worker_config.
+         * @param worker_config configuration of the worker threads; worker i is named "<name>-i"
+         */
+        explicit ThreadPool(int num_workers = -1, const std::vector<int> & cpu_affinity = std::vector<int>(),
+                            const ThreadConfig & worker_config = ThreadConfig("ark-worker"));
+
+        /**
+         * Destroy the pool, finishing all queued tasks before joining the workers.
+         */
+        ~ThreadPool();
+
+        /**
+         * Submit a task to the pool.
+         * @param task the task
+         * @param priority task priority
+         */
+        void submit(std::function<void()> task, Priority priority = NORMAL);
+
+        /**
+         * Run body(start, end) over sub-ranges of [begin, end) in parallel and wait for completion.
+         * The calling thread also participates.
+         * @param begin, end the range
+         * @param body function to call on each sub-range
+         * @param grain minimum size of each sub-range. If not positive, chosen automatically.
+         * @param priority task priority
+         */
+        void parallelFor(int begin, int end, const std::function<void(int, int)> & body,
+                         int grain = 0, Priority priority = HIGH);
+
+        /**
+         * Run one queued task on the calling thread, if there is one.
+         * Used to help the pool while waiting for tasks to complete.
+         * @param max_priority only run tasks of at least this priority
+         * @return true if a task was run
+         */
+        bool runPendingTask(Priority max_priority = LOW);
+
+        /** Get the number of worker threads in this pool */
+        int getNumWorkers() const;
+
+        /** Get the index of the calling thread within this pool's workers (-1 if not a worker) */
+        int getWorkerIndex() const;
+
+        /** Get the number of tasks that are queued but not yet started */
+        int getNumPending() const;
+
+        /** Get the effective configuration of a worker thread, as reported by the worker once started */
+        ThreadConfig getWorkerConfig(int index) const;
+
+        /**
+         * Get the global thread pool, creating it on first use.
+         * @see configureGlobal
+         */
+        static ThreadPool & global();
+
+        /**
+         * Set the number of workers, CPU affinity and thread configuration of the global thread pool.
+         * Must be called before the global pool is first used, otherwise has no effect.
+         * @return true if the configuration will be applied
+         */
+        static bool configureGlobal(int num_workers, const std::vector<int> & cpu_affinity = std::vector<int>(),
+                                    const ThreadConfig & worker_config = ThreadConfig("ark-worker"));
+
+        /**
+         * Get the background thread pool, creating it on first use.
+         * This is a single low-priority worker used for I/O such as recording frames to disk,
+         * so that slow writes never occupy the detection workers.
+         * @see configureBackground
+         */
+        static ThreadPool & background();
+
+        /**
+         * Set the thread configuration of the background pool's worker (default: "ark-recorder", niceness 10).
+         * Must be called before the background pool is first used, otherwise has no effect.
+         * @return true if the configuration will be applied
+         */
+        static bool configureBackground(const ThreadConfig & worker_config);
+
+        /** Shared pointer to ThreadPool instance */
+        typedef std::shared_ptr<ThreadPool> Ptr;
+
+    private:
+        /** a queue of tasks for each priority */
+        struct TaskQueue {
+            std::mutex mutex;
+            std::deque<std::function<void()> > tasks[NUM_PRIORITIES];
+        };
+
+        /** worker thread main loop */
+        void workerLoop(int index);
+
+        /** take a task from the queues, in priority order; 'self' is the caller's worker index or -1 */
+        bool takeTask(int self, std::function<void()> & task, Priority max_priority = LOW);
+
+        /** worker threads */
+        std::vector<boost::thread> workers;
+
+        /** effective configuration of each worker */
+        std::vector<ThreadConfig> workerConfigs;
+        mutable std::mutex workerConfigMutex;
+
+        /** one queue per worker, followed by the shared queue for tasks submitted from outside the pool */
+        std::vector<std::unique_ptr<TaskQueue> > queues;
+
+        /** number of queued tasks */
+        std::atomic<int> pending;
+
+        /** true when the pool is being destroyed */
+        std::atomic<bool> stopping;
+
+        /** used to put idle workers to sleep */
+        std::mutex sleepMutex;
+        std::condition_variable sleepCondition;
+    };
+
+    /**
+     * A group of tasks run on a thread pool, which can be waited on together.
+     * A continuation may be attached to run on the pool once all tasks in the group complete.
+     * If a task throws, the first exception is rethrown by wait().
+     */
+    class TaskGroup {
+    public:
+        /**
+         * Create a new task group.
+         * @param pool the pool to run tasks on (default: the global pool)
+         * @param priority priority of tasks in this group
+         */
+        explicit TaskGroup(ThreadPool & pool = ThreadPool::global(),
+                           ThreadPool::Priority priority = ThreadPool::NORMAL);
+
+        /** Waits for all tasks in the group before destroying it */
+        ~TaskGroup();
+
+        /** Add a task to the group and submit it to the pool */
+        void run(std::function<void()> task);
+
+        /**
+         * Wait for all tasks in the group to complete, running queued tasks on the calling thread meanwhile.
+         * Rethrows the first exception thrown by a task, if any.
+         */
+        void wait();
+
+        /**
+         * Set a function to submit to the pool when all tasks in the group have completed.
+         * If the group is already complete, the continuation is submitted immediately.
+         */
+        void then(std::function<void()> continuation);
+
+        /** Returns true if all tasks in the group have completed */
+        bool done() const;
+
+    private:
+        /** state shared with the submitted tasks */
+        struct State {
+            std::atomic<int> remaining;
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::function<void()> continuation;
+            std::exception_ptr exception;
+        };
+
+        /** mark a task as finished */
+        static void finish(const std::shared_ptr<State> & state, ThreadPool & pool,
+                           ThreadPool::Priority priority);
+
+        ThreadPool & pool;
+        ThreadPool::Priority priority;
+        std::shared_ptr<State> state;
+    };
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Version.h"
+#include "DetectionParams.h"
+#include "FeatureStore.h"
+
+namespace ark {
+    namespace classifier {
+        /**
+         * Builds a FeatureStore from labeled recordings, running hand detection and
+         * feature extraction on all frames in parallel.
+         *
+         * Each frame (as written by DepthCamera::writeImage) contributes the features of the largest
+         * hand candidate found in it, labeled with the frame's label; frames with no candidate are skipped.
+         *
+         * Example:
+         * @code
+         *   auto samples = TrainingDataBuilder::readLabels("data/labels.txt", "data/frames");
+         *   TrainingDataBuilder().build(samples, FeatureStore::KIND_VALIDATOR, "data/" + DATA_STORE_FILE_NAME);
+         *   SVMHandValidator validator; validator.train("data/");
+         * @endcode
+         */
+        class TrainingDataBuilder {
+        public:
+            /** A labeled frame */
+            struct Sample {
+                /** path to the frame file */
+                std::string path;
+
+                /** label of the frame (1 = hand, 0 = not a hand) */
+                int label;
+            };
+
+            /** Summary of a build */
+            struct Report {
+                /** number of frames processed */
+                int numFrames = 0;
+
+                /** number of samples written to the store */
+                int numSamples = 0;
+
+                /** number of frames that could not be read, or where no hand candidate was found */
+                int numSkipped = 0;
+
+                /** total time taken, in ms */
+                double totalMs = 0.0;
+            };
+
+            /**
+             * Create a builder.
+             * @param params parameters for hand detection (if not specified, uses default params).
+             *               The SVM check is always disabled, so that the trainers see every candidate.
+             */
+            explicit TrainingDataBuilder(DetectionParams::Ptr params = nullptr);
+
+            /**
+             * Read a labels file in the format of DATA_LABELS_FILE_NAME
+             * (number of frames, then one "name label" pair per frame).
+             * @param labels_path path to the labels file
+             * @param frames_dir directory containing the frame files named in the labels file
+             */
+            static std::vector<Sample> readLabels(const std::string & labels_path, const std::string & frames_dir);
+
+            /**
+             * Extract features from all samples and write them to a feature store.
+             * @param samples labeled frames
+             * @param kind which classifier to extract features for
+             * @param out_path path of the feature store to write
+             * @return summary of the build (numSamples is 0 if the store could not be written)
+             */
+            Report build(const std::vector<Sample> & samples, FeatureStore::Kind kind,
+                         const std::string & out_path) const;
+
+        private:
+            /** hand detection parameters */
+            DetectionParams::Ptr params;
+        };
+    }
+}
@@ -192,9 +192,28 @@ namespace ark {
         * @param resolution pixel resolution of output normal matrix
         * @param fill_in if true, fills in all pixels of output matrix by copying
         *                else, only fills pixels at interval 'resolution'
+        * @param [in] exclude_mask optionally, mask (CV_8U, size of xyz_map) of pixels to skip;
+        *                          their normals are set to zero
         */
         void computeNormalMap(const cv::Mat & xyz_map, cv::Mat & output_mat,
-            int normal_dist = 6, int resolution = 2, bool fill_in = true);
+            int normal_dist = 6, int resolution = 2, bool fill_in = true,
+            const cv::Mat & exclude_mask = cv::Mat());
+
+        /**
+        * Compute the surface normal vectors of a point cloud on a contiguous, decimated grid.
+        * Pixel (i, j) of the outputs corresponds to pixel (i * resolution, j * resolution) of xyz_map,
+        * so the outputs are resolution^2 times smaller than a full-size normal map with fill_in = false.
+        * @param [in] xyz_map input point cloud
+        * @param [out] output_normals output normal matrix, of size xyz_map.size() / resolution
+        * @param [out] output_xyz the points of xyz_map the normals were computed at, same size
+        * @param normal_dist distance at which surface vectors are sampled to compute the normal
+        * @param resolution decimation factor
+        * @param [in] exclude_mask optionally, mask (CV_8U, size of xyz_map) of pixels to skip;
+        *                          their normals and points are set to zero
+        */
+        void computeDecimatedNormalMap(const cv::Mat & xyz_map, cv::Mat & output_normals,
+            cv::Mat & output_xyz, int normal_dist = 6, int resolution = 2,
+            const cv::Mat & exclude_mask = cv::Mat());
 
         /**
         * Determine whether (x,y) is a non-zero point in the matrix.
@@ -244,6 +263,62 @@ namespace ark {
             int interval1 = 1, int interval2 = 0, float interval2_dist = 0.05f, 
             cv::Mat * color = nullptr);
 
+        /**
+         * Bits of a connectivity map, marking which neighbors of a pixel it is connected to.
+         * @see computeConnectivityMap
+         */
+        enum ConnectivityBit {
+            /** connected to pixel at (x, y - interval1) */
+            CONNECT_UP = 1,
+            /** connected to pixel at (x, y + interval1) */
+            CONNECT_DOWN = 2,
+            /** connected to pixel at (x - interval1, y) */
+            CONNECT_LEFT = 4,
+            /** connected to pixel at (x + interval1, y) */
+            CONNECT_RIGHT = 8,
+            /** connected to pixel at (x, y - interval2) */
+            CONNECT_UP2 = 16,
+            /** connected to pixel at (x, y + interval2) */
+            CONNECT_DOWN2 = 32
+        };
+
+        /**
+         * Compute a connectivity map, marking for each pixel which neighbors lie within a threshold euclidean
+         * distance of it. Each pair of neighbors is tested exactly once.
+         * Works with both XYZ maps (3D distance) and normal maps (normal similarity).
+         * Flood fills may then traverse the bits instead of recomputing distances (see floodFillConnected).
+         * @param [in] map the input map (CV_32FC3)
+         * @param [out] output the connectivity map (CV_8U), a combination of ConnectivityBit values per pixel
+         * @param thresh maximum euclidean distance allowed between neighbors
+         * @param interval1 interval to adjacent points. If greater than 1, only pixels with row and column
+         *                  divisible by interval1 are connected
+         * @param interval2 additional interval to adjacent points (0 = not used), only for up/down
+         * @param interval2_thresh distance theshold for interval2
+         */
+        void computeConnectivityMap(const cv::Mat & map, cv::Mat & output, float thresh,
+            int interval1 = 1, int interval2 = 0, float interval2_thresh = 0.05f);
+
+        /**
+         * Performs a single floodfill on a connectivity map starting from seed point (x,y).
+         * @param [in] connectivity the connectivity map (see computeConnectivityMap)
+         * @param seed seed point
+         * @param [out] output_ij_points optionally, pointer to a vector for storing ij coords of the points in the component.
+         * @param [out] output_xyz_points optionally, pointer to a vector for storing xyz coords of the points in the component.
+         * @param [in] xyz_map the XYZ map to take the xyz coords from. Required if output_xyz_points is given.
+         * @param interval1, interval2 intervals used when computing the connectivity map
+         * @param [in, out] color an auxiliary matrix (CV_8U)
+         *             for recording if a point is being visited (1), has already been visited (0)
+         *             or is not yet visited (255)
+         *             By default, allocates a temporary matrix for use during flood fill.
+         * @return number of points in component
+         */
+        int floodFillConnected(const cv::Mat & connectivity, const Point2i & seed,
+            std::vector<Point2i> * output_ij_points = nullptr,
+            std::vector<Vec3f> * output_xyz_points = nullptr,
+            const cv::Mat * xyz_map = nullptr,
+            int interval1 = 1, int interval2 = 0,
+            cv::Mat * color = nullptr);
+
         /**
         * Compute the angle in radians 'pointij' is at from the origin, going CCW starting from (0, 1), if y-axis is facing up.
         * @param pointij input point in ij coordinates
@@ -443,6 +518,13 @@ namespace ark {
         */
         double diameter(const std::vector<cv::Point> & points, int & a, int & b);
 
+        /**
+         * Allocate the calling thread's scratch buffers for flood fill and point sorting
+         * (normally grown on first use) for frames of the given size.
+         * Called by ark::init() to avoid allocations on the first frames.
+         */
+        void reserveScratch(const cv::Size & frame_size);
+
         /**
           * Sort points by y and then x coordinate using radix sort
           * @param points[in] vector of points to sort
@@ -517,6 +599,16 @@ namespace ark {
         float radiusInDirection(const cv::Mat & xyz_map, const Point2i & center,
                              double angle, double angle_offset = 0.0);
 
+        /**
+         * Greedily match points of one set to points of another (e.g. objects between frames),
+         * closest pairs first, each point being matched at most once.
+         * @param a first set of points
+         * @param b second set of points
+         * @param max_dist maximum distance between matched points
+         * @return for each point of a, index of the matched point of b (-1 if unmatched)
+         */
+        std::vector<int> matchNearest(const std::vector<Vec3f> & a, const std::vector<Vec3f> & b, float max_dist);
+
         /**
          * Compares two points (Point, Point2f, Vec3i or Vec3f),
          * first by x, then y, then z (if available). Used for sorting points.
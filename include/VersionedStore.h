@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "Version.h"
+
+namespace ark {
+    /**
+     * Holds the current version of a shared, immutable object (parameters, models, ...) that may be
+     * replaced at any time by another thread, RCU-style: publishing swaps in a new object atomically,
+     * while readers keep using the snapshot they hold until they choose to pick up the new one.
+     *
+     * Readers on hot paths should use a Reader, which only checks an atomic version counter
+     * (no locks) unless a new version was published, and refresh it at frame boundaries.
+     * Published objects must not be modified afterwards.
+     *
+     * Example:
+     * @code
+     *   VersionedStore<Model> store(std::make_shared<Model>(...));
+     *   // processing thread
+     *   VersionedStore<Model>::Reader reader;
+     *   while (...) { reader.refresh(store); process(frame, *reader); }
+     *   // any other thread
+     *   store.publish(std::make_shared<Model>(...));
+     * @endcode
+     */
+    template<class T>
+    class VersionedStore {
+    public:
+        /** Pointer to a published version */
+        typedef std::shared_ptr<T> Snapshot;
+
+        /**
+         * Snapshot of a store, cached by one consumer.
+         * Not thread-safe: each thread (or each detector) should own its reader.
+         */
+        class Reader {
+        public:
+            /**
+             * Pick up the latest version of the store, if it changed since the last refresh.
+             * @return true if the snapshot changed
+             */
+            bool refresh(const VersionedStore & store)
+            {
+                const uint64_t latest = store.getVersion();
+                if (latest == version && bound == &store) return false;
+
+                // a version published in between is picked up on the next refresh
+                version = latest;
+                bound = &store;
+                snapshot = store.load();
+                return true;
+            }
+
+            /** Returns the cached snapshot */
+            const Snapshot & get() const { return snapshot; }
+
+            /** Returns the version of the cached snapshot */
+            uint64_t getVersion() const { return version; }
+
+            T & operator*() const { return *snapshot; }
+            T * operator->() const { return snapshot.get(); }
+
+        private:
+            const VersionedStore * bound = nullptr;
+            uint64_t version = 0;
+            Snapshot snapshot;
+        };
+
+        /** Create a store holding the given initial version */
+        explicit VersionedStore(Snapshot initial = Snapshot()) : current(initial) { }
+
+        VersionedStore(const VersionedStore &) = delete;
+        VersionedStore & operator=(const VersionedStore &) = delete;
+
+        /** Replace the current version. Readers pick it up on their next refresh. */
+        void publish(Snapshot value)
+        {
+            std::atomic_store(&current, value);
+            version.fetch_add(1, std::memory_order_release);
+        }
+
+        /** Get the current version */
+        Snapshot load() const
+        {
+            return std::atomic_load(&current);
+        }
+
+        /** Returns the number of versions published so far */
+        uint64_t getVersion() const
+        {
+            return version.load(std::memory_order_acquire);
+        }
+
+    private:
+        Snapshot current;
+        std::atomic<uint64_t> version{ 0 };
+    };
+}
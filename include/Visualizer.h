@@ -7,6 +7,7 @@
 
 // OpenARK headers
 #include "Hand.h"
+#include "PointCloudAdapter.h"
 
 namespace ark {
     /**
@@ -61,13 +62,32 @@ namespace ark {
         */
         static void visualizeCloud(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud);
 
+        /**
+        * Visualization for a xyz map as a PCL point cloud.
+        * The map is converted through a pooled PointCloudAdapter, so no cloud is allocated per frame.
+        * @param [in] xyz_map input point cloud matrix
+        */
+        static void visualizeCloud(const cv::Mat & xyz_map);
+
         /**
         * Visualization for polygon mesh.
-        * Visualize a PCL point cloud as a polygon mesh
+        * Visualize a PCL point cloud as a polygon mesh.
+        * Organized clouds (e.g. from PointCloudAdapter) are triangulated directly on the pixel grid,
+        * with normals from integral images; unorganized clouds fall back to greedy projection triangulation.
         * @param [in] cloud PCL point cloud to be visualized
         */
         static void visulizePolygonMesh(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud);
 
+        /**
+        * Visualization for polygon mesh.
+        * Visualize a xyz map as a polygon mesh, triangulated directly on the pixel grid.
+        * @param [in] xyz_map input point cloud matrix
+        * @param [in] normal_map optionally, a full-size normal map for shading
+        *                        (e.g. from util::computeNormalMap with fill_in = true);
+        *                        if empty, normals are estimated from integral images
+        */
+        static void visulizePolygonMesh(const cv::Mat & xyz_map, const cv::Mat & normal_map = cv::Mat());
+
         /**
         * Visualization for plane regression.
         * @param [in] input_mat the base xyzMap on which to draw the visualization
@@ -87,13 +107,23 @@ namespace ark {
         */
         static void visualizePlanePoints(cv::Mat &input_mat, std::vector<Point2i> indicies);
 
-    private:
         /**
-         * Initializes & opens the PCL visualizer
+         * Initializes & opens the PCL visualizer (otherwise done on first use)
          * @return true on success, false if visualizer already open
          */
         static bool initPCLViewer();
 
+    private:
+        /**
+         * Triangulate an organized cloud with normals on its pixel grid and show it in the PCL viewer
+         */
+        static void visualizeOrganizedMesh(pcl::PointCloud<pcl::PointNormal>::Ptr cloud);
+
+        /**
+         * Show a polygon mesh in the PCL viewer
+         */
+        static void showPolygonMesh(const pcl::PolygonMesh & mesh);
+
         /**
         * Visualization for a generic matrix.
         * @param [in] input matrix to be visualized
@@ -114,5 +144,10 @@ namespace ark {
         */
         static pcl::visualization::PCLVisualizer * viewer;
 
+        /**
+        * Adapter used to convert xyz maps for the PCL viewer
+        */
+        static PointCloudAdapter cloudAdapter;
+
     };
 }
@@ -46,6 +46,21 @@ int main() {
     // initialize detectors
     PlaneDetector::Ptr planeDetector = std::make_shared<PlaneDetector>();
     HandDetector::Ptr handDetector = std::make_shared<HandDetector>(planeDetector);
+
+    // load models & warm up the pipeline (on throwaway detectors) before the first frame
+    InitOptions initOptions;
+    initOptions.frameSize = camera->getImageSize();
+    initOptions.params = params;
+    std::cout << init(initOptions).toString() << "\n\n";
+
+    // shed detection quality when frames take longer than the camera's frame interval
+    LatencyGovernor governor(params, 1000.0 / 30.0);
+    governor.addDetector(planeDetector);
+    governor.addDetector(handDetector);
+    governor.addTransitionCallback([](const LatencyGovernor::Transition & t) {
+        std::cout << "Quality level " << t.fromLevel << " -> " << t.toLevel
+                  << " (frame time " << t.frameMs << " ms)\n";
+    });
     
     // store frame & FPS information
     const int FPS_CYCLE_FRAMES = 8; // number of frames to average FPS over (FPS 'cycle' length)
@@ -63,36 +78,49 @@ int main() {
     // option flags
     bool showHands = true, showPlanes = false, useSVM = true, useEdgeConn = false, showArea = false, playing = true;
 
-    // turn on the camera
+    // the IR/RGB background is drawn from these streams; subscribe before capturing so they are enabled up front
+    if (camera->hasIRMap()) camera->subscribe(DepthCamera::CHANNEL_IR);
+    else if (camera->hasRGBMap()) camera->subscribe(DepthCamera::CHANNEL_RGB);
+
+    // turn on the camera, restarting it automatically if it stalls
     camera->beginCapture();
+    CaptureWatchdog watchdog(*camera);
+    watchdog.start();
 
     // main demo loop
     while (true)
     {
         ++currFrame;
+        governor.beginFrame();
 
         // get latest image from the camera
         cv::Mat xyzMap = camera->getXYZMap();
 
         /**** Start: Hand/plane detection ****/
 
-        // query objects in the current frame
-        params->handUseSVM = useSVM;
-        params->handRequireEdgeConnected = useEdgeConn;
+        // pass changed options on to the detectors (they take effect from the next update)
+        if (params->handUseSVM != useSVM || params->handRequireEdgeConnected != useEdgeConn) {
+            params->handUseSVM = useSVM;
+            params->handRequireEdgeConnected = useEdgeConn;
+            governor.setBaseParams(params);
+        }
 
+        // query objects in the current frame
         std::vector<Hand::Ptr> hands;
         std::vector<FramePlane::Ptr> planes;
-
-        planeDetector->setParams(params);
-        handDetector->setParams(params);
         
         if (showPlanes || showHands) {
             /* even if only hand layer is enabled, 
-               planes need to be detected anyway for finding hand contact points */
-            planeDetector->update(*camera);
+               planes need to be detected anyway for finding hand contact points
+               (under load, the governor may keep the previous planes for some frames) */
+            if (governor.shouldRunPlanes()) {
+                LatencyGovernor::StageTimer timer(governor, "planes");
+                planeDetector->update(*camera);
+            }
             planes = planeDetector->getPlanes();
 
             if (showHands) {
+                LatencyGovernor::StageTimer timer(governor, "hands");
                 handDetector->update(*camera);
                 hands = handDetector->getHands();
             }
@@ -125,7 +153,9 @@ int main() {
             // normal map background
             cv::Mat normalMap = planeDetector->getNormalMap();
             if (!normalMap.empty()) {
-                Visualizer::visualizeNormalMap(normalMap, handVisual, params->normalResolution);
+                // the normal map is decimated; scale it back up to the frame size
+                Visualizer::visualizeNormalMap(normalMap, handVisual, 1);
+                cv::resize(handVisual, handVisual, camera->getImageSize(), 0, 0, cv::INTER_LINEAR);
             }
             else {
                 handVisual = cv::Mat::zeros(camera->getImageSize(), CV_8UC3);
@@ -221,6 +251,11 @@ int main() {
             static char chr[32];
             sprintf(chr, "FPS: %02.3f", currFPS);
             cv::putText(handVisual, chr, Point2i(handVisual.cols - 120, 25), 0, 0.5, WHITE);
+            if (governor.getLevel() > 0) {
+                // reduced quality to keep up with the camera
+                cv::putText(handVisual, "Quality: -" + std::to_string(governor.getLevel()),
+                    Point2i(handVisual.cols - 120, 75), 0, 0.5, WHITE);
+            }
 #ifdef DEBUG
             cv::putText(handVisual, "Frame: " + std::to_string(currFrame),
                 Point2i(handVisual.cols - 120, 50), 0, 0.5, WHITE);
@@ -259,6 +294,8 @@ int main() {
         }
         /**** End: Visualization ****/
 
+        if (playing && !camera->badInput()) governor.endFrame();
+
         /**** Start: Controls ****/
         int c = cv::waitKey(wait);
 
@@ -296,6 +333,7 @@ int main() {
     }
 
     camera->endCapture();
+    std::cout << governor.getStats().toString() << "\n";
 
     cv::destroyAllWindows();
     return 0;
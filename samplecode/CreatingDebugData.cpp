@@ -22,7 +22,7 @@ int main() {
     {
         /**** Start: Write Frames to File ****/
         std::string filename = "img" + std::to_string(frame) + ".yml";
-        camera->writeImage(filename);
+        camera->writeImageAsync(filename);
         std::cout << "Saved: " << filename <<  std::endl;
         /**** End: Write Frames to File ****/
         cv::Mat visual; ark::Visualizer::visualizeXYZMap(camera->getXYZMap(), visual);
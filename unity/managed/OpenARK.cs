@@ -98,6 +98,43 @@ namespace OpenARK
             return result;
         }
 
+        /** get a list of hands in the current frame, with their palm centers and fingertips
+          * predicted to the time they will be displayed to compensate for detection latency
+          * @param leadMs time from now (ms) at which the hands will be displayed
+          */
+        public List<Hand> getPredictedHands(float leadMs)
+        {
+            List<Hand> result = getHands();
+            int nPredicted = Internal.predictHands(leadMs);
+
+            for (int i = 0; i < nPredicted && i < result.Count; ++i)
+            {
+                result[i].center = Internal.readVector3(Internal.predictedHandPos, i);
+                int nFingers = Internal.predictedHandNumFingers(i);
+                result[i].fingers = Internal.readArray(Internal.predictedFingerPos, i, nFingers);
+            }
+
+            return result;
+        }
+
+        /** mean distance (m) between predicted positions and the positions later measured */
+        public float predictionError
+        {
+            get
+            {
+                return Internal.predictionMeanError();
+            }
+        }
+
+        /** mean distance (m) between unpredicted (last known) positions and the positions later measured */
+        public float uncompensatedError
+        {
+            get
+            {
+                return Internal.predictionMeanUncompensatedError();
+            }
+        }
+
         /** get a list of planes in the current frame */
         public List<Plane> getPlanes()
         {
@@ -268,6 +305,37 @@ namespace OpenARK
         [DllImport(OPENARK_DLL)]
         public static extern float handDefectPos(int hand_id, int index, int axis);
 
+        /*** PREDICTION ***/
+        /** Predict the hands of the current frame at a time relative to now (ms)
+          * @return number of hands predicted
+          */
+        [DllImport(OPENARK_DLL)]
+        public static extern int predictHands(float lead_ms);
+
+        /** Get the predicted palm center of hand 'hand_id' computed by predictHands
+          * @param axis 0:x 1:y 2:z coordinates
+          */
+        [DllImport(OPENARK_DLL)]
+        public static extern float predictedHandPos(int hand_id, int axis);
+
+        /** Get the number of fingers predicted on hand 'hand_id' by predictHands */
+        [DllImport(OPENARK_DLL)]
+        public static extern int predictedHandNumFingers(int hand_id);
+
+        /** Get the predicted coordinates of 'index'th finger on hand 'hand_id' computed by predictHands
+          * @param axis 0:x 1:y 2:z coordinates
+          */
+        [DllImport(OPENARK_DLL)]
+        public static extern float predictedFingerPos(int hand_id, int index, int axis);
+
+        /** Get the mean distance between predicted positions and the positions later measured (meters) */
+        [DllImport(OPENARK_DLL)]
+        public static extern float predictionMeanError();
+
+        /** Get the mean distance between unpredicted positions and the positions later measured (meters) */
+        [DllImport(OPENARK_DLL)]
+        public static extern float predictionMeanUncompensatedError();
+
         /*** PLANE ***/
         /** Get the coordinates at the center of mass of plane 'plane_id'
           * @param axis 0:x 1:y 2:z coordinates
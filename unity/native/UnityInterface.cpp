@@ -19,7 +19,10 @@ extern "C" {
     static ark::DetectionParams::Ptr params;
     static const std::vector<ark::Hand::Ptr> * hands;
     static const std::vector<ark::FramePlane::Ptr> * planes;
+    static ark::HandPredictor::Ptr predictor;
+    static std::vector<ark::HandPredictor::PredictedHand> predictedHands;
     static std::vector<int> touches;
+    static std::chrono::steady_clock::time_point lastFrameTime;
 
     static int lastTouchHand;
 
@@ -33,6 +36,7 @@ extern "C" {
         params = ark::DetectionParams::create();
         pd = std::make_shared<ark::PlaneDetector>(params);
         hd = std::make_shared<ark::HandDetector>(pd, params);
+        predictor = std::make_shared<ark::HandPredictor>();
     }
 
     void update() {
@@ -40,10 +44,19 @@ extern "C" {
             std::this_thread::sleep_for(std::chrono::milliseconds(10));
             return;
         }
-        pd->update(*camera);
-        hd->update(*camera);
+
+        // take the capture time together with the frame, so that it always matches the detected hands
+        std::chrono::steady_clock::time_point frameTime;
+        const cv::Mat xyzMap = camera->getXYZMap(frameTime);
+        if (frameTime == lastFrameTime) return;
+        lastFrameTime = frameTime;
+
+        pd->update(xyzMap);
+        hd->update(xyzMap);
         planes = &pd->getPlanes();
         hands = &hd->getHands();
+
+        predictor->update(*hands, frameTime);
     }
 
     void beginCapture() {
@@ -104,6 +117,40 @@ extern "C" {
         return hands->at(hand_id)->getDefects()[index][axis];
     }
 
+    int predictHands(float lead_ms)
+    {
+        if (!predictor) return 0;
+        predictedHands = predictor->predictAhead(lead_ms);
+        return (int) predictedHands.size();
+    }
+
+    float predictedHandPos(int hand_id, int axis)
+    {
+        return predictedHands.at(hand_id).palmCenter[axis];
+    }
+
+    int predictedHandNumFingers(int hand_id)
+    {
+        return (int) predictedHands.at(hand_id).fingers.size();
+    }
+
+    float predictedFingerPos(int hand_id, int index, int axis)
+    {
+        return predictedHands.at(hand_id).fingers[index][axis];
+    }
+
+    float predictionMeanError()
+    {
+        if (!predictor) return 0.0f;
+        return (float) predictor->getStats().meanError;
+    }
+
+    float predictionMeanUncompensatedError()
+    {
+        if (!predictor) return 0.0f;
+        return (float) predictor->getStats().meanUncompensatedError;
+    }
+
     float planePos(int plane_id, int axis)
     {
         return planes->at(plane_id)->getCenter()[axis];
@@ -65,6 +65,35 @@ extern "C" {
       */
     UnityPlugin_API float handDefectPos(int hand_id, int index, int axis);
 
+    /*** PREDICTION ***/
+    /** Predict the hands of the current frame at a time relative to now, compensating for latency.
+      * Hand i of the prediction is hand i of the current frame.
+      * @see predictedHandPos
+      * @see predictedFingerPos
+      * @param lead_ms time from now (ms) at which the prediction will be displayed
+      * @return number of hands predicted
+      */
+    UnityPlugin_API int predictHands(float lead_ms);
+
+    /** Get the predicted palm center of hand 'hand_id' computed by predictHands (meters)
+      * @param axis 0:x 1:y 2:z coordinates
+      */
+    UnityPlugin_API float predictedHandPos(int hand_id, int axis);
+
+    /** Get the number of fingers predicted on hand 'hand_id' by predictHands */
+    UnityPlugin_API int predictedHandNumFingers(int hand_id);
+
+    /** Get the predicted coordinates of 'index'th finger on hand 'hand_id' computed by predictHands
+      * @param axis 0:x 1:y 2:z coordinates
+      */
+    UnityPlugin_API float predictedFingerPos(int hand_id, int index, int axis);
+
+    /** Get the mean distance between predicted positions and the positions later measured (meters) */
+    UnityPlugin_API float predictionMeanError();
+
+    /** Get the mean distance between unpredicted (last known) positions and the positions later measured (meters) */
+    UnityPlugin_API float predictionMeanUncompensatedError();
+
     /*** PLANE ***/
     /** Get the coordinates at the center of mass of plane 'plane_id'
       * @param axis 0:x 1:y 2:z coordinates